@@ -0,0 +1,36 @@
+/**
+ * @file     backlog.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Flash store-and-forward of readings that could not be sent
+ */
+
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+#include <stdint.h>
+#include <time.h>
+#include <esp_err.h>
+
+#include "configuration.h"
+#include "channels.h"
+
+#if BACKLOG_ENABLE
+
+void backlog_store(channel_id_t channel, int32_t value, time_t timestamp);
+uint8_t backlog_is_offline(time_t timestamp);
+void backlog_result(esp_err_t status, time_t timestamp);
+esp_err_t backlog_replay(void);
+
+#else
+
+#define backlog_store(channel, value, timestamp)
+#define backlog_is_offline(timestamp) 0
+#define backlog_result(status, timestamp)
+#define backlog_replay()
+
+#endif
+
+#endif
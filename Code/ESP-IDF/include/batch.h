@@ -0,0 +1,32 @@
+/**
+ * @file     batch.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    RTC memory buffer for batched measurement publishing
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <time.h>
+#include <esp_err.h>
+#include "channels.h"
+
+typedef struct
+{
+    uint32_t timestamp; // Measurement timestamp [sec]
+    uint8_t channel;    // channel_id_t
+    int32_t value;      // Measurement value [fixed point units]
+} batch_entry_t;
+
+void batch_push(channel_id_t channel, int32_t value, time_t timestamp);
+uint8_t batch_count(void);
+uint8_t batch_is_due(time_t timestamp);
+time_t batch_due_in(time_t timestamp);
+void batch_clear(void);
+esp_err_t batch_flush(void);
+
+#endif
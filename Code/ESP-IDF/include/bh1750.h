@@ -12,12 +12,33 @@
 
 #include <stdint.h>
 #include <esp_err.h>
+#include <esp_attr.h>
+#include "configuration.h"
 #include "typedefs.h"
 
-esp_err_t bh1750_setup(bh1750_mode_t mode, bh1750_resolution_t resolution);
-esp_err_t bh1750_read(uint16_t *level);
-esp_err_t bh1750_power_down();
-esp_err_t bh1750_power_on();
-esp_err_t bh1750_set_measurement_time(uint8_t time);
+typedef struct
+{
+    bh1750_mode_t mode;
+    bh1750_resolution_t resolution; // LOW, HIGH or HIGH2
+    uint8_t mtreg;                  // Measurement time register
+    uint32_t lux_min;               // Auto-ranging: a darker reading switches to a finer range [lx]
+    uint32_t lux_max;               // Auto-ranging: a brighter reading switches to a coarser range [lx]
+    uint8_t opcode;                 // Measurement command, set with the range
+    uint32_t conversion_us;         // Maximum conversion time, set with the range [us]
+} bh1750_range_t;
+
+extern RTC_DATA_ATTR bh1750_range_t rtc_bh1750_range[LIGHT_SENSORS]; // Active range of every sensor, the sensors keep it during deep sleep
+
+esp_err_t bh1750_setup(uint8_t sensor, bh1750_mode_t mode, bh1750_resolution_t resolution);
+esp_err_t bh1750_auto_range(uint8_t sensor, uint32_t level);
+uint32_t bh1750_conversion_time_us(uint8_t sensor);
+void bh1750_wait_conversion(uint8_t sensor);
+esp_err_t bh1750_start_submit(uint8_t sensor, uint32_t *level);
+esp_err_t bh1750_read_result(uint8_t sensor, uint32_t *level);
+esp_err_t bh1750_read(uint8_t sensor, uint32_t *level);
+esp_err_t bh1750_read_submit(uint8_t sensor, uint32_t *level);
+esp_err_t bh1750_power_down(uint8_t sensor);
+esp_err_t bh1750_power_on(uint8_t sensor);
+esp_err_t bh1750_set_measurement_time(uint8_t sensor, uint8_t time);
 
 #endif
\ No newline at end of file
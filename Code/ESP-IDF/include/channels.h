@@ -0,0 +1,52 @@
+/**
+ * @file     channels.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Measurement channel table
+ */
+
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <esp_err.h>
+#include <esp_sleep.h>
+
+#include "configuration.h"
+#include "decision.h"
+
+typedef enum
+{
+    CHANNEL_LIGHT = 0, // One light channel per light sensor
+    CHANNEL_TEMPERATURE = CHANNEL_LIGHT + LIGHT_SENSORS,
+    CHANNEL_HUMIDITY,
+    CHANNEL_MAX
+} channel_id_t;
+
+_Static_assert(CHANNEL_MAX <= 8, "Channel masks are 8 bits");
+
+#define CHANNEL_TIMESTAMP_UNKNOWN ((time_t)-1) // Reading time lost with a reset, published without an age
+
+typedef struct
+{
+    const char *key;                                                       // Key in the combined state message
+    uint8_t sensor;                                                        // Sensor index in devices.c, passed to read and publish
+    uint8_t decimals;                                                      // Decimal digits of the fixed point value
+    decision_config_t decision;                                            // Default report policy and thresholds [fixed point units], see settings.h
+    esp_err_t (*read)(uint8_t sensor, int32_t *value);                     // Value of the last acquisition
+    esp_err_t (*publish)(uint8_t sensor, int32_t value, time_t timestamp); // Publish a value with its age, MQTT must be already setup
+} channel_t;
+
+extern const channel_t channels[CHANNEL_MAX];
+extern RTC_DATA_ATTR channel_state_t rtc_channels[CHANNEL_MAX];
+
+void channels_reset(void);
+uint8_t channel_is_expired(channel_id_t id, time_t timestamp);
+time_t channels_expire_in(time_t timestamp);
+uint8_t handle_measurement(channel_id_t id, int32_t value, time_t timestamp);
+void channel_force(channel_id_t id, int32_t value, time_t timestamp);
+
+#endif
@@ -11,19 +11,56 @@
 #define CONFIGURATION_H
 
 // GENERAL
-#define SLEEP_INTERVAL_SEC 5             // Time between measurements [sec]
+#define SLEEP_INTERVAL_SEC 5             // Time between measurements, if not adaptive [sec]
 #define SENSOR_UPDATE_INTERVAL_MAX 300   // Force an update after determined time [sec]
 #define LIGHT_UPDATE_THRESHOLD 2         // Update if light changes more than this [lux]
 #define TEMPERATURE_UPDATE_THRESHOLD 0.2 // Update if temperature changes more than this [°C/°F]
 #define HUMIDITY_UPDATE_THRESHOLD 2      // Update if humidity changes more than this [%]
 
+#define LIGHT_UPDATE_POLICY DECISION_POLICY_DELTA       // Report policy (DELTA, RELATIVE, HYSTERESIS, SWINGING_DOOR), see decision.h
+#define LIGHT_UPDATE_RELATIVE 10                        // RELATIVE policy: update if light changes more than this [%]
+#define TEMPERATURE_UPDATE_POLICY DECISION_POLICY_DELTA // Report policy
+#define HUMIDITY_UPDATE_POLICY DECISION_POLICY_DELTA    // Report policy
+
 #define TEMPERATURE_USE_FAHRENHEIT 0 // Enable Fahrenheit measurements
 
+#define LIGHT_SENSORS 1 // BH1750 light sensors (1 to 4), one light channel each, wired as listed in devices.c, 3 and 4 need I2C_SECONDARY_ENABLE
+
+#define LIGHT_OVERSAMPLE 1                  // Readings per measurement, filtered into one value
+#define LIGHT_FILTER FILTER_MEDIAN          // Filter of the readings (MEDIAN, TRIMMED_MEAN), see filter.h
+#define TEMPERATURE_OVERSAMPLE 1            // Readings per measurement, taken with the humidity ones
+#define TEMPERATURE_FILTER FILTER_MEDIAN    // Filter of the readings
+#define HUMIDITY_OVERSAMPLE 1               // Readings per measurement
+#define HUMIDITY_FILTER FILTER_TRIMMED_MEAN // Filter of the readings
+
+#define SLEEP_ADAPTIVE 0           // Stretch the time between measurements while readings are stable, up to SLEEP_INTERVAL_MAX_SEC
+#define SLEEP_INTERVAL_MIN_SEC 5   // Shortest adaptive time between measurements [sec]
+#define SLEEP_INTERVAL_MAX_SEC 120 // Longest adaptive time between measurements [sec]
+
+#define BATCH_ENABLE 0            // Store readings in RTC memory and publish them in a single Wi-Fi session
+#define BATCH_SIZE 16             // Flush when this many readings are stored
+#define BATCH_MAX_LATENCY_SEC 120 // Flush when the oldest stored reading is older than this [sec]
+
+#define BACKLOG_ENABLE 0           // Keep readings that could not be sent in flash and send them later, needs the partitions.csv table flashed
+#define BACKLOG_RETRY_MIN_SEC 30   // Wait before connecting again after a failed session [sec]
+#define BACKLOG_RETRY_MAX_SEC 1800 // Longest wait, doubled after every failed session [sec]
+
+#define WAKE_STUB_ENABLE 0   // Check the light level in the deep sleep wake stub, boot only when needed, not yet validated on a board
+#define WAKE_STUB_SKIP_MAX 4 // Wakes in a row handled by the stub, before a full boot reads every sensor
+
+#define PIR_HOLDOFF_SEC 30   // Report the end of motion after no motion for this time [sec]
+#define PIR_PIGGYBACK_SEC 60 // Send with motion the channels due within this time [sec]
+
+#define SETTINGS_REMOTE 0 // Override the settings above and the sensor resolutions with the retained settings topic
+
 // WI-FI
 #define WIFI_SSID "wifi"
 #define WIFI_PASSWORD "password"
 #define WIFI_MAXIMUM_RETRY 5
 
+#define WIFI_FAST_RECONNECT 1    // Reuse access point and IP lease of the last connection
+#define WIFI_SPECULATIVE_START 1 // Connect while reading sensors: 0 never, 1 when a report is already due, 2 always
+
 #define WIFI_STATIC_IP 0 // Enable static IP
 #define WIFI_IP_ADDRESS "192.168.1.100"
 #define WIFI_DEFAULT_GATEWAY "192.168.1.1"
@@ -37,30 +74,62 @@
 
 #define MQTT_NODE_NAME "ESP32-SensorNode" // ESP32 SensorNode name on MQTT
 #define MQTT_ENABLE_DISCOVERY 1           // Enable automatic Home Assistant sensor discovery
+#define MQTT_COMBINED_PAYLOAD 0           // Send all measurements in a single JSON message on the state topic
 
 #define MQTT_LIGHT_TOPIC "light"             // Light topic
 #define MQTT_TEMPERATURE_TOPIC "temperature" // Temperature topic
 #define MQTT_HUMIDITY_TOPIC "humidity"       // Humidity topic
 #define MQTT_PIR_TOPIC "motion"              // Motion topic
+#define MQTT_STATE_TOPIC "state"             // Combined measurements topic
+#define MQTT_DIAGNOSTICS_TOPIC "diagnostics" // Wake trace topic
+#define MQTT_SETTINGS_TOPIC "settings"       // Runtime settings topic, see settings.c
 
 /* ADVANCED CONFIGURATION - From here don't edit if not sure ******************/
 
 // MQTT
 #define MQTT_SENSOR_DISCOVERY_TOPIC "homeassistant/sensor"
 #define MQTT_BINARY_SENSOR_DISCOVERY_TOPIC "homeassistant/binary_sensor"
-#define MQTT_TOPIC_MAX_LEN 80
-#define MQTT_CONFIGURATION_PAYLOAD_MAX_LEN 200
+#define MQTT_STATUS_TOPIC "homeassistant/status" // Home Assistant birth message topic
+#define MQTT_STATUS_ONLINE "online"              // Home Assistant birth message payload
+#define MQTT_NVS_NAMESPACE "mqtt"                // NVS namespace of the published discovery hash
 #define MQTT_MEASUREMENT_MAX_LEN 10
+#define MQTT_STATE_MAX_LEN (176 + 40 * (LIGHT_SENSORS - 1)) // Combined payload with the ages, grows with every light sensor
+#define MQTT_WINDOW_SIZE 8 // Maximum messages in flight before waiting for acks
+
+// BACKLOG
+#define BACKLOG_PARTITION "readings" // Flash partition label, see partitions.csv
+#define BACKLOG_REPLAY_MAX 32        // Stored readings sent per session
+
+// SETTINGS
+#define SETTINGS_NVS_NAMESPACE "settings" // NVS namespace of the received settings
+#define SETTINGS_PAYLOAD_MAX_LEN 256      // Longest settings payload
+#define SETTINGS_INTERVAL_MAX_SEC 604800  // Longest received interval, keeps timestamp sums in range [sec]
+
+// SLEEP
+#define SLEEP_RATE_EWMA_SHIFT 2 // Weight of a new rate of change sample: 1 / 2^N
+#define WAKE_STUB_I2C_DELAY_US 5 // Wake stub I2C half clock period [us]
+
+// DIAGNOSTICS
+#define TRACE_ENABLE 0          // Print the awake time of every wake phase before deep sleep, for bench measurements
+#define TRACE_PUBLISH 0         // Keep a trace of the last wakes in RTC memory and publish it when connected
+#define TRACE_BUFFER_SIZE 96    // Trace events kept in RTC memory
+#define TRACE_PUBLISH_EVENTS 8  // Trace events per diagnostics message
+
+// WI-FI - Fast reconnect and setup task
+#define WIFI_CACHE_LEASE_SEC 3600 // Renew the cached IP lease with DHCP after this time [sec]
+#define WIFI_SETUP_TASK_STACK_SIZE 4096
+#define WIFI_SETUP_TASK_PRIORITY 5
 
 // TIMEOUTS
 #define WIFI_SETUP_TIMEOUT_MS 500 // Wi-Fi connection timeout
-#define MQTT_SEND_TIMEOUT_MS 200  // MQTT message timeout
+#define MQTT_SEND_TIMEOUT_MS 200  // MQTT acks timeout, for all messages in flight
 
 // EVENT BITS
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 #define MQTT_PUBLISHED_BIT BIT2
 #define MQTT_ERROR_BIT BIT3
+#define WIFI_SETUP_DONE_BIT BIT4
 
 // I2C
 #define I2C_MASTER_SCL_IO 22      // I2C clock pin
@@ -68,10 +137,26 @@
 #define I2C_MASTER_NUM 0          // I2C port
 #define I2C_MASTER_FREQ_HZ 400000 // I2C bus frequency
 
+#define I2C_SECONDARY_ENABLE 0       // Second I2C controller, its transactions run in parallel with the first one
+#define I2C_SECONDARY_SCL_IO 26      // Second I2C clock pin
+#define I2C_SECONDARY_SDA_IO 25      // Second I2C data pin
+#define I2C_SECONDARY_NUM 1          // Second I2C port
+#define I2C_SECONDARY_FREQ_HZ 400000 // Second I2C bus frequency
+#define I2C_WORKER_TASK_STACK_SIZE 2048
+#define I2C_WORKER_TASK_PRIORITY 5
+
+#define I2C_QUEUE_SIZE (6 + 2 * LIGHT_SENSORS) // Maximum queued transactions per controller, two per light sensor in a burst
+#define I2C_TRANSACTION_MAX_LEN 4              // Maximum bytes written or read by a transaction
+#define I2C_TRANSACTION_TIMEOUT_MS 50          // Transaction timeout
+
+// TCA9548A - I2C multiplexer
+#define TCA9548A_ADDR 0x70 // Multiplexer address, 0x70 to 0x77 with the address pins
+
 // BH1750 - Light sensor
-#define BH1750_ADDR 0x23                   // Sensor address
-#define BH1750_MODE BH1750_MODE_CONTINIOUS // Sensor mode
-#define BH1750_RESOLUTION BH1750_RES_HIGH  // Sensor resolution
+#define BH1750_ADDR 0x23                  // Sensor address
+#define BH1750_ADDR_ALT 0x5C              // Sensor address with the ADDR pin high
+#define BH1750_MODE BH1750_MODE_ONE_TIME  // Sensor mode (ONE_TIME: powered down between readings, CONTINIOUS: converts through deep sleep)
+#define BH1750_RESOLUTION BH1750_RES_AUTO // Sensor resolution (LOW, HIGH, HIGH2, AUTO)
 
 #define BH1750_OPCODE_HIGH 0x0 // I2C Operation Codes
 #define BH1750_OPCODE_HIGH2 0x1
@@ -83,6 +168,15 @@
 #define BH1750_OPCODE_MT_HI 0x40
 #define BH1750_OPCODE_MT_LO 0x60
 
+#define BH1750_MTREG_MIN 31 // Measurement time register range
+#define BH1750_MTREG_MAX 254
+
+#define BH1750_CONVERSION_HIGH_US 180000 // Maximum conversion time at the default measurement time, H and H2 resolution [us]
+#define BH1750_CONVERSION_LOW_US 24000   // Maximum conversion time at the default measurement time, L resolution [us]
+
+// OVERSAMPLING
+#define OVERSAMPLE_INTERVAL_US 0 // Shortest time between the readings of a burst, with LIGHT_OVERSAMPLE > 1 also one BH1750 conversion [us]
+
 // SI7021 - Temperature and humidity sensor
 #define SI7021_ADDR 0x40                   // Temperature and humidity sensor I2C address
 #define SI7021_RESOLUTION SI7021_RES_HIGH2 // Temperature and humidity sensor resolution
@@ -94,9 +188,14 @@
 #define SI7021_REG_READ 0xE7
 #define SI7021_RESET 0xFE
 
-#define MEASUREMENT_WAIT 25 // Measurement delay
+#define SI7021_REG_RES1 0x80 // User register resolution bits
+#define SI7021_REG_RES0 0x01
+
+#define SI7021_POLL_INTERVAL_US 500 // Interval between reads while a conversion is running [us]
+#define SI7021_CRC_RETRIES 2        // Measurements repeated on checksum error
 
 // AS312 - PIR
-#define PIR_GPIO 13 // PIR GPIO
+#define PIR_GPIO 13       // PIR GPIO
+#define PIR_QUEUE_SIZE 16 // Motion edges kept in RTC memory
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+/**
+ * @file     conversions.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Fixed point conversion of raw sensor readings.
+ *           Results are integers, temperature and humidity in hundredths,
+ *           so conversions never go through the software double support.
+ *           Only depends on stdint.h, so the same kernels are built by
+ *           the host benchmark in tools/.
+ */
+
+#ifndef CONVERSIONS_H
+#define CONVERSIONS_H
+
+#include <stdint.h>
+
+/**
+ * @brief    Si7021 code conversion to humidity,
+ *           RH = 125 * code / 65536 - 6
+ *
+ * @param    code: Raw humidity sensor reading
+ * @return   int32_t humidity [% / 100]
+ */
+static inline int32_t si7021_code_to_rh_centi(const uint16_t code)
+{
+    return (int32_t)((12500u * code + 32768u) >> 16) - 600;
+}
+
+/**
+ * @brief    Si7021 code conversion to celsius temperature,
+ *           T = 175.72 * code / 65536 - 46.85
+ *
+ * @param    code: Raw temperature sensor reading
+ * @return   int32_t temperature [°C / 100]
+ */
+static inline int32_t si7021_code_to_celsius_centi(const uint16_t code)
+{
+    return (int32_t)((17572u * code + 32768u) >> 16) - 4685;
+}
+
+/**
+ * @brief    Si7021 code conversion to fahrenheit temperature,
+ *           T = 316.296 * code / 65536 - 52.33.
+ *           The 31629.6 / 65536 factor is scaled by 2^32, so the
+ *           product needs 64 bits.
+ *
+ * @param    code: Raw temperature sensor reading
+ * @return   int32_t temperature [°F / 100]
+ */
+static inline int32_t si7021_code_to_fahrenheit_centi(const uint16_t code)
+{
+    return (int32_t)((2072877466ull * code + 0x80000000ull) >> 32) - 5233;
+}
+
+#define BH1750_MTREG_DEFAULT 69 // Measurement time register the datasheet count / 1.2 refers to
+
+/**
+ * @brief    BH1750 count conversion to illuminance,
+ *           lux = count / 1.2 * 69 / MTreg, halved in H2 resolution.
+ *           Computed in 32 bits, the full 16 bit count range fits.
+ *
+ * @param    count: Raw light sensor reading
+ * @param    mtreg: Measurement time register, 31 to 254
+ * @param    half: 1 in H2 resolution, 0 otherwise
+ * @return   uint32_t illuminance [lx]
+ */
+static inline uint32_t bh1750_count_to_lux(const uint16_t count, const uint8_t mtreg, const uint8_t half)
+{
+    uint32_t divisor = 6u * mtreg << half;
+    return (count * 5u * BH1750_MTREG_DEFAULT + divisor / 2) / divisor;
+}
+
+#endif
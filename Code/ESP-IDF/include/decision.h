@@ -0,0 +1,284 @@
+/**
+ * @file     decision.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Report decision of a measurement channel.
+ *           Only depends on the C library, so the same logic runs in the
+ *           firmware and in the host tools.
+ *
+ *           Every policy bounds the error between the measurements and
+ *           what the receiver reconstructs from the reports:
+ *           - DELTA: last report held, error <= threshold
+ *           - RELATIVE: last report held, error <= max(threshold,
+ *             relative * |last report|), a logarithmic step for light
+ *           - HYSTERESIS: last report held, error <= threshold, and
+ *             <= threshold / 2 once a change lasts DECISION_HYSTERESIS_SAMPLES
+ *           - SWINGING_DOOR: reports linearly interpolated, error <= threshold
+ *             plus half a unit of rounding. The reported point ends the
+ *             segment at the last sample before the door closed, so the
+ *             report carries a past timestamp. The bound only holds on
+ *             that time: the report is published with its age (see
+ *             mqtt.c) and the receiver places it at receive time - age.
+ *             A receiver that places reports at their receive time only
+ *             gets the bound of a held value shifted by the report delay.
+ */
+
+#ifndef DECISION_H
+#define DECISION_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DECISION_HYSTERESIS_SAMPLES 3 // Samples beyond half threshold that trigger a report
+#define DECISION_SLOPE_SHIFT 8        // Door slopes are kept in 1/256 fixed point units per second
+
+// Threshold conversion from configuration units to hundredths
+#define DECISION_CENTI(value) ((int32_t)((value)*100 + 0.5))
+
+typedef enum
+{
+    DECISION_POLICY_DELTA = 0,
+    DECISION_POLICY_RELATIVE,
+    DECISION_POLICY_HYSTERESIS,
+    DECISION_POLICY_SWINGING_DOOR
+} decision_policy_t;
+
+typedef struct
+{
+    decision_policy_t policy;
+    int32_t threshold;          // Update if value changes more than this [fixed point units]
+    uint16_t relative_permille; // RELATIVE: update if value changes more than this fraction [1/1000]
+    time_t interval_max;        // Force an update after this time [sec]
+} decision_config_t;
+
+typedef struct
+{
+    int32_t value;         // Last reported value
+    time_t timestamp;      // Last reported value timestamp [sec]
+    int32_t sample;        // Last measured value
+    time_t sample_time;    // Last measured value timestamp [sec]
+    int32_t slope_upper;   // SWINGING_DOOR: upper door slope
+    int32_t slope_lower;   // SWINGING_DOOR: lower door slope
+    uint8_t pending;       // HYSTERESIS: consecutive samples beyond half threshold
+    uint8_t valid;         // Value has been reported at least once
+} channel_state_t;
+
+/**
+ * @brief    Checks if the last reported value is expired
+ *
+ * @param    state: Pointer to channel state
+ * @param    interval_max: Maximum time between reports [sec]
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 expired or never reported, 0 otherwise
+ */
+static inline uint8_t decision_is_expired(const channel_state_t *state, time_t interval_max, time_t timestamp)
+{
+    return !state->valid || (timestamp - state->timestamp) >= interval_max;
+}
+
+/**
+ * @brief    Change from a reference value that triggers a report.
+ *           Also flattened into the wake stub, which runs from RTC fast
+ *           memory with the flash cache off: the 64 bit division is a
+ *           call to the libgcc helper __divdi3, safe there only because
+ *           the linker takes it from ROM (esp32.rom.libgcc.ld). Check
+ *           that any other helper added here is in ROM too.
+ *
+ * @param    config: Pointer to channel decision configuration
+ * @param    reference: Reference value
+ * @return   int32_t threshold [fixed point units]
+ */
+static inline int32_t decision_threshold(const decision_config_t *config, int32_t reference)
+{
+    if (config->policy == DECISION_POLICY_RELATIVE)
+    {
+        int32_t relative = (int32_t)(((int64_t)abs(reference) * config->relative_permille) / 1000);
+        if (relative > config->threshold)
+            return relative;
+    }
+    return config->threshold;
+}
+
+/**
+ * @brief    Checks if a new measurement is certainly not reported, with
+ *           the last report as reference. Expiry and the swinging door
+ *           need the sample time and are left to decision_update, so is
+ *           a change beyond the quiet band. A quiet sample ends a pending
+ *           hysteresis change. Also run alone by the deep sleep wake
+ *           stub, before deciding if a full boot is needed.
+ *
+ * @param    state: Pointer to channel state
+ * @param    config: Pointer to channel decision configuration
+ * @param    value: new measurement
+ * @return   uint8_t: 1 not reported, 0 decision_update needed
+ */
+static inline uint8_t decision_is_quiet(channel_state_t *state, const decision_config_t *config, int32_t value)
+{
+    if (!state->valid || config->policy == DECISION_POLICY_SWINGING_DOOR)
+        return 0;
+
+    int32_t band = decision_threshold(config, state->value);
+    if (config->policy == DECISION_POLICY_HYSTERESIS)
+        band /= 2; // Samples beyond half threshold count toward a report
+    if (abs(value - state->value) > band)
+        return 0;
+
+    state->pending = 0;
+    return 1;
+}
+
+/**
+ * @brief    Save a reported value, the swinging door opens on it
+ *           with the next sample
+ *
+ * @param    state: Pointer to channel state
+ * @param    value: Reported value
+ * @param    timestamp: Reported value timestamp
+ */
+static inline void decision_report(channel_state_t *state, int32_t value, time_t timestamp)
+{
+    state->value = value;
+    state->timestamp = timestamp;
+    state->slope_upper = INT32_MAX;
+    state->slope_lower = INT32_MIN;
+    state->pending = 0;
+    state->valid = 1;
+}
+
+/**
+ * @brief    Swinging door step, narrows the door with a new sample.
+ *           A closing sample leaves the door as it was, so it still
+ *           holds every sample of the segment. The first sample never
+ *           closes the door: when no slope step fits it, the door is
+ *           left crossed and ends on that sample.
+ *
+ * @param    state: Pointer to channel state
+ * @param    threshold: Door width [fixed point units]
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 door closed, 0 otherwise
+ */
+static inline uint8_t decision_door_update(channel_state_t *state, int32_t threshold, int32_t value, time_t timestamp)
+{
+    time_t elapsed = timestamp - state->timestamp;
+
+    if (elapsed <= 0)
+        return 0;
+
+    int64_t high = (int64_t)(value + threshold - state->value) * (1 << DECISION_SLOPE_SHIFT);
+    int64_t low = (int64_t)(value - threshold - state->value) * (1 << DECISION_SLOPE_SHIFT);
+    int32_t upper = (int32_t)(high / elapsed - (high % elapsed < 0)); // Floor, the line stays inside the door
+    int32_t lower = (int32_t)(low / elapsed + (low % elapsed > 0));   // Ceil
+    uint8_t opening = (state->slope_upper == INT32_MAX && state->slope_lower == INT32_MIN);
+
+    if (upper > state->slope_upper)
+        upper = state->slope_upper;
+    if (lower < state->slope_lower)
+        lower = state->slope_lower;
+
+    if (lower > upper && !opening)
+        return 1;
+
+    state->slope_upper = upper;
+    state->slope_lower = lower;
+
+    return 0;
+}
+
+/**
+ * @brief    Point of the closed segment at the last sample, on the
+ *           middle line of the door, or the sample itself when the door
+ *           is crossed
+ *
+ * @param    state: Pointer to channel state
+ * @return   int32_t segment end value [fixed point units]
+ */
+static inline int32_t decision_door_end(const channel_state_t *state)
+{
+    if (state->slope_lower > state->slope_upper)
+        return state->sample; // Crossed door, the single sample is the end
+
+    int64_t rise = ((int64_t)state->slope_upper + state->slope_lower) * (state->sample_time - state->timestamp);
+    int64_t half = 1 << DECISION_SLOPE_SHIFT; // Round to nearest, rise is scaled by 2 << DECISION_SLOPE_SHIFT
+
+    return state->value + (int32_t)((rise + (rise < 0 ? -half : half)) / (2 * half));
+}
+
+/**
+ * @brief    Report a new measurement regardless of the threshold,
+ *           closing the open swinging door segment first
+ *
+ * @param    state: Pointer to channel state
+ * @param    config: Pointer to channel decision configuration
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ */
+static inline void decision_force(channel_state_t *state, const decision_config_t *config, int32_t value, time_t timestamp)
+{
+    if (config->policy == DECISION_POLICY_SWINGING_DOOR && state->valid && state->sample_time != state->timestamp)
+    {
+        decision_report(state, decision_door_end(state), state->sample_time); // Close the open segment
+        decision_door_update(state, decision_threshold(config, state->value), value, timestamp);
+    }
+    else
+        decision_report(state, value, timestamp);
+
+    state->sample = value;
+    state->sample_time = timestamp;
+}
+
+/**
+ * @brief    Checks if a new measurement needs to be reported,
+ *           and if so saves the value to report as the last reported value
+ *
+ * @param    state: Pointer to channel state
+ * @param    config: Pointer to channel decision configuration
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 needs update, 0 otherwise
+ */
+static inline uint8_t decision_update(channel_state_t *state, const decision_config_t *config, int32_t value, time_t timestamp)
+{
+    uint8_t report = 1;
+    int32_t threshold = decision_threshold(config, state->value);
+
+    if (decision_is_expired(state, config->interval_max, timestamp))
+    {
+        decision_force(state, config, value, timestamp);
+    }
+    else if (config->policy == DECISION_POLICY_SWINGING_DOOR)
+    {
+        if (decision_door_update(state, threshold, value, timestamp))
+        {
+            decision_report(state, decision_door_end(state), state->sample_time); // Segment ends at the last sample inside the door
+            decision_door_update(state, threshold, value, timestamp);             // New door from the reported point
+        }
+        else
+            report = 0;
+    }
+    else if (decision_is_quiet(state, config, value))
+    {
+        report = 0;
+    }
+    else if (config->policy == DECISION_POLICY_HYSTERESIS && abs(value - state->value) <= threshold)
+    {
+        if (++state->pending >= DECISION_HYSTERESIS_SAMPLES)
+            decision_report(state, value, timestamp);
+        else
+            report = 0;
+    }
+    else
+    {
+        decision_report(state, value, timestamp);
+    }
+
+    state->sample = value;
+    state->sample_time = timestamp;
+
+    return report;
+}
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * @file     devices.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    I2C devices of the node
+ */
+
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <esp_err.h>
+#include <esp_attr.h>
+
+#include "configuration.h"
+#include "i2c.h"
+
+_Static_assert(LIGHT_SENSORS >= 1 && LIGHT_SENSORS <= 4, "1 to 4 light sensors");
+_Static_assert(LIGHT_SENSORS <= 2 || I2C_SECONDARY_ENABLE, "Light sensors 3 and 4 are on the second I2C controller");
+
+extern RTC_RODATA_ATTR const i2c_device_t bh1750_devices[LIGHT_SENSORS];
+extern const i2c_device_t si7021_device;
+
+esp_err_t devices_reset_muxes(void);
+
+#endif
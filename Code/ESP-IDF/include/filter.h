@@ -0,0 +1,95 @@
+/**
+ * @file     filter.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Filters of a burst of readings into one measurement.
+ *           Fixed point only, and only depends on stdint.h, so the same
+ *           filters run in the firmware and in the host tools.
+ *           - MEDIAN: middle reading, the mean of the two middle ones
+ *             for an even count. Ignores up to half the burst.
+ *           - TRIMMED_MEAN: mean after dropping count / FILTER_TRIM_DIVISOR
+ *             readings at each end, at least one from 3 readings, so a
+ *             single outlier is always dropped. Keeps more resolution
+ *             than the median on quantized readings, ignores fewer
+ *             outliers. tools/filter_check.c checks both filters.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+#define FILTER_TRIM_DIVISOR 4 // TRIMMED_MEAN drops a quarter of the readings at each end
+
+typedef enum
+{
+    FILTER_MEDIAN = 0,
+    FILTER_TRIMMED_MEAN
+} filter_t;
+
+/**
+ * @brief    Sort a few readings in place, insertion sort
+ *
+ * @param    samples: Readings
+ * @param    count: Number of readings
+ */
+static inline void filter_sort(int32_t *samples, uint8_t count)
+{
+    for (uint8_t i = 1; i < count; i++)
+    {
+        int32_t sample = samples[i];
+        uint8_t j = i;
+
+        for (; j > 0 && samples[j - 1] > sample; j--)
+            samples[j] = samples[j - 1];
+        samples[j] = sample;
+    }
+}
+
+/**
+ * @brief    Rounded mean of sorted readings
+ *
+ * @param    samples: Readings
+ * @param    count: Number of readings, at least 1
+ * @return   int32_t mean, halves rounded away from zero
+ */
+static inline int32_t filter_mean(const int32_t *samples, uint8_t count)
+{
+    int64_t sum = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+        sum += samples[i];
+
+    return (int32_t)((sum + (sum < 0 ? -(count / 2) : count / 2)) / count);
+}
+
+/**
+ * @brief    Filter a burst of readings into one measurement, the
+ *           readings are sorted in place
+ *
+ * @param    filter: Filter
+ * @param    samples: Readings
+ * @param    count: Number of readings, at least 1
+ * @return   int32_t measurement [fixed point units]
+ */
+static inline int32_t filter_apply(filter_t filter, int32_t *samples, uint8_t count)
+{
+    filter_sort(samples, count);
+
+    if (filter == FILTER_TRIMMED_MEAN)
+    {
+        uint8_t trim = count / FILTER_TRIM_DIVISOR;
+
+        if (!trim && count >= 3)
+            trim = 1; // A mean of 3 would keep the outlier
+        return filter_mean(samples + trim, count - 2 * trim);
+    }
+
+    if (count % 2)
+        return samples[count / 2];
+    return filter_mean(samples + count / 2 - 1, 2);
+}
+
+#endif
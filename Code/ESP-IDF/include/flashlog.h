@@ -0,0 +1,51 @@
+/**
+ * @file     flashlog.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Append-only log of readings in a flash region.
+ *           Only depends on the C library, the storage is reached through
+ *           callbacks, so the same code runs on a flash partition in the
+ *           firmware and on a file in the host tools.
+ */
+
+#ifndef FLASHLOG_H
+#define FLASHLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASHLOG_SECTOR_SIZE 4096 // Erase unit [bytes]
+
+typedef struct
+{
+    uint32_t timestamp; // Reading timestamp [sec]
+    int32_t value;      // Reading value [fixed point units]
+    uint8_t channel;    // channel_id_t
+} flashlog_record_t;
+
+typedef struct
+{
+    int (*read)(void *context, uint32_t offset, void *data, size_t len);        // 0 on success
+    int (*write)(void *context, uint32_t offset, const void *data, size_t len); // Can only clear bits, 0 on success
+    int (*erase)(void *context, uint32_t offset);                               // Set a sector to 0xFF, 0 on success
+    void *context;                                                              // Callbacks argument
+    uint32_t size;                                                              // Multiple of FLASHLOG_SECTOR_SIZE, at least two sectors
+} flashlog_storage_t;
+
+typedef struct
+{
+    uint32_t head;     // Offset of the next record slot, a sector start if not begun yet
+    uint32_t tail;     // Offset of the oldest unsent record
+    uint32_t head_seq; // Sequence number of the head sector
+    uint32_t count;    // Unsent records
+    uint8_t valid;     // Positions are known, 0 to scan the storage again
+} flashlog_t;
+
+int flashlog_open(flashlog_t *log, const flashlog_storage_t *storage);
+int flashlog_append(flashlog_t *log, const flashlog_storage_t *storage, const flashlog_record_t *record);
+size_t flashlog_peek(const flashlog_t *log, const flashlog_storage_t *storage, flashlog_record_t *records, size_t max);
+int flashlog_consume(flashlog_t *log, const flashlog_storage_t *storage, size_t count);
+
+#endif
@@ -11,9 +11,12 @@
 #define GPIO_H
 
 #include <stdint.h>
+#include <time.h>
 #include <esp_err.h>
 
 void gpio_setup(void);
-esp_err_t handle_pir(void);
+uint8_t pir_is_due(time_t timestamp);
+uint32_t pir_sleep_time(time_t timestamp, uint32_t sleep_time);
+esp_err_t handle_pir(uint8_t piggyback);
 
 #endif
\ No newline at end of file
@@ -12,7 +12,47 @@
 
 #include <stdint.h>
 #include <esp_err.h>
+#include <esp_attr.h>
+#include <driver/i2c.h>
+
+#include "configuration.h"
+
+#define I2C_MUX_NONE 0x00 // Device on the controller bus, not behind a multiplexer
+
+typedef struct
+{
+    i2c_port_t port;     // I2C controller
+    uint8_t address;     // 7 bit device address
+    uint8_t mux_address; // TCA9548A multiplexer address, I2C_MUX_NONE if not behind one
+    uint8_t mux_channel; // TCA9548A channel, 0 to 7
+} i2c_device_t;
+
+typedef struct
+{
+    uint8_t address; // Multiplexer with an enabled channel, I2C_MUX_NONE if none
+    uint8_t channel; // Enabled channel
+} i2c_mux_state_t;
+
+typedef void (*i2c_callback_t)(esp_err_t status, void *args);
+
+typedef struct
+{
+    const i2c_device_t *device;          // Target device
+    uint8_t tx[I2C_TRANSACTION_MAX_LEN]; // Bytes to write
+    uint8_t tx_len;                      // Number of bytes to write
+    uint8_t rx[I2C_TRANSACTION_MAX_LEN]; // Read bytes, after a repeated start if tx_len > 0
+    uint8_t rx_len;                      // Number of bytes to read
+    i2c_callback_t callback;             // Completion callback, can be NULL
+    void *args;                          // Completion callback arguments
+} i2c_transaction_t;
+
+extern RTC_DATA_ATTR i2c_mux_state_t rtc_i2c_mux[I2C_NUM_MAX]; // Multiplexers keep their channel through deep sleep
 
 esp_err_t i2c_setup(void);
+esp_err_t i2c_mux_reset(i2c_port_t port, uint8_t mux_address);
+void i2c_transaction_init(i2c_transaction_t *transaction, const i2c_device_t *device, uint8_t tx_len, uint8_t rx_len);
+esp_err_t i2c_bus_submit(i2c_transaction_t *transaction, i2c_callback_t callback, void *args);
+esp_err_t i2c_bus_run(void);
+esp_err_t i2c_bus_transfer(i2c_transaction_t *transaction);
 
 #endif
@@ -11,14 +11,18 @@
 #define MQTT_H
 
 #include <stdint.h>
+#include <time.h>
 #include <esp_err.h>
 
 esp_err_t mqtt_setup(void);
+esp_err_t mqtt_publish(const char *topic, const char *payload);
 esp_err_t mqtt_event_wait(void);
+esp_err_t mqtt_message_status(uint8_t index);
 esp_err_t mqtt_send_autodiscovery(void);
-esp_err_t mqtt_send_light(uint16_t light);
-esp_err_t mqtt_send_temperature(float temperature);
-esp_err_t mqtt_send_humidity(float humidity);
+esp_err_t mqtt_send_light(uint8_t sensor, int32_t light, time_t timestamp);
+esp_err_t mqtt_send_temperature(uint8_t sensor, int32_t temperature, time_t timestamp);
+esp_err_t mqtt_send_humidity(uint8_t sensor, int32_t humidity, time_t timestamp);
 esp_err_t mqtt_send_pir(uint8_t pir);
+esp_err_t mqtt_send_state(void);
 
 #endif
@@ -0,0 +1,23 @@
+/**
+ * @file     schedule.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Adaptive measurement scheduling
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "channels.h"
+
+void schedule_reset(time_t timestamp);
+void schedule_update(channel_id_t id, int32_t value, time_t timestamp);
+void schedule_plan(time_t timestamp);
+uint32_t schedule_sleep_time(time_t timestamp);
+
+#endif
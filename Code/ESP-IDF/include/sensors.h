@@ -0,0 +1,23 @@
+/**
+ * @file     sensors.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Sensor acquisition scheduler
+ */
+
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdint.h>
+#include <esp_err.h>
+
+esp_err_t sensors_start(uint8_t light);
+esp_err_t sensors_read(uint8_t light);
+esp_err_t sensors_acquire(void);
+esp_err_t sensors_read_light(uint8_t sensor, int32_t *light);
+esp_err_t sensors_read_temperature(uint8_t sensor, int32_t *temperature);
+esp_err_t sensors_read_humidity(uint8_t sensor, int32_t *humidity);
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file     settings.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Runtime configuration, updated through MQTT
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_sleep.h>
+
+#include "configuration.h"
+#include "typedefs.h"
+#include "channels.h"
+
+typedef struct
+{
+    uint32_t sleep_interval_sec;             // Time between measurements, if not adaptive [sec]
+    uint32_t sleep_interval_min_sec;         // Shortest adaptive time between measurements [sec]
+    uint32_t sleep_interval_max_sec;         // Longest adaptive time between measurements [sec]
+    uint32_t batch_max_latency_sec;          // Flush when the oldest stored reading is older than this [sec]
+    uint32_t pir_holdoff_sec;                // Report the end of motion after no motion for this time [sec]
+    uint32_t pir_piggyback_sec;              // Send with motion the channels due within this time [sec]
+    decision_config_t decision[CHANNEL_MAX]; // Report policy and thresholds [fixed point units]
+    bh1750_resolution_t bh1750_resolution;   // Light sensor resolution
+    si7021_resolution_t si7021_resolution;   // Temperature and humidity sensor resolution
+    uint32_t crc;                            // CRC-32 of the fields above
+} settings_t;
+
+extern RTC_DATA_ATTR settings_t rtc_settings;
+
+void settings_load(void);
+uint8_t settings_sensors_changed(void);
+
+#if SETTINGS_REMOTE
+
+void settings_receive(const char *payload, size_t len);
+void settings_apply(void);
+
+#else
+
+#define settings_apply()
+
+#endif
+
+#endif
@@ -17,9 +17,12 @@
 esp_err_t si7021_setup(si7021_resolution_t resolution);
 esp_err_t si7021_write_register(uint8_t settings);
 esp_err_t si7021_read_register(uint8_t *output);
-esp_err_t si7021_measure(float *temperature, float *humidity);
-esp_err_t si7021_read_temperature(float *temperature);
-esp_err_t si7021_read_temperature_after_humidity(float *temperature);
-esp_err_t si7021_read_humidity(float *humidity);
+esp_err_t si7021_measure(int32_t *temperature, int32_t *humidity);
+esp_err_t si7021_start_measurement(void);
+esp_err_t si7021_start_measurement_submit(void);
+esp_err_t si7021_read_result(int32_t *temperature, int32_t *humidity);
+esp_err_t si7021_read_temperature(int32_t *temperature);
+esp_err_t si7021_read_temperature_after_humidity(int32_t *temperature);
+esp_err_t si7021_read_humidity(int32_t *humidity);
 
 #endif
\ No newline at end of file
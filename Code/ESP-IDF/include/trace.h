@@ -0,0 +1,72 @@
+/**
+ * @file     trace.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Wake phase timing functions
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <esp_err.h>
+#include <esp_sleep.h>
+
+#include "configuration.h"
+
+typedef enum
+{
+    TRACE_PHASE_BOOT = 0,     // Reset until app_main
+    TRACE_PHASE_SETUP,        // I2C driver and sensor setup
+    TRACE_PHASE_SENSOR_READ,  // Sensor readings
+    TRACE_PHASE_WIFI_SETUP,   // Wi-Fi driver start
+    TRACE_PHASE_WIFI_CONNECT, // Wi-Fi association and IP
+    TRACE_PHASE_MQTT_SETUP,   // MQTT client start
+    TRACE_PHASE_MQTT_PUBLISH, // MQTT publish and ack
+    TRACE_PHASE_SENSOR_START, // Conversion start and light reading, inside sensor read
+    TRACE_PHASE_SI7021_WAIT,  // Si7021 conversion polling, inside sensor read
+    TRACE_PHASE_RADIO,        // Radio on, overlaps other phases
+    TRACE_PHASE_MQTT_SEND,    // Message handed to the MQTT client (instant)
+    TRACE_PHASE_MQTT_ACK,     // Message acknowledged (instant)
+    TRACE_PHASE_DEEP_SLEEP,   // Deep sleep start (instant)
+    TRACE_PHASE_MAX
+} trace_phase_t;
+
+#define TRACE_PHASE_TOP_MAX TRACE_PHASE_SENSOR_START // Phases before this one add up to the awake time
+
+#if TRACE_ENABLE
+
+void trace_wake(time_t timestamp, esp_sleep_wakeup_cause_t wakeup_cause);
+void trace_phase_begin(trace_phase_t phase);
+void trace_phase_end(trace_phase_t phase);
+void trace_mark(trace_phase_t phase);
+void trace_radio_on(void);
+void trace_radio_off(void);
+void trace_report(esp_sleep_wakeup_cause_t wakeup_cause);
+
+#else
+
+#define trace_wake(timestamp, wakeup_cause)
+#define trace_phase_begin(phase)
+#define trace_phase_end(phase)
+#define trace_mark(phase)
+#define trace_radio_on()
+#define trace_radio_off()
+#define trace_report(wakeup_cause)
+
+#endif
+
+#if TRACE_ENABLE && TRACE_PUBLISH
+
+esp_err_t trace_publish(void);
+
+#else
+
+#define trace_publish()
+
+#endif
+
+#endif
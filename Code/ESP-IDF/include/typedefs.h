@@ -10,12 +10,6 @@
 #ifndef TYPEDEFS_H
 #define TYPEDEFS_H
 
-typedef enum measurement_type
-{
-    int_t = 0,
-    float_t,
-} measurement_type;
-
 typedef enum
 {
     SI7021_RES_HIGH2 = 0, // Temp resolution 14 bit, RH 12 bit
@@ -35,7 +29,8 @@ typedef enum
 {
     BH1750_RES_LOW = 0, // Resolution 4 lx, measurement time 16 ms
     BH1750_RES_HIGH,    // Resolution 1 lx, measurement time 120 ms
-    BH1750_RES_HIGH2    // Resolution 0.5 lx, measurement time 120 ms
+    BH1750_RES_HIGH2,   // Resolution 0.5 lx, measurement time 120 ms
+    BH1750_RES_AUTO     // Auto-ranging, resolution and measurement time follow the light level
 } bh1750_resolution_t;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,235 @@
+/**
+ * @file     wake.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Per-wake decisions: the rate of change of the channels and
+ *           the next planned wakeup (schedule.c), when the batch buffer
+ *           is due (batch.c) and the motion hold-off (gpio.c).
+ *           Only depends on the C library and decision.h, so the same
+ *           logic runs in the firmware and in the host tools. The state
+ *           is passed in, the firmware keeps it in RTC memory.
+ */
+
+#ifndef WAKE_H
+#define WAKE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "decision.h"
+
+#define WAKE_RATE_SHIFT 8 // Rates are kept in 1/256 fixed point units per second
+
+typedef struct
+{
+    int32_t value;    // Last measured value
+    int32_t rate;     // Average rate of change [fixed point units / 256 sec]
+    time_t timestamp; // Last measurement timestamp [sec]
+    uint8_t valid;    // Value is set
+} wake_rate_t;
+
+typedef struct
+{
+    uint8_t motion;    // Motion state, after the hold-off
+    uint8_t level;     // Last PIR level
+    uint32_t off_time; // End of the last motion [sec]
+} wake_pir_t;
+
+/**
+ * @brief    Forget the rate of change of a channel, until it is measured
+ *           again the channel is assumed to cross its threshold at the
+ *           shortest interval
+ *
+ * @param    rate: Pointer to channel rate
+ * @param    threshold: Channel threshold [fixed point units]
+ * @param    interval_min: Shortest sleep interval [sec]
+ */
+static inline void wake_rate_reset(wake_rate_t *rate, int32_t threshold, uint32_t interval_min)
+{
+    rate->valid = 0;
+    rate->rate = (threshold << WAKE_RATE_SHIFT) / interval_min;
+}
+
+/**
+ * @brief    Update the rate of change of a channel with a new measurement
+ *
+ * @param    rate: Pointer to channel rate
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ * @param    ewma_shift: Average weight of the new rate, 1 / 2^shift
+ */
+static inline void wake_rate_update(wake_rate_t *rate, int32_t value, time_t timestamp, uint8_t ewma_shift)
+{
+    time_t elapsed = timestamp - rate->timestamp;
+
+    if (rate->valid && elapsed > 0)
+    {
+        int32_t sample = (abs(value - rate->value) << WAKE_RATE_SHIFT) / elapsed;
+        rate->rate += (sample - rate->rate) / (1 << ewma_shift);
+    }
+
+    rate->value = value;
+    rate->timestamp = timestamp;
+    rate->valid = 1;
+}
+
+/**
+ * @brief    Interval to the next measurement: when the fastest channel
+ *           is expected to cross its threshold, never after a channel
+ *           or the batch buffer needs to be sent
+ *
+ * @param    states: Channel states, count entries
+ * @param    configs: Channel decision configurations, count entries
+ * @param    rates: Channel rates, count entries
+ * @param    count: Number of channels
+ * @param    batch_left: Time left before the batch is due [sec], interval_max if empty
+ * @param    interval_min: Shortest sleep interval [sec]
+ * @param    interval_max: Longest sleep interval [sec]
+ * @param    timestamp: actual timestamp
+ * @return   time_t interval [sec]
+ */
+static inline time_t wake_plan(const channel_state_t *states, const decision_config_t *configs, const wake_rate_t *rates, uint8_t count,
+                               time_t batch_left, time_t interval_min, time_t interval_max, time_t timestamp)
+{
+    time_t interval = interval_max;
+
+    for (uint8_t id = 0; id < count; id++)
+    {
+        time_t left = 0; // Time before the channel must be sent anyway
+
+        if (states[id].valid)
+            left = configs[id].interval_max - (timestamp - states[id].timestamp);
+        if (left < interval)
+            interval = left;
+
+        if (rates[id].rate > 0)
+        {
+            int32_t threshold = decision_threshold(&configs[id], states[id].value);
+            time_t crossing = ((int64_t)threshold << WAKE_RATE_SHIFT) / rates[id].rate;
+            if (crossing < interval)
+                interval = crossing;
+        }
+    }
+
+    if (batch_left < interval)
+        interval = batch_left;
+
+    if (interval < interval_min)
+        interval = interval_min;
+
+    return interval;
+}
+
+/**
+ * @brief    Time left before the next planned measurement
+ *
+ * @param    next: Planned measurement timestamp [sec]
+ * @param    interval_max: Longest sleep interval [sec]
+ * @param    timestamp: actual timestamp
+ * @return   uint32_t sleep time [sec]
+ */
+static inline uint32_t wake_sleep_time(time_t next, time_t interval_max, time_t timestamp)
+{
+    time_t left = next - timestamp;
+
+    if (left < 1)
+        return 1; // Measurement is overdue
+    if (left > interval_max)
+        return interval_max;
+    return left;
+}
+
+/**
+ * @brief    Time left before the batch buffer needs to be flushed
+ *           because of its oldest reading
+ *
+ * @param    count: Stored readings
+ * @param    oldest: Oldest reading timestamp [sec]
+ * @param    latency: Longest time a reading may be stored [sec]
+ * @param    timestamp: actual timestamp
+ * @return   time_t time left [sec], the latency if empty
+ */
+static inline time_t wake_batch_due_in(uint8_t count, time_t oldest, time_t latency, time_t timestamp)
+{
+    if (count == 0)
+        return latency;
+
+    return latency - (timestamp - oldest);
+}
+
+/**
+ * @brief    Checks if the batch buffer needs to be flushed, either
+ *           because it is full or because the oldest reading is too old
+ *
+ * @param    count: Stored readings
+ * @param    size: Buffer size
+ * @param    oldest: Oldest reading timestamp [sec]
+ * @param    latency: Longest time a reading may be stored [sec]
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 flush needed, 0 otherwise
+ */
+static inline uint8_t wake_batch_is_due(uint8_t count, uint8_t size, time_t oldest, time_t latency, time_t timestamp)
+{
+    if (count == 0)
+        return 0;
+
+    return count >= size || wake_batch_due_in(count, oldest, latency, timestamp) <= 0;
+}
+
+/**
+ * @brief    Merge a PIR edge into the motion state. Motion starts with
+ *           a rising edge and ends only after the PIR stayed low for the
+ *           hold-off time, see wake_pir_expire()
+ *
+ * @param    pir: Pointer to motion state
+ * @param    level: Edge level
+ * @param    timestamp: Edge timestamp
+ */
+static inline void wake_pir_edge(wake_pir_t *pir, uint8_t level, uint32_t timestamp)
+{
+    if (level)
+        pir->motion = 1; // Motion starts or continues
+    else if (pir->level)
+        pir->off_time = timestamp;
+    pir->level = level;
+}
+
+/**
+ * @brief    End the motion once the PIR stayed low for the whole hold-off
+ *
+ * @param    pir: Pointer to motion state
+ * @param    holdoff: Hold-off time [sec]
+ * @param    timestamp: actual timestamp
+ */
+static inline void wake_pir_expire(wake_pir_t *pir, uint32_t holdoff, time_t timestamp)
+{
+    if (pir->motion && !pir->level && timestamp - pir->off_time >= holdoff)
+        pir->motion = 0;
+}
+
+/**
+ * @brief    Shortens the sleep time to wake up when the hold-off
+ *           of the last motion expires
+ *
+ * @param    pir: Pointer to motion state
+ * @param    holdoff: Hold-off time [sec]
+ * @param    timestamp: actual timestamp
+ * @param    sleep_time: planned sleep time [sec]
+ * @return   uint32_t sleep time [sec]
+ */
+static inline uint32_t wake_pir_sleep_time(const wake_pir_t *pir, uint32_t holdoff, time_t timestamp, uint32_t sleep_time)
+{
+    if (!pir->motion || pir->level)
+        return sleep_time; // No motion, or motion still going on
+
+    time_t left = pir->off_time + holdoff - timestamp;
+
+    if (left < 1)
+        return 1;
+    return left < sleep_time ? left : sleep_time;
+}
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file     wake_stub.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Deep sleep wake stub light check
+ */
+
+#ifndef WAKE_STUB_H
+#define WAKE_STUB_H
+
+#include <stdint.h>
+
+#include "configuration.h"
+
+#if WAKE_STUB_ENABLE
+
+void wake_stub_arm(uint32_t sleep_time, uint32_t boot_in);
+uint8_t wake_stub_skipped(void);
+
+#else
+
+#define wake_stub_arm(sleep_time, boot_in)
+#define wake_stub_skipped() 0
+
+#endif
+
+#endif
@@ -14,6 +14,8 @@
 #include <esp_err.h>
 
 esp_err_t wifi_setup(void);
+esp_err_t wifi_setup_background(void);
+esp_err_t wifi_stop(void);
 esp_err_t wifi_event_wait(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,236 @@
+/**
+ * @file     backlog.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Flash store-and-forward of readings that could not be sent.
+ *           Readings whose session failed are appended to a flashlog.c
+ *           log in the BACKLOG_PARTITION partition, and replayed in time
+ *           order at the start of the next session that reaches the broker.
+ *           After a failed session no new connection is attempted for a
+ *           doubling wait, readings due meanwhile go straight to the log.
+ *           Readings are replayed with their age. The clock restarts with
+ *           a reset, so the age of the readings stored before it is lost.
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <esp_partition.h>
+#include <esp_sleep.h>
+
+#include "configuration.h"
+
+#include "backlog.h"
+#include "flashlog.h"
+#include "mqtt.h"
+
+#if BACKLOG_ENABLE
+
+// RTC variables
+RTC_DATA_ATTR flashlog_t rtc_backlog;        // Log positions, scanned again after a reset
+RTC_DATA_ATTR time_t rtc_backlog_retry;      // No connection before this time [sec]
+RTC_DATA_ATTR uint32_t rtc_backlog_backoff;  // Last wait after a failed session [sec]
+RTC_DATA_ATTR uint32_t rtc_backlog_stale;    // Oldest readings stored before the last reset
+
+// Global variables
+const esp_partition_t *backlog_partition;
+flashlog_storage_t backlog_storage;
+
+// Private function declarations
+static esp_err_t backlog_setup(void);
+static void backlog_forget(uint32_t count);
+static int partition_read(void *context, uint32_t offset, void *data, size_t len);
+static int partition_write(void *context, uint32_t offset, const void *data, size_t len);
+static int partition_erase(void *context, uint32_t offset);
+
+// Functions
+
+/**
+ * @brief    Find the partition, and scan the log if its positions
+ *           were lost with a reset
+ * 
+ * @return   esp_err_t status
+ */
+static esp_err_t backlog_setup(void)
+{
+    if (backlog_partition)
+        return ESP_OK;
+
+    backlog_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BACKLOG_PARTITION);
+    if (!backlog_partition)
+    {
+        printf("Partition %s not found, flash partitions.csv over serial\n", BACKLOG_PARTITION); // OTA updates keep the old partition table
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    backlog_storage.read = partition_read;
+    backlog_storage.write = partition_write;
+    backlog_storage.erase = partition_erase;
+    backlog_storage.context = (void *)backlog_partition;
+    backlog_storage.size = backlog_partition->size - backlog_partition->size % FLASHLOG_SECTOR_SIZE;
+
+    if (!rtc_backlog.valid)
+    {
+        if (flashlog_open(&rtc_backlog, &backlog_storage) != 0)
+            return ESP_FAIL;
+        rtc_backlog_stale = rtc_backlog.count; // Timestamps of an older clock
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief    Account for the oldest readings leaving the log, sent,
+ *           dropped or overwritten
+ * 
+ * @param    count: Number of readings
+ */
+static void backlog_forget(uint32_t count)
+{
+    rtc_backlog_stale -= count < rtc_backlog_stale ? count : rtc_backlog_stale;
+}
+
+/**
+ * @brief    Read from the partition
+ * 
+ */
+static int partition_read(void *context, uint32_t offset, void *data, size_t len)
+{
+    return esp_partition_read(context, offset, data, len) == ESP_OK ? 0 : -1;
+}
+
+/**
+ * @brief    Program the partition
+ * 
+ */
+static int partition_write(void *context, uint32_t offset, const void *data, size_t len)
+{
+    return esp_partition_write(context, offset, data, len) == ESP_OK ? 0 : -1;
+}
+
+/**
+ * @brief    Erase a sector of the partition
+ * 
+ */
+static int partition_erase(void *context, uint32_t offset)
+{
+    return esp_partition_erase_range(context, offset, FLASHLOG_SECTOR_SIZE) == ESP_OK ? 0 : -1;
+}
+
+/**
+ * @brief    Store a reading that could not be sent
+ * 
+ * @param    channel: Measurement channel
+ * @param    value: Measurement value
+ * @param    timestamp: Measurement timestamp
+ */
+void backlog_store(channel_id_t channel, int32_t value, time_t timestamp)
+{
+    flashlog_record_t record = {timestamp, value, channel};
+    uint32_t count;
+
+    if (backlog_setup() != ESP_OK)
+    {
+        printf("Failed to store reading\n");
+        return;
+    }
+
+    count = rtc_backlog.count;
+    if (flashlog_append(&rtc_backlog, &backlog_storage, &record) != 0)
+        printf("Failed to store reading\n");
+    else
+        backlog_forget(count + 1 - rtc_backlog.count); // Oldest readings overwritten by a full log
+}
+
+/**
+ * @brief    Checks if the node is waiting after a failed session
+ * 
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 don't connect, 0 otherwise
+ */
+uint8_t backlog_is_offline(time_t timestamp)
+{
+    return timestamp < rtc_backlog_retry;
+}
+
+/**
+ * @brief    Update the wait before the next connection with the outcome
+ *           of a session
+ * 
+ * @param    status: Session status
+ * @param    timestamp: actual timestamp
+ */
+void backlog_result(esp_err_t status, time_t timestamp)
+{
+    if (status == ESP_OK)
+    {
+        rtc_backlog_backoff = 0;
+        rtc_backlog_retry = 0;
+        return;
+    }
+
+    rtc_backlog_backoff = rtc_backlog_backoff ? rtc_backlog_backoff * 2 : BACKLOG_RETRY_MIN_SEC;
+    if (rtc_backlog_backoff > BACKLOG_RETRY_MAX_SEC)
+        rtc_backlog_backoff = BACKLOG_RETRY_MAX_SEC;
+    rtc_backlog_retry = timestamp + rtc_backlog_backoff;
+}
+
+/**
+ * @brief    Publish the oldest stored readings, MQTT must be already setup.
+ *           At most BACKLOG_REPLAY_MAX readings are sent, in windows of
+ *           MQTT_WINDOW_SIZE messages, and marked as sent only once
+ *           acknowledged. Readings stored before a reset are sent
+ *           without an age.
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t backlog_replay(void)
+{
+    flashlog_record_t records[MQTT_WINDOW_SIZE];
+    uint16_t replayed = 0;
+
+    if (backlog_setup() != ESP_OK)
+        return ESP_FAIL;
+
+    while (rtc_backlog.count && replayed < BACKLOG_REPLAY_MAX)
+    {
+        size_t count = flashlog_peek(&rtc_backlog, &backlog_storage, records, MQTT_WINDOW_SIZE);
+        uint32_t pending = rtc_backlog.count;
+        uint8_t queued = 0, acked = 0;
+        esp_err_t status = ESP_OK;
+
+        if (count && records[0].channel >= CHANNEL_MAX)
+        {
+            flashlog_consume(&rtc_backlog, &backlog_storage, 1); // Drop an unknown channel
+            backlog_forget(pending - rtc_backlog.count);
+            continue;
+        }
+
+        while (queued < count && records[queued].channel < CHANNEL_MAX)
+        {
+            time_t timestamp = queued < rtc_backlog_stale ? CHANNEL_TIMESTAMP_UNKNOWN : (time_t)records[queued].timestamp;
+
+            status = channels[records[queued].channel].publish(channels[records[queued].channel].sensor, records[queued].value, timestamp);
+            if (status != ESP_OK)
+                break;
+            queued++;
+        }
+        mqtt_event_wait(); // Wait for all MQTT acks
+
+        while (acked < queued && mqtt_message_status(acked) == ESP_OK)
+            acked++;
+
+        uint8_t dropped = acked == queued && status == ESP_ERR_INVALID_SIZE; // A value that can't be formatted would block the backlog
+
+        flashlog_consume(&rtc_backlog, &backlog_storage, acked + dropped);
+        backlog_forget(pending - rtc_backlog.count);
+        replayed += acked;
+
+        if (!dropped && (acked < queued || queued == 0))
+            return ESP_FAIL; // Keep the remaining readings for the next session
+    }
+    return ESP_OK;
+}
+
+#endif
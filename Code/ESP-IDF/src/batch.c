@@ -0,0 +1,182 @@
+/**
+ * @file     batch.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    RTC memory buffer for batched measurement publishing.
+ *           Readings that need to be sent are stored across deep sleep
+ *           cycles and published together in a single Wi-Fi session.
+ */
+
+// Include libraries
+#include <esp_sleep.h>
+
+#include "configuration.h"
+
+#include "batch.h"
+#include "settings.h"
+#include "backlog.h"
+#include "mqtt.h"
+#include "wake.h"
+
+#if BATCH_ENABLE
+
+// RTC variables
+RTC_DATA_ATTR batch_entry_t rtc_batch[BATCH_SIZE];
+RTC_DATA_ATTR uint8_t rtc_batch_head; // Index of the oldest entry
+RTC_DATA_ATTR uint8_t rtc_batch_count;
+
+// Private function declarations
+esp_err_t batch_send_entry(const batch_entry_t *entry);
+
+// Functions
+
+/**
+ * @brief    Store a reading in the buffer, the oldest one is moved to
+ *           the flash backlog if full
+ * 
+ * @param    channel: Measurement channel
+ * @param    value: Measurement value
+ * @param    timestamp: Measurement timestamp
+ */
+void batch_push(channel_id_t channel, int32_t value, time_t timestamp)
+{
+    uint8_t index = (rtc_batch_head + rtc_batch_count) % BATCH_SIZE;
+
+    if (rtc_batch_count == BATCH_SIZE)
+        backlog_store(rtc_batch[index].channel, rtc_batch[index].value, rtc_batch[index].timestamp); // Oldest entry, about to be overwritten
+
+    rtc_batch[index].timestamp = timestamp;
+    rtc_batch[index].channel = channel;
+    rtc_batch[index].value = value;
+
+    if (rtc_batch_count < BATCH_SIZE)
+        rtc_batch_count++;
+    else
+        rtc_batch_head = (rtc_batch_head + 1) % BATCH_SIZE; // Oldest entry was moved to the backlog
+}
+
+/**
+ * @brief    Number of stored readings
+ * 
+ * @return   uint8_t count
+ */
+uint8_t batch_count(void)
+{
+    return rtc_batch_count;
+}
+
+/**
+ * @brief    Checks if the buffer needs to be flushed, either because
+ *           it is full or because the oldest reading is too old
+ * 
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 flush needed, 0 otherwise
+ */
+uint8_t batch_is_due(time_t timestamp)
+{
+    return wake_batch_is_due(rtc_batch_count, BATCH_SIZE, rtc_batch[rtc_batch_head].timestamp, rtc_settings.batch_max_latency_sec, timestamp);
+}
+
+/**
+ * @brief    Time left before the buffer needs to be flushed because
+ *           of its oldest reading
+ * 
+ * @param    timestamp: actual timestamp
+ * @return   time_t time left [sec], the maximum latency if empty
+ */
+time_t batch_due_in(time_t timestamp)
+{
+    return wake_batch_due_in(rtc_batch_count, rtc_batch[rtc_batch_head].timestamp, rtc_settings.batch_max_latency_sec, timestamp);
+}
+
+/**
+ * @brief    Publish a single stored reading
+ * 
+ * @param    entry: Pointer to buffer entry
+ * @return   esp_err_t status
+ */
+esp_err_t batch_send_entry(const batch_entry_t *entry)
+{
+    if (entry->channel >= CHANNEL_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    return channels[entry->channel].publish(channels[entry->channel].sensor, entry->value, entry->timestamp); // Sent with its age, placed at its time by the receiver
+}
+
+/**
+ * @brief    Remove every stored reading
+ * 
+ */
+void batch_clear(void)
+{
+    rtc_batch_head = 0;
+    rtc_batch_count = 0;
+}
+
+#if MQTT_COMBINED_PAYLOAD
+
+/**
+ * @brief    Publish the stored readings, MQTT must be already setup.
+ *           The combined state message carries the latest value of
+ *           every channel, so a single message flushes the buffer.
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t batch_flush(void)
+{
+    if (!rtc_batch_count)
+        return ESP_OK;
+
+    ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_state()); // Send all values in one message
+    esp_err_t ret = mqtt_event_wait();                // Wait for MQTT ack
+
+    if (ret == ESP_OK)
+        batch_clear();
+
+    return ret;
+}
+
+#else
+
+/**
+ * @brief    Publish the stored readings in time order, MQTT must be already setup.
+ *           Readings are sent in windows of MQTT_WINDOW_SIZE messages and
+ *           removed from the buffer only once acknowledged.
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t batch_flush(void)
+{
+    while (rtc_batch_count)
+    {
+        uint8_t queued = 0, acked = 0;
+        esp_err_t status = ESP_OK;
+
+        while (queued < rtc_batch_count && queued < MQTT_WINDOW_SIZE)
+        {
+            status = batch_send_entry(&rtc_batch[(rtc_batch_head + queued) % BATCH_SIZE]);
+            if (status != ESP_OK)
+                break;
+            queued++;
+        }
+        mqtt_event_wait(); // Wait for all MQTT acks
+
+        while (acked < queued && mqtt_message_status(acked) == ESP_OK)
+            acked++;
+
+        uint8_t dropped = acked == queued && status == ESP_ERR_INVALID_SIZE; // A value that can't be formatted would block the buffer
+
+        rtc_batch_head = (rtc_batch_head + acked + dropped) % BATCH_SIZE;
+        rtc_batch_count -= acked + dropped;
+
+        if (!dropped && (acked < queued || queued == 0))
+            return ESP_FAIL; // Keep the remaining readings for the next session
+    }
+    return ESP_OK;
+}
+
+#endif
+
+#endif
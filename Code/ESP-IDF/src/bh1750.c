@@ -5,35 +5,178 @@
  * @date     13-09-2020
  * 
  * @brief    ESP-IDF driver for BH1750
+ *           With BH1750_RES_AUTO the resolution and the measurement time
+ *           follow the light level: long measurement time and H2
+ *           resolution in the dark, L resolution and short measurement
+ *           time in bright light. The range is switched after a reading,
+ *           so the sensor converts in the new range while the ESP32 sleeps.
+ *           In BH1750_MODE_ONE_TIME the sensor is powered on for every
+ *           reading, converts once and powers itself down, so it doesn't
+ *           draw measurement current through deep sleep.
+ *           Every function takes the sensor index in the devices.c table,
+ *           each sensor keeps its own range.
  */
 
 // Include libraries
-#include <driver/i2c.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rom/ets_sys.h"
 
 #include "configuration.h"
 
 #include "bh1750.h"
+#include "i2c.h"
+#include "devices.h"
+#include "conversions.h"
 
-// Imported variables
-extern i2c_port_t i2c_master_port;
+// Auto-ranging ranges, from the finest to the coarsest. Bounds overlap,
+// so a level close to a bound doesn't switch back and forth.
+static const bh1750_range_t bh1750_auto_ranges[] = {
+    {.resolution = BH1750_RES_HIGH2, .mtreg = BH1750_MTREG_MAX, .lux_min = 0, .lux_max = 40},           // Dark, 0.11 lx per count, up to 7400 lx
+    {.resolution = BH1750_RES_HIGH, .mtreg = BH1750_MTREG_DEFAULT, .lux_min = 30, .lux_max = 1000},     // Indoor, 0.83 lx per count, 120 ms
+    {.resolution = BH1750_RES_LOW, .mtreg = BH1750_MTREG_DEFAULT, .lux_min = 800, .lux_max = 50000},    // Daylight, 16 ms, up to 54600 lx
+    {.resolution = BH1750_RES_LOW, .mtreg = BH1750_MTREG_MIN, .lux_min = 45000, .lux_max = UINT32_MAX}, // Sunlight, 7 ms, up to 121000 lx
+};
+
+#define BH1750_AUTO_RANGES (sizeof(bh1750_auto_ranges) / sizeof(bh1750_auto_ranges[0]))
+#define BH1750_AUTO_RANGE_DEFAULT 1
+
+// RTC variables
+RTC_DATA_ATTR bh1750_range_t rtc_bh1750_range[LIGHT_SENSORS] = {
+    [0 ... LIGHT_SENSORS - 1] = {
+        .mode = BH1750_MODE,
+        .resolution = BH1750_RES_HIGH,
+        .mtreg = BH1750_MTREG_DEFAULT,
+        .lux_min = 0,
+        .lux_max = UINT32_MAX,
+        .opcode = (BH1750_MODE == BH1750_MODE_ONE_TIME ? BH1750_OPCODE_OT : BH1750_OPCODE_CONT) | BH1750_OPCODE_HIGH,
+        .conversion_us = BH1750_CONVERSION_HIGH_US,
+    },
+};
+RTC_DATA_ATTR uint8_t rtc_bh1750_auto_index[LIGHT_SENSORS] = {[0 ... LIGHT_SENSORS - 1] = BH1750_AUTO_RANGE_DEFAULT}; // Auto-ranging range in bh1750_auto_ranges
+RTC_DATA_ATTR int64_t rtc_bh1750_switch_time[LIGHT_SENSORS]; // Last range switch [us]
+
+// Global variables
+int64_t bh1750_conversion_start[LIGHT_SENSORS]; // Start of the one-time conversion [us]
+uint32_t *bh1750_levels[LIGHT_SENSORS];         // Light level variables of the queued readings
+
+i2c_transaction_t bh1750_command_transaction;
+i2c_transaction_t bh1750_power_transaction[LIGHT_SENSORS];
+i2c_transaction_t bh1750_start_transaction[LIGHT_SENSORS];
+i2c_transaction_t bh1750_read_transaction[LIGHT_SENSORS];
 
 // Private function declarations
-esp_err_t bh1750_send_command(uint8_t opcode);
+esp_err_t bh1750_send_command(uint8_t sensor, uint8_t opcode);
+static esp_err_t bh1750_set_range(uint8_t sensor, const bh1750_range_t *range);
+static int64_t bh1750_time_us(void);
+static void bh1750_delay_us(int64_t wait);
+static void bh1750_start_done(esp_err_t status, void *args);
+static void bh1750_read_done(esp_err_t status, void *args);
 
 // Functions
 
 /**
  * @brief    Setup BH1750 parameters
  * 
+ * @param    sensor: Sensor index in devices.c
  * @param    mode: Measurement mode
  * @param    resolution: Resolution
  * @return   esp_err_t status
  */
-esp_err_t bh1750_setup(bh1750_mode_t mode, bh1750_resolution_t resolution)
+esp_err_t bh1750_setup(uint8_t sensor, bh1750_mode_t mode, bh1750_resolution_t resolution)
+{
+    bh1750_range_t range = {
+        .resolution = resolution,
+        .mtreg = BH1750_MTREG_DEFAULT,
+        .lux_min = 0,
+        .lux_max = UINT32_MAX,
+    };
+
+    if (resolution == BH1750_RES_AUTO)
+        range = bh1750_auto_ranges[rtc_bh1750_auto_index[sensor]];
+    range.mode = mode;
+
+    return bh1750_set_range(sensor, &range);
+}
+
+/**
+ * @brief    Switch to the auto-ranging range of a light level, if the
+ *           level is out of the active one
+ * 
+ * @param    sensor: Sensor index in devices.c
+ * @param    level: Last light level [lx]
+ * @return   esp_err_t status
+ */
+esp_err_t bh1750_auto_range(uint8_t sensor, uint32_t level)
+{
+    uint8_t index = rtc_bh1750_auto_index[sensor];
+
+    while (index > 0 && level < bh1750_auto_ranges[index].lux_min)
+        index--;
+    while (index < BH1750_AUTO_RANGES - 1 && level >= bh1750_auto_ranges[index].lux_max)
+        index++;
+
+    if (index == rtc_bh1750_auto_index[sensor])
+        return ESP_OK;
+
+    bh1750_range_t range = bh1750_auto_ranges[index];
+    range.mode = rtc_bh1750_range[sensor].mode;
+
+    esp_err_t ret = bh1750_set_range(sensor, &range);
+    if (ret == ESP_OK)
+        rtc_bh1750_auto_index[sensor] = index;
+
+    return ret;
+}
+
+/**
+ * @brief    Maximum conversion time in the active range
+ * 
+ * @param    sensor: Sensor index in devices.c
+ * @return   uint32_t time [us]
+ */
+uint32_t bh1750_conversion_time_us(uint8_t sensor)
+{
+    return rtc_bh1750_range[sensor].conversion_us;
+}
+
+/**
+ * @brief    Wait for the first conversion after the last range switch,
+ *           earlier readings are in the previous range. Returns at once
+ *           if the sensor converted during deep sleep, or in one-time
+ *           mode, where every reading waits for its own conversion.
+ * 
+ * @param    sensor: Sensor index in devices.c
+ */
+void bh1750_wait_conversion(uint8_t sensor)
+{
+    if (rtc_bh1750_range[sensor].mode == BH1750_MODE_ONE_TIME)
+        return;
+
+    int64_t wait = rtc_bh1750_switch_time[sensor] + bh1750_conversion_time_us(sensor) - bh1750_time_us();
+
+    if (wait > 0)
+        bh1750_delay_us(wait);
+}
+
+/**
+ * @brief    Send the measurement time and the mode of a range. In
+ *           one-time mode the sensor is left powered down, conversions
+ *           are started by bh1750_start_submit().
+ * 
+ * @param    sensor: Sensor index in devices.c
+ * @param    range: Pointer to range
+ * @return   esp_err_t status
+ */
+static esp_err_t bh1750_set_range(uint8_t sensor, const bh1750_range_t *range)
 {
+    bh1750_range_t active = *range;
     uint8_t opcode;
 
-    switch (mode)
+    switch (range->mode)
     {
     case BH1750_MODE_ONE_TIME:
         opcode = BH1750_OPCODE_OT;
@@ -44,7 +187,7 @@ esp_err_t bh1750_setup(bh1750_mode_t mode, bh1750_resolution_t resolution)
         break;
     }
 
-    switch (resolution)
+    switch (range->resolution)
     {
     case BH1750_RES_LOW:
         opcode |= BH1750_OPCODE_LOW;
@@ -59,85 +202,218 @@ esp_err_t bh1750_setup(bh1750_mode_t mode, bh1750_resolution_t resolution)
         break;
     }
 
-    return bh1750_send_command(opcode);
+    active.opcode = opcode;
+    active.conversion_us = (range->resolution == BH1750_RES_LOW ? BH1750_CONVERSION_LOW_US : BH1750_CONVERSION_HIGH_US) *
+                           range->mtreg / BH1750_MTREG_DEFAULT;
+
+    esp_err_t ret = range->mode == BH1750_MODE_ONE_TIME ? bh1750_power_on(sensor) : ESP_OK;
+    if (ret == ESP_OK)
+        ret = bh1750_set_measurement_time(sensor, range->mtreg);
+    if (ret != ESP_OK)
+        return ret;
+
+    if (range->mode == BH1750_MODE_ONE_TIME)
+        ret = bh1750_power_down(sensor);
+    else
+        ret = bh1750_send_command(sensor, opcode); // Restarts the conversion with the new measurement time
+    if (ret != ESP_OK)
+        return ret;
+
+    rtc_bh1750_range[sensor] = active;
+    rtc_bh1750_switch_time[sensor] = bh1750_time_us();
+
+    return ESP_OK;
+}
+
+/**
+ * @brief    Time that keeps counting during deep sleep
+ * 
+ * @return   int64_t time [us]
+ */
+static int64_t bh1750_time_us(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000000LL + now.tv_usec;
+}
+
+/**
+ * @brief    Wait without keeping the CPU busy, the task sleeps the
+ *           whole ticks and only the sub-tick remainder is spun
+ * 
+ * @param    wait: Wait time [us]
+ */
+static void bh1750_delay_us(int64_t wait)
+{
+    int64_t end = esp_timer_get_time() + wait;
+
+    vTaskDelay(pdMS_TO_TICKS(wait / 1000)); // Never longer than the wait
+    wait = end - esp_timer_get_time();
+    if (wait > 0)
+        ets_delay_us(wait);
 }
 
 /**
  * @brief    Send command to BH1750
  * 
+ * @param    sensor: Sensor index in devices.c
  * @param    opcode: opcode to send
  * @return   esp_err_t
  */
-esp_err_t bh1750_send_command(uint8_t opcode)
+esp_err_t bh1750_send_command(uint8_t sensor, uint8_t opcode)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (BH1750_ADDR << 1) | I2C_MASTER_WRITE, I2C_MASTER_ACK);
-    i2c_master_write_byte(cmd, opcode, I2C_MASTER_ACK);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_master_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    i2c_transaction_init(&bh1750_command_transaction, &bh1750_devices[sensor], 1, 0);
+    bh1750_command_transaction.tx[0] = opcode;
+    esp_err_t ret = i2c_bus_transfer(&bh1750_command_transaction);
 
     ESP_ERROR_CHECK(ret);
 
     return ret;
 }
 
+/**
+ * @brief    Queue the start of a light reading on the I2C bus.
+ *           In one-time mode the sensor is powered on and starts a
+ *           conversion, read by bh1750_read_result(). In continuous mode
+ *           the last conversion is read right away.
+ * 
+ * @param    sensor: Sensor index in devices.c
+ * @param    level: Pointer to light level variable [lx]
+ * @return   esp_err_t status
+ */
+esp_err_t bh1750_start_submit(uint8_t sensor, uint32_t *level)
+{
+    if (rtc_bh1750_range[sensor].mode != BH1750_MODE_ONE_TIME)
+        return bh1750_read_submit(sensor, level);
+
+    i2c_transaction_init(&bh1750_power_transaction[sensor], &bh1750_devices[sensor], 1, 0);
+    bh1750_power_transaction[sensor].tx[0] = BH1750_OPCODE_POWER_ON;
+    esp_err_t ret = i2c_bus_submit(&bh1750_power_transaction[sensor], NULL, NULL);
+    if (ret != ESP_OK)
+        return ret;
+
+    i2c_transaction_init(&bh1750_start_transaction[sensor], &bh1750_devices[sensor], 1, 0);
+    bh1750_start_transaction[sensor].tx[0] = rtc_bh1750_range[sensor].opcode;
+    return i2c_bus_submit(&bh1750_start_transaction[sensor], bh1750_start_done, (void *)(uintptr_t)sensor);
+}
+
+/**
+ * @brief    Conversion start completion callback
+ * 
+ * @param    status: Transaction status
+ * @param    args: Sensor index
+ */
+static void bh1750_start_done(esp_err_t status, void *args)
+{
+    bh1750_conversion_start[(uintptr_t)args] = esp_timer_get_time(); // Conversion time counts from here
+}
+
+/**
+ * @brief    Read the light level of a reading started with
+ *           bh1750_start_submit(), waiting only for the rest of the
+ *           one-time conversion. The sensor then powers itself down.
+ *           The reading is queued, it completes when the bus runs.
+ * 
+ * @param    sensor: Sensor index in devices.c
+ * @param    level: Pointer to light level variable [lx]
+ * @return   esp_err_t status
+ */
+esp_err_t bh1750_read_result(uint8_t sensor, uint32_t *level)
+{
+    if (rtc_bh1750_range[sensor].mode != BH1750_MODE_ONE_TIME)
+        return ESP_OK; // Read by bh1750_start_submit()
+
+    int64_t wait = bh1750_conversion_start[sensor] + rtc_bh1750_range[sensor].conversion_us - esp_timer_get_time();
+    if (wait > 0)
+        bh1750_delay_us(wait);
+
+    return bh1750_read_submit(sensor, level);
+}
+
 /**
  * @brief    Read light level from BH1750
  * 
- * @param    level: Pointer to light level variable
+ * @param    sensor: Sensor index in devices.c
+ * @param    level: Pointer to light level variable [lx]
  * @return   esp_err_t 
  */
-esp_err_t bh1750_read(uint16_t *level)
+esp_err_t bh1750_read(uint8_t sensor, uint32_t *level)
 {
-    uint8_t buf[2];
-    uint16_t light;
-
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (BH1750_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_ACK);
-    i2c_master_read(cmd, buf, 2, I2C_MASTER_ACK);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_master_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    ESP_ERROR_CHECK(bh1750_read_submit(sensor, level));
+    esp_err_t ret = i2c_bus_run();
 
     ESP_ERROR_CHECK(ret);
 
-    light = buf[0] << 8 | buf[1];
-    *level = (light * 10) / 12;
-
     return ret;
 }
 
+/**
+ * @brief    Queue a light level reading on the I2C bus,
+ *           the level is written when the bus runs the transaction
+ * 
+ * @param    sensor: Sensor index in devices.c
+ * @param    level: Pointer to light level variable [lx]
+ * @return   esp_err_t 
+ */
+esp_err_t bh1750_read_submit(uint8_t sensor, uint32_t *level)
+{
+    bh1750_levels[sensor] = level;
+    i2c_transaction_init(&bh1750_read_transaction[sensor], &bh1750_devices[sensor], 0, 2);
+    return i2c_bus_submit(&bh1750_read_transaction[sensor], bh1750_read_done, (void *)(uintptr_t)sensor);
+}
+
+/**
+ * @brief    Light level reading completion callback
+ * 
+ * @param    status: Transaction status
+ * @param    args: Sensor index
+ */
+static void bh1750_read_done(esp_err_t status, void *args)
+{
+    uint8_t sensor = (uintptr_t)args;
+
+    if (status != ESP_OK)
+        return;
+
+    uint16_t count = bh1750_read_transaction[sensor].rx[0] << 8 | bh1750_read_transaction[sensor].rx[1];
+    *bh1750_levels[sensor] = bh1750_count_to_lux(count, rtc_bh1750_range[sensor].mtreg, rtc_bh1750_range[sensor].resolution == BH1750_RES_HIGH2);
+}
+
 /**
  * @brief    Send power down command to BH1750
  * 
+ * @param    sensor: Sensor index in devices.c
  * @return   esp_err_t 
  */
-esp_err_t bh1750_power_down()
+esp_err_t bh1750_power_down(uint8_t sensor)
 {
-    return bh1750_send_command(BH1750_OPCODE_POWER_DOWN);
+    return bh1750_send_command(sensor, BH1750_OPCODE_POWER_DOWN);
 }
 
 /**
  * @brief    Send power on command to BH1750
  * 
+ * @param    sensor: Sensor index in devices.c
  * @return   esp_err_t 
  */
-esp_err_t bh1750_power_on()
+esp_err_t bh1750_power_on(uint8_t sensor)
 {
-    return bh1750_send_command(BH1750_OPCODE_POWER_ON);
+    return bh1750_send_command(sensor, BH1750_OPCODE_POWER_ON);
 }
 
 /**
  * @brief    Set measurement sensitivity for BH1750
  * 
+ * @param    sensor: Sensor index in devices.c
  * @param    time: Measurement sensitivity
  * @return   esp_err_t 
  */
-esp_err_t bh1750_set_measurement_time(uint8_t time)
+esp_err_t bh1750_set_measurement_time(uint8_t sensor, uint8_t time)
 {
-    bh1750_send_command(BH1750_OPCODE_MT_HI | (time >> 5));
-    return bh1750_send_command(BH1750_OPCODE_MT_LO | (time & 0x1f));
+    esp_err_t ret = bh1750_send_command(sensor, BH1750_OPCODE_MT_HI | (time >> 5));
+    if (ret != ESP_OK)
+        return ret; // A low part alone would set a wrong measurement time
+
+    return bh1750_send_command(sensor, BH1750_OPCODE_MT_LO | (time & 0x1f));
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+/**
+ * @file     channels.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Measurement channel table.
+ *           Every channel is described by one entry, the wakeup loop
+ *           reads, checks and publishes all of them the same way.
+ *           Values are fixed point integers, temperature and humidity
+ *           in hundredths and light in lux. Every light sensor of
+ *           devices.c has its own light channel.
+ */
+
+// Include libraries
+#include "configuration.h"
+
+#include "channels.h"
+#include "settings.h"
+#include "sensors.h"
+#include "mqtt.h"
+
+// Light channel of a light sensor
+#define LIGHT_CHANNEL(n, name)                                   \
+    [CHANNEL_LIGHT + (n)] = {                                    \
+        .key = name,                                             \
+        .sensor = (n),                                           \
+        .decimals = 0,                                           \
+        .decision = {                                            \
+            .policy = LIGHT_UPDATE_POLICY,                       \
+            .threshold = LIGHT_UPDATE_THRESHOLD,                 \
+            .relative_permille = LIGHT_UPDATE_RELATIVE * 10,     \
+            .interval_max = SENSOR_UPDATE_INTERVAL_MAX,          \
+        },                                                       \
+        .read = sensors_read_light,                              \
+        .publish = mqtt_send_light,                              \
+    }
+
+// Global variables
+const channel_t channels[CHANNEL_MAX] = {
+    LIGHT_CHANNEL(0, "light"),
+#if LIGHT_SENSORS > 1
+    LIGHT_CHANNEL(1, "light2"),
+#endif
+#if LIGHT_SENSORS > 2
+    LIGHT_CHANNEL(2, "light3"),
+#endif
+#if LIGHT_SENSORS > 3
+    LIGHT_CHANNEL(3, "light4"),
+#endif
+    [CHANNEL_TEMPERATURE] = {
+        .key = "temperature",
+        .decimals = 2,
+        .decision = {
+            .policy = TEMPERATURE_UPDATE_POLICY,
+            .threshold = DECISION_CENTI(TEMPERATURE_UPDATE_THRESHOLD),
+            .interval_max = SENSOR_UPDATE_INTERVAL_MAX,
+        },
+        .read = sensors_read_temperature,
+        .publish = mqtt_send_temperature,
+    },
+    [CHANNEL_HUMIDITY] = {
+        .key = "humidity",
+        .decimals = 2,
+        .decision = {
+            .policy = HUMIDITY_UPDATE_POLICY,
+            .threshold = DECISION_CENTI(HUMIDITY_UPDATE_THRESHOLD),
+            .interval_max = SENSOR_UPDATE_INTERVAL_MAX,
+        },
+        .read = sensors_read_humidity,
+        .publish = mqtt_send_humidity,
+    },
+};
+
+// RTC variables
+RTC_DATA_ATTR channel_state_t rtc_channels[CHANNEL_MAX];
+
+// Functions
+
+/**
+ * @brief    Invalidate every channel, so the next measurements are reported
+ *
+ */
+void channels_reset(void)
+{
+    for (uint8_t id = 0; id < CHANNEL_MAX; id++)
+        rtc_channels[id].valid = 0;
+}
+
+/**
+ * @brief    Checks if the last reported value of a channel is expired
+ *
+ * @param    id: Channel
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 expired or never reported, 0 otherwise
+ */
+uint8_t channel_is_expired(channel_id_t id, time_t timestamp)
+{
+    return decision_is_expired(&rtc_channels[id], rtc_settings.decision[id].interval_max, timestamp);
+}
+
+/**
+ * @brief    Time left before the first channel expires
+ *
+ * @param    timestamp: actual timestamp
+ * @return   time_t time left [sec], 0 if a channel was never reported
+ */
+time_t channels_expire_in(time_t timestamp)
+{
+    time_t left = INT32_MAX;
+
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+    {
+        if (!rtc_channels[id].valid)
+            return 0;
+
+        time_t expire = rtc_settings.decision[id].interval_max - (timestamp - rtc_channels[id].timestamp);
+        if (expire < left)
+            left = expire;
+    }
+    return left > 0 ? left : 0;
+}
+
+/**
+ * @brief    Checks if new measurement needs to be sent with the channel
+ *           report policy, and if so saves the value to send as the last
+ *           reported value.
+ *
+ * @param    id: Channel
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 needs update, 0 otherwise
+ */
+uint8_t handle_measurement(channel_id_t id, int32_t value, time_t timestamp)
+{
+    return decision_update(&rtc_channels[id], &rtc_settings.decision[id], value, timestamp);
+}
+
+/**
+ * @brief    Saves a new measurement as the last reported value,
+ *           regardless of the channel report policy
+ *
+ * @param    id: Channel
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ */
+void channel_force(channel_id_t id, int32_t value, time_t timestamp)
+{
+    decision_force(&rtc_channels[id], &rtc_settings.decision[id], value, timestamp);
+}
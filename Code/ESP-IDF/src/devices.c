@@ -0,0 +1,71 @@
+/**
+ * @file     devices.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    I2C devices of the node: controller, address and multiplexer
+ *           channel of every sensor. Edit the table to match the wiring.
+ *           Light sensors beyond the first one report on their own
+ *           channel (light2, light3, light4). Devices on a controller bus
+ *           need distinct addresses, a TCA9548A multiplexer channel or
+ *           the second controller (I2C_SECONDARY_ENABLE) isolate the rest.
+ *           A device behind a multiplexer channel shares the bus with the
+ *           devices outside it, so its address must differ from theirs too.
+ *           The BH1750 has two addresses: the first two sensors use both
+ *           on the first controller, the other two on the second one.
+ *           Sensors on the second controller are read in parallel.
+ *           The light sensor table is in RTC memory, the deep sleep wake
+ *           stub reads the light sensors too.
+ */
+
+// Include libraries
+#include "configuration.h"
+
+#include "devices.h"
+
+// Global variables
+RTC_RODATA_ATTR const i2c_device_t bh1750_devices[LIGHT_SENSORS] = {
+    {.port = I2C_MASTER_NUM, .address = BH1750_ADDR, .mux_address = I2C_MUX_NONE},
+#if LIGHT_SENSORS > 1
+    {.port = I2C_MASTER_NUM, .address = BH1750_ADDR_ALT, .mux_address = I2C_MUX_NONE}, // ADDR pin high
+#endif
+#if LIGHT_SENSORS > 2
+    {.port = I2C_SECONDARY_NUM, .address = BH1750_ADDR, .mux_address = I2C_MUX_NONE},
+#endif
+#if LIGHT_SENSORS > 3
+    {.port = I2C_SECONDARY_NUM, .address = BH1750_ADDR_ALT, .mux_address = I2C_MUX_NONE}, // ADDR pin high
+#endif
+};
+
+const i2c_device_t si7021_device = {.port = I2C_MASTER_NUM, .address = SI7021_ADDR, .mux_address = I2C_MUX_NONE};
+
+// Functions
+
+/**
+ * @brief    Disable the channels of every multiplexer in the table,
+ *           needed after a power on
+ *
+ * @return   esp_err_t status
+ */
+esp_err_t devices_reset_muxes(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    for (uint8_t i = 0; i < LIGHT_SENSORS && ret == ESP_OK; i++)
+    {
+        const i2c_device_t *device = &bh1750_devices[i];
+        uint8_t seen = device->mux_address == I2C_MUX_NONE;
+
+        for (uint8_t j = 0; j < i && !seen; j++)
+            seen = bh1750_devices[j].port == device->port && bh1750_devices[j].mux_address == device->mux_address;
+
+        if (!seen)
+            ret = i2c_mux_reset(device->port, device->mux_address);
+    }
+
+    if (ret == ESP_OK && si7021_device.mux_address != I2C_MUX_NONE)
+        ret = i2c_mux_reset(si7021_device.port, si7021_device.mux_address);
+
+    return ret;
+}
@@ -0,0 +1,371 @@
+/**
+ * @file     flashlog.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Append-only log of readings in a flash region.
+ *           The region is a ring of sectors, each one starting with a
+ *           header that holds a sequence number, followed by fixed size
+ *           record slots. Records are only ever programmed, a sent record
+ *           is marked by clearing its sent byte, and a sector is erased
+ *           only when the ring comes back to it, so every sector wears
+ *           the same. When the ring is full the oldest sector is dropped.
+ *           Records carry a CRC, a slot torn by a power loss is skipped.
+ *           Positions are rebuilt from the headers by flashlog_open(),
+ *           between deep sleeps they can be kept in RTC memory.
+ */
+
+// Include libraries
+#include <string.h>
+
+#include "flashlog.h"
+
+#define FLASHLOG_MAGIC 0x474F4C46 // "FLOG"
+#define SLOT_SENT 0x00
+#define SLOT_UNSENT 0xFF
+
+typedef struct
+{
+    uint32_t magic; // FLASHLOG_MAGIC once the sector is in use
+    uint32_t seq;   // Sector sequence number, increasing along the ring
+} flashlog_header_t;
+
+typedef struct
+{
+    uint32_t timestamp; // Reading timestamp [sec]
+    int32_t value;      // Reading value [fixed point units]
+    uint8_t channel;    // channel_id_t
+    uint8_t crc;        // CRC-8 of the fields above
+    uint8_t sent;       // SLOT_UNSENT until acknowledged
+    uint8_t reserved;
+} flashlog_slot_t;
+
+#define HEADER_SIZE sizeof(flashlog_header_t)
+#define SLOT_SIZE sizeof(flashlog_slot_t)
+#define SLOT_CRC_LEN offsetof(flashlog_slot_t, crc)
+
+// Private function declarations
+static uint8_t slot_crc(const flashlog_slot_t *slot);
+static uint8_t slot_is_empty(const flashlog_slot_t *slot);
+static uint8_t slot_is_pending(const flashlog_slot_t *slot);
+static uint32_t slot_next(const flashlog_storage_t *storage, uint32_t offset);
+static uint32_t log_end(const flashlog_t *log);
+static uint32_t log_seek(const flashlog_t *log, const flashlog_storage_t *storage, uint32_t offset);
+static int sector_start(flashlog_t *log, const flashlog_storage_t *storage);
+
+// Functions
+
+/**
+ * @brief    CRC-8 of a slot, polynomial 0x31
+ *
+ * @param    slot: Pointer to slot
+ * @return   uint8_t crc
+ */
+static uint8_t slot_crc(const flashlog_slot_t *slot)
+{
+    const uint8_t *data = (const uint8_t *)slot;
+    uint8_t crc = 0xFF;
+
+    for (size_t i = 0; i < SLOT_CRC_LEN; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * @brief    Checks if a slot was never programmed
+ *
+ * @param    slot: Pointer to slot
+ * @return   uint8_t: 1 empty, 0 otherwise
+ */
+static uint8_t slot_is_empty(const flashlog_slot_t *slot)
+{
+    const uint8_t *data = (const uint8_t *)slot;
+
+    for (size_t i = 0; i < SLOT_SIZE; i++)
+        if (data[i] != 0xFF)
+            return 0;
+    return 1;
+}
+
+/**
+ * @brief    Checks if a slot holds a valid record still to be sent
+ *
+ * @param    slot: Pointer to slot
+ * @return   uint8_t: 1 pending, 0 otherwise
+ */
+static uint8_t slot_is_pending(const flashlog_slot_t *slot)
+{
+    return !slot_is_empty(slot) && slot->sent == SLOT_UNSENT && slot->crc == slot_crc(slot);
+}
+
+/**
+ * @brief    Offset of the slot after a given one, along the ring
+ *
+ * @param    storage: Pointer to storage
+ * @param    offset: Slot offset
+ * @return   uint32_t next slot offset
+ */
+static uint32_t slot_next(const flashlog_storage_t *storage, uint32_t offset)
+{
+    uint32_t sector = offset - offset % FLASHLOG_SECTOR_SIZE;
+
+    offset += SLOT_SIZE;
+    if (offset + SLOT_SIZE > sector + FLASHLOG_SECTOR_SIZE)
+        offset = (sector + FLASHLOG_SECTOR_SIZE) % storage->size + HEADER_SIZE;
+    return offset;
+}
+
+/**
+ * @brief    First slot offset after the written records
+ *
+ * @param    log: Pointer to log
+ * @return   uint32_t offset
+ */
+static uint32_t log_end(const flashlog_t *log)
+{
+    return log->head % FLASHLOG_SECTOR_SIZE ? log->head : log->head + HEADER_SIZE;
+}
+
+/**
+ * @brief    First pending record from a given slot on
+ *
+ * @param    log: Pointer to log
+ * @param    storage: Pointer to storage
+ * @param    offset: Slot offset to start from
+ * @return   uint32_t pending record offset, log end if none
+ */
+static uint32_t log_seek(const flashlog_t *log, const flashlog_storage_t *storage, uint32_t offset)
+{
+    flashlog_slot_t slot;
+
+    for (uint32_t i = 0; log->count && i < storage->size / SLOT_SIZE; i++, offset = slot_next(storage, offset))
+        if (storage->read(storage->context, offset, &slot, SLOT_SIZE) == 0 && slot_is_pending(&slot))
+            return offset;
+    return log_end(log);
+}
+
+/**
+ * @brief    Rebuild the log positions from the storage
+ *
+ * @param    log: Pointer to log
+ * @param    storage: Pointer to storage
+ * @return   int: 0 on success
+ */
+int flashlog_open(flashlog_t *log, const flashlog_storage_t *storage)
+{
+    flashlog_header_t header;
+    flashlog_slot_t slot;
+    uint32_t oldest = 0, newest = 0, oldest_seq = UINT32_MAX, newest_seq = 0;
+    uint8_t used = 0;
+
+    log->valid = 0;
+    for (uint32_t sector = 0; sector < storage->size; sector += FLASHLOG_SECTOR_SIZE)
+    {
+        if (storage->read(storage->context, sector, &header, HEADER_SIZE) != 0)
+            return -1;
+        if (header.magic != FLASHLOG_MAGIC)
+            continue;
+
+        used = 1;
+        if (header.seq < oldest_seq)
+        {
+            oldest_seq = header.seq;
+            oldest = sector;
+        }
+        if (header.seq >= newest_seq)
+        {
+            newest_seq = header.seq;
+            newest = sector;
+        }
+    }
+
+    log->count = 0;
+    if (!used) // Blank storage
+    {
+        log->head = 0;
+        log->head_seq = 0;
+        log->tail = log_end(log);
+        log->valid = 1;
+        return 0;
+    }
+
+    // Head is the first empty slot of the newest sector
+    log->head_seq = newest_seq;
+    log->head = (newest + FLASHLOG_SECTOR_SIZE) % storage->size;
+    for (uint32_t offset = newest + HEADER_SIZE; offset + SLOT_SIZE <= newest + FLASHLOG_SECTOR_SIZE; offset += SLOT_SIZE)
+    {
+        if (storage->read(storage->context, offset, &slot, SLOT_SIZE) != 0)
+            return -1;
+        if (slot_is_empty(&slot))
+        {
+            log->head = offset;
+            break;
+        }
+    }
+
+    // Count the pending records from the oldest sector on, the whole ring if full
+    uint32_t end = log_end(log);
+    uint8_t full = log->head == oldest;
+
+    log->tail = end;
+    for (uint32_t offset = oldest + HEADER_SIZE; full || offset != end; full = 0, offset = slot_next(storage, offset))
+    {
+        if (storage->read(storage->context, offset, &slot, SLOT_SIZE) != 0)
+            return -1;
+        if (!slot_is_pending(&slot))
+            continue;
+        if (!log->count)
+            log->tail = offset;
+        log->count++;
+    }
+
+    log->valid = 1;
+    return 0;
+}
+
+/**
+ * @brief    Erase the head sector and write its header, the pending
+ *           records it still holds are dropped
+ *
+ * @param    log: Pointer to log
+ * @param    storage: Pointer to storage
+ * @return   int: 0 on success
+ */
+static int sector_start(flashlog_t *log, const flashlog_storage_t *storage)
+{
+    uint32_t sector = log->head;
+    flashlog_header_t header;
+    flashlog_slot_t slot;
+
+    if (storage->read(storage->context, sector, &header, HEADER_SIZE) != 0)
+        return -1;
+
+    if (header.magic == FLASHLOG_MAGIC) // Ring is full, drop the oldest sector
+    {
+        for (uint32_t offset = sector + HEADER_SIZE; offset + SLOT_SIZE <= sector + FLASHLOG_SECTOR_SIZE; offset += SLOT_SIZE)
+            if (storage->read(storage->context, offset, &slot, SLOT_SIZE) == 0 && slot_is_pending(&slot) && log->count)
+                log->count--;
+    }
+
+    if (storage->erase(storage->context, sector) != 0)
+        return -1;
+
+    header.magic = FLASHLOG_MAGIC;
+    header.seq = log->head_seq + 1;
+    if (storage->write(storage->context, sector, &header, HEADER_SIZE) != 0)
+        return -1;
+
+    log->head_seq = header.seq;
+    log->head = sector + HEADER_SIZE;
+
+    if (log->count && log->tail - log->tail % FLASHLOG_SECTOR_SIZE == sector)
+        log->tail = log_seek(log, storage, (sector + FLASHLOG_SECTOR_SIZE) % storage->size + HEADER_SIZE);
+
+    return 0;
+}
+
+/**
+ * @brief    Append a record
+ *
+ * @param    log: Pointer to log
+ * @param    storage: Pointer to storage
+ * @param    record: Pointer to record
+ * @return   int: 0 on success
+ */
+int flashlog_append(flashlog_t *log, const flashlog_storage_t *storage, const flashlog_record_t *record)
+{
+    if (log->head % FLASHLOG_SECTOR_SIZE == 0 && sector_start(log, storage) != 0)
+        return -1;
+
+    flashlog_slot_t slot = {
+        .timestamp = record->timestamp,
+        .value = record->value,
+        .channel = record->channel,
+        .sent = SLOT_UNSENT,
+        .reserved = 0xFF,
+    };
+    slot.crc = slot_crc(&slot);
+
+    uint32_t offset = log->head;
+    uint32_t sector = offset - offset % FLASHLOG_SECTOR_SIZE;
+
+    log->head += SLOT_SIZE; // Slot is used even if the write fails halfway
+    if (log->head + SLOT_SIZE > sector + FLASHLOG_SECTOR_SIZE)
+        log->head = (sector + FLASHLOG_SECTOR_SIZE) % storage->size;
+
+    if (storage->write(storage->context, offset, &slot, SLOT_SIZE) != 0)
+        return -1;
+
+    if (!log->count)
+        log->tail = offset;
+    log->count++;
+
+    return 0;
+}
+
+/**
+ * @brief    Read the oldest pending records, in append order
+ *
+ * @param    log: Pointer to log
+ * @param    storage: Pointer to storage
+ * @param    records: Pointer to records array
+ * @param    max: Records array size
+ * @return   size_t number of records read
+ */
+size_t flashlog_peek(const flashlog_t *log, const flashlog_storage_t *storage, flashlog_record_t *records, size_t max)
+{
+    flashlog_slot_t slot;
+    size_t count = 0;
+    uint32_t offset = log->tail;
+
+    for (uint32_t i = 0; count < max && count < log->count && i < storage->size / SLOT_SIZE; i++, offset = slot_next(storage, offset))
+    {
+        if (storage->read(storage->context, offset, &slot, SLOT_SIZE) != 0)
+            return count;
+        if (!slot_is_pending(&slot))
+            continue;
+
+        records[count].timestamp = slot.timestamp;
+        records[count].value = slot.value;
+        records[count].channel = slot.channel;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief    Mark the oldest pending records as sent
+ *
+ * @param    log: Pointer to log
+ * @param    storage: Pointer to storage
+ * @param    count: Number of records, as returned by flashlog_peek()
+ * @return   int: 0 on success
+ */
+int flashlog_consume(flashlog_t *log, const flashlog_storage_t *storage, size_t count)
+{
+    uint32_t offset = log->tail;
+    const uint8_t sent = SLOT_SENT;
+    flashlog_slot_t slot;
+
+    for (uint32_t i = 0; count && log->count && i < storage->size / SLOT_SIZE; i++, offset = slot_next(storage, offset))
+    {
+        if (storage->read(storage->context, offset, &slot, SLOT_SIZE) != 0)
+            return -1;
+        if (!slot_is_pending(&slot))
+            continue;
+
+        if (storage->write(storage->context, offset + offsetof(flashlog_slot_t, sent), &sent, 1) != 0)
+            return -1;
+        log->count--;
+        count--;
+    }
+
+    log->tail = log_seek(log, storage, offset);
+
+    return 0;
+}
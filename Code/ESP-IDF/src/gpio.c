@@ -8,20 +8,48 @@
  */
 
 // Include libraries
+#include <sys/time.h>
 #include <driver/rtc_io.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
 
 #include "configuration.h"
 
 #include "gpio.h"
 #include "wifi.h"
 #include "mqtt.h"
+#include "channels.h"
+#include "settings.h"
+#include "batch.h"
+#include "backlog.h"
+#include "trace.h"
+#include "wake.h"
+
+// Motion edge
+typedef struct
+{
+    uint32_t timestamp; // Edge timestamp [sec]
+    uint8_t level;      // PIR level after the edge
+} pir_edge_t;
 
 // Imported variables
-extern RTC_DATA_ATTR uint8_t rtc_pir;
+extern RTC_DATA_ATTR wake_pir_t rtc_pir;
 extern RTC_DATA_ATTR uint8_t rtc_pir_pending;
 
+// RTC variables
+RTC_DATA_ATTR pir_edge_t rtc_pir_edges[PIR_QUEUE_SIZE];
+RTC_DATA_ATTR uint8_t rtc_pir_edges_head; // Index of the oldest edge
+RTC_DATA_ATTR uint8_t rtc_pir_edges_count;
+RTC_DATA_ATTR uint8_t rtc_pir_reported;   // Last published motion state
+
+// Global variables
+portMUX_TYPE pir_mux = portMUX_INITIALIZER_UNLOCKED;
+int64_t pir_time_base; // Timestamp at esp_timer zero [us]
+
 // Private function declarations
 static void gpio_handler(void *args);
+static void pir_push(uint32_t timestamp, uint8_t level);
+static void pir_process(time_t timestamp);
 
 // Functions
 
@@ -43,6 +71,14 @@ void gpio_setup(void)
 
     gpio_config(&io_conf); // Configure GPIO
 
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    pir_time_base = now.tv_sec * 1000000LL + now.tv_usec - esp_timer_get_time(); // Edge time without gettimeofday in the ISR
+
+    portENTER_CRITICAL(&pir_mux);
+    pir_push(now.tv_sec, gpio_get_level((gpio_num_t)PIR_GPIO)); // Edge that woke the node
+    portEXIT_CRITICAL(&pir_mux);
+
     gpio_install_isr_service(0);
     gpio_isr_handler_add(PIR_GPIO, gpio_handler, NULL);
 }
@@ -54,33 +90,148 @@ void gpio_setup(void)
  */
 static void gpio_handler(void *args)
 {
-    rtc_pir = gpio_get_level((gpio_num_t)PIR_GPIO); // Save the PIR value into RTC memory
+    portENTER_CRITICAL_ISR(&pir_mux);
+    pir_push((pir_time_base + esp_timer_get_time()) / 1000000, gpio_get_level((gpio_num_t)PIR_GPIO)); // Save the edge into RTC memory
     rtc_pir_pending = 1;
+    portEXIT_CRITICAL_ISR(&pir_mux);
+}
+
+/**
+ * @brief    Store a motion edge, the oldest one is overwritten if full.
+ *           Must be called with pir_mux taken.
+ * 
+ * @param    timestamp: Edge timestamp
+ * @param    level: PIR level after the edge
+ */
+static void pir_push(uint32_t timestamp, uint8_t level)
+{
+    pir_edge_t *edge = &rtc_pir_edges[(rtc_pir_edges_head + rtc_pir_edges_count) % PIR_QUEUE_SIZE];
+
+    edge->timestamp = timestamp;
+    edge->level = level;
+
+    if (rtc_pir_edges_count < PIR_QUEUE_SIZE)
+        rtc_pir_edges_count++;
+    else
+        rtc_pir_edges_head = (rtc_pir_edges_head + 1) % PIR_QUEUE_SIZE; // Drop the oldest edge
+}
+
+/**
+ * @brief    Merge the stored edges into the motion state.
+ *           Motion starts with a rising edge and ends only after the PIR
+ *           stayed low for the hold-off time, so a burst of motion is a
+ *           single on/off pair.
+ * 
+ * @param    timestamp: actual timestamp
+ */
+static void pir_process(time_t timestamp)
+{
+    portENTER_CRITICAL(&pir_mux);
+    while (rtc_pir_edges_count)
+    {
+        const pir_edge_t *edge = &rtc_pir_edges[rtc_pir_edges_head];
+
+        wake_pir_edge(&rtc_pir, edge->level, edge->timestamp);
+
+        rtc_pir_edges_head = (rtc_pir_edges_head + 1) % PIR_QUEUE_SIZE;
+        rtc_pir_edges_count--;
+    }
+    portEXIT_CRITICAL(&pir_mux);
+
+    wake_pir_expire(&rtc_pir, rtc_settings.pir_holdoff_sec, timestamp); // No motion for the whole hold-off
+}
+
+/**
+ * @brief    Checks if the motion state needs to be published
+ * 
+ * @param    timestamp: actual timestamp
+ * @return   uint8_t: 1 publish needed, 0 otherwise
+ */
+uint8_t pir_is_due(time_t timestamp)
+{
+    pir_process(timestamp);
+
+    return rtc_pir.motion != rtc_pir_reported;
+}
+
+/**
+ * @brief    Shortens the sleep time to wake up when the hold-off
+ *           of the last motion expires
+ * 
+ * @param    timestamp: actual timestamp
+ * @param    sleep_time: planned sleep time [sec]
+ * @return   uint32_t sleep time [sec]
+ */
+uint32_t pir_sleep_time(time_t timestamp, uint32_t sleep_time)
+{
+    return wake_pir_sleep_time(&rtc_pir, rtc_settings.pir_holdoff_sec, timestamp, sleep_time);
 }
 
 /**
  * @brief    PIR handler function.
- *           This function saves the actual PIR value into RTC memory,
- *           requests the Wi-Fi connection to be established and sends
- *           the new PIR value via MQTT.
+ *           This function merges the stored motion edges and, if the motion
+ *           state changed since it was last published, requests the Wi-Fi
+ *           connection to be established and sends it via MQTT together
+ *           with the given channels.
  * 
+ * @param    piggyback: Bit mask of the channels to send with the motion state
  * @return   esp_err_t status
  */
-esp_err_t handle_pir(void)
+esp_err_t handle_pir(uint8_t piggyback)
 {
-    if (!rtc_pir_pending)
-        rtc_pir = gpio_get_level((gpio_num_t)PIR_GPIO); // Save the PIR value into RTC memory
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    rtc_pir_pending = 0;
+    if (!pir_is_due(now.tv_sec))
+        return ESP_OK; // Edge merged into the motion already reported
 
     ESP_ERROR_CHECK(wifi_setup());     // Turn on Wi-Fi
     esp_err_t ret = wifi_event_wait(); // Wait for Wi-Fi connection
 
     if (ret == ESP_OK)
     {
-        ESP_ERROR_CHECK(mqtt_setup());                         // Setup MQTT
-        ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_pir(rtc_pir)); // Send PIR value
-        rtc_pir_pending = 0;
-        return (mqtt_event_wait()); // Wait for MQTT ack
+        ESP_ERROR_CHECK(mqtt_setup()); // Setup MQTT
+
+        trace_phase_begin(TRACE_PHASE_MQTT_PUBLISH);
+        backlog_replay(); // Send readings of failed sessions first, older than the piggybacked ones
+#if MQTT_COMBINED_PAYLOAD
+        ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_state()); // Send PIR value with the other measurements
+#else
+        ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_pir(rtc_pir.motion)); // Send PIR value
+        for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+        {
+            if (!(piggyback & (1 << id)))
+                continue;
+#if BATCH_ENABLE
+            batch_push(id, rtc_channels[id].value, rtc_channels[id].timestamp); // Flushed below in time order
+#else
+            ESP_ERROR_CHECK_WITHOUT_ABORT(channels[id].publish(channels[id].sensor, rtc_channels[id].value, rtc_channels[id].timestamp)); // Send channel value
+#endif
+        }
+#endif
+        ret = mqtt_event_wait(); // Wait for MQTT ack
+        if (ret == ESP_OK)
+            rtc_pir_reported = rtc_pir.motion;
+
+#if BATCH_ENABLE && MQTT_COMBINED_PAYLOAD
+        if (ret == ESP_OK)
+            batch_clear(); // Stored readings were sent with the state
+#elif BATCH_ENABLE
+        if (batch_flush() != ESP_OK) // Send stored readings with the motion event
+            ret = ESP_FAIL;
+#endif
+        trace_publish(); // Send wake trace
+        trace_phase_end(TRACE_PHASE_MQTT_PUBLISH);
     }
-    else
-        return ret;
+
+#if !BATCH_ENABLE
+    if (ret != ESP_OK)
+        for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+            if (piggyback & (1 << id))
+                backlog_store(id, rtc_channels[id].value, rtc_channels[id].timestamp); // Not sent with the motion state
+#endif
+    backlog_result(ret, now.tv_sec);
+
+    return ret;
 }
@@ -5,17 +5,59 @@
  * @date     13-09-2020
  * 
  * @brief    I2C functions
+ *           Transactions target a device handle: controller, address and
+ *           optionally a TCA9548A multiplexer channel, selected before
+ *           the transaction when it isn't already. With
+ *           I2C_SECONDARY_ENABLE the transactions queued on the second
+ *           controller run in a task of their own, in parallel with the
+ *           ones of the first controller.
  */
 
 // Include libraries
 #include "driver/i2c.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "configuration.h"
 
 #include "i2c.h"
 
+#if I2C_SECONDARY_ENABLE
+_Static_assert(I2C_SECONDARY_NUM != I2C_MASTER_NUM, "The I2C controllers need different ports");
+#endif
+
+#define I2C_ACK_CHECK_EN true // Fail on a byte not acknowledged, a converting Si7021 doesn't acknowledge its address
+
+// Transactions queued on a controller
+typedef struct
+{
+    i2c_transaction_t *queue[I2C_QUEUE_SIZE];
+    uint8_t count;
+    uint8_t ready;    // Controller setup done
+    esp_err_t status; // First error of the last run
+} i2c_bus_t;
+
+// RTC variables
+RTC_DATA_ATTR i2c_mux_state_t rtc_i2c_mux[I2C_NUM_MAX];
+
 // Global variables
-i2c_port_t i2c_master_port = 0;
+i2c_bus_t i2c_buses[I2C_NUM_MAX];
+
+#if I2C_SECONDARY_ENABLE
+TaskHandle_t i2c_worker = NULL;
+SemaphoreHandle_t i2c_worker_done = NULL;
+#endif
+
+// Private function declarations
+esp_err_t i2c_transaction_run(i2c_transaction_t *transaction);
+static esp_err_t i2c_port_setup(i2c_port_t port, int sda_io, int scl_io, uint32_t clk_speed);
+static esp_err_t i2c_bus_run_port(i2c_port_t port);
+static esp_err_t i2c_mux_select(const i2c_device_t *device);
+static esp_err_t i2c_mux_write(i2c_port_t port, uint8_t mux_address, uint8_t channels);
+#if I2C_SECONDARY_ENABLE
+static void i2c_worker_task(void *args);
+#endif
 
 // Functions
 
@@ -25,17 +67,311 @@ i2c_port_t i2c_master_port = 0;
  * @return   esp_err_t status
  */
 esp_err_t i2c_setup(void)
+{
+    esp_err_t ret = i2c_port_setup(I2C_MASTER_NUM, I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO, I2C_MASTER_FREQ_HZ);
+
+#if I2C_SECONDARY_ENABLE
+    if (ret == ESP_OK)
+        ret = i2c_port_setup(I2C_SECONDARY_NUM, I2C_SECONDARY_SDA_IO, I2C_SECONDARY_SCL_IO, I2C_SECONDARY_FREQ_HZ);
+
+    if (ret == ESP_OK && i2c_worker == NULL)
+    {
+        i2c_worker_done = xSemaphoreCreateBinary();
+        if (i2c_worker_done == NULL)
+            return ESP_ERR_NO_MEM;
+
+        if (xTaskCreatePinnedToCore(i2c_worker_task,
+                                    "i2c_worker",
+                                    I2C_WORKER_TASK_STACK_SIZE,
+                                    NULL,
+                                    I2C_WORKER_TASK_PRIORITY,
+                                    &i2c_worker,
+                                    1) != pdPASS)
+            return ESP_FAIL;
+    }
+#endif
+
+    return ret;
+}
+
+/**
+ * @brief    Setup of one I2C controller
+ * 
+ * @param    port: I2C port
+ * @param    sda_io: Data pin
+ * @param    scl_io: Clock pin
+ * @param    clk_speed: Bus frequency [Hz]
+ * @return   esp_err_t status
+ */
+static esp_err_t i2c_port_setup(i2c_port_t port, int sda_io, int scl_io, uint32_t clk_speed)
 {
     i2c_config_t conf;
     conf.mode = I2C_MODE_MASTER;
-    conf.sda_io_num = I2C_MASTER_SDA_IO;
+    conf.sda_io_num = sda_io;
     conf.sda_pullup_en = GPIO_PULLUP_DISABLE;
-    conf.scl_io_num = I2C_MASTER_SCL_IO;
+    conf.scl_io_num = scl_io;
     conf.scl_pullup_en = GPIO_PULLUP_DISABLE;
-    conf.master.clk_speed = I2C_MASTER_FREQ_HZ;
+    conf.master.clk_speed = clk_speed;
+
+    i2c_param_config(port, &conf); // I2C configuration
+
+    esp_err_t ret = i2c_driver_install(port, conf.mode, 0, 0, 0); // I2C driver start
+    if (ret == ESP_OK)
+        i2c_buses[port].ready = 1;
+
+    return ret;
+}
+
+/**
+ * @brief    Disable every channel of a multiplexer. Multiplexers keep
+ *           their channel through deep sleep, so they are reset after a
+ *           power on, when the state in RTC memory is lost.
+ * 
+ * @param    port: I2C port of the multiplexer
+ * @param    mux_address: Multiplexer address
+ * @return   esp_err_t status
+ */
+esp_err_t i2c_mux_reset(i2c_port_t port, uint8_t mux_address)
+{
+    esp_err_t ret = i2c_mux_write(port, mux_address, 0);
+
+    if (ret == ESP_OK && rtc_i2c_mux[port].address == mux_address)
+        rtc_i2c_mux[port].address = I2C_MUX_NONE;
+
+    return ret;
+}
+
+/**
+ * @brief    Prepare a statically allocated transaction
+ * 
+ * @param    transaction: Pointer to transaction
+ * @param    device: Target device
+ * @param    tx_len: Number of bytes to write
+ * @param    rx_len: Number of bytes to read
+ */
+void i2c_transaction_init(i2c_transaction_t *transaction, const i2c_device_t *device, uint8_t tx_len, uint8_t rx_len)
+{
+    transaction->device = device;
+    transaction->tx_len = tx_len;
+    transaction->rx_len = rx_len;
+}
+
+/**
+ * @brief    Queue a transaction on the controller of its device,
+ *           executed by the next i2c_bus_run call
+ * 
+ * @param    transaction: Pointer to transaction
+ * @param    callback: Completion callback, can be NULL
+ * @param    args: Completion callback arguments
+ * @return   esp_err_t status
+ */
+esp_err_t i2c_bus_submit(i2c_transaction_t *transaction, i2c_callback_t callback, void *args)
+{
+    i2c_bus_t *bus = &i2c_buses[transaction->device->port];
+
+    if (!bus->ready)
+        return ESP_ERR_INVALID_STATE;
+    if (bus->count >= I2C_QUEUE_SIZE)
+        return ESP_ERR_NO_MEM;
+
+    transaction->callback = callback;
+    transaction->args = args;
+    bus->queue[bus->count++] = transaction;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief    Execute every queued transaction back to back, calling
+ *           each completion callback as soon as its transaction ends.
+ *           The two controllers run their queues in parallel, callbacks
+ *           of the second one are called from its task.
+ * 
+ * @return   esp_err_t status: first error, ESP_OK if every transaction succeeded
+ */
+esp_err_t i2c_bus_run(void)
+{
+#if I2C_SECONDARY_ENABLE
+    uint8_t parallel = i2c_buses[I2C_SECONDARY_NUM].count > 0;
+    if (parallel)
+        xTaskNotifyGive(i2c_worker); // Second controller starts its queue
+#endif
+
+    esp_err_t ret = i2c_bus_run_port(I2C_MASTER_NUM);
+
+#if I2C_SECONDARY_ENABLE
+    if (parallel)
+    {
+        xSemaphoreTake(i2c_worker_done, portMAX_DELAY); // Bounded by the transaction timeouts
+        if (ret == ESP_OK)
+            ret = i2c_buses[I2C_SECONDARY_NUM].status;
+    }
+#endif
+
+    return ret;
+}
+
+/**
+ * @brief    Execute the queued transactions of one controller
+ * 
+ * @param    port: I2C port
+ * @return   esp_err_t status: first error, ESP_OK if every transaction succeeded
+ */
+static esp_err_t i2c_bus_run_port(i2c_port_t port)
+{
+    i2c_bus_t *bus = &i2c_buses[port];
+    esp_err_t ret = ESP_OK;
+
+    for (uint8_t i = 0; i < bus->count; i++)
+    {
+        i2c_transaction_t *transaction = bus->queue[i];
+        esp_err_t status = i2c_transaction_run(transaction);
+
+        if (transaction->callback != NULL)
+            transaction->callback(status, transaction->args);
+        if (ret == ESP_OK)
+            ret = status;
+    }
+    bus->count = 0;
+    bus->status = ret;
+
+    return ret;
+}
+
+#if I2C_SECONDARY_ENABLE
+
+/**
+ * @brief    Second controller task, runs its queue when notified
+ * 
+ * @param    args: Unused
+ */
+static void i2c_worker_task(void *args)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        i2c_bus_run_port(I2C_SECONDARY_NUM);
+        xSemaphoreGive(i2c_worker_done);
+    }
+}
+
+#endif
+
+/**
+ * @brief    Execute a single transaction right away
+ * 
+ * @param    transaction: Pointer to transaction
+ * @return   esp_err_t status
+ */
+esp_err_t i2c_bus_transfer(i2c_transaction_t *transaction)
+{
+    if (!i2c_buses[transaction->device->port].ready)
+        return ESP_ERR_INVALID_STATE;
+
+    return i2c_transaction_run(transaction);
+}
+
+/**
+ * @brief    Build the command link of a transaction and execute it,
+ *           after selecting the multiplexer channel of its device.
+ *           i2c_master_cmd_begin() consumes the link as it runs, so a
+ *           new one is built for every run.
+ * 
+ * @param    transaction: Pointer to transaction
+ * @return   esp_err_t status
+ */
+esp_err_t i2c_transaction_run(i2c_transaction_t *transaction)
+{
+    const i2c_device_t *device = transaction->device;
+
+    esp_err_t ret = i2c_mux_select(device);
+    if (ret != ESP_OK)
+        return ret;
+
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL)
+        return ESP_ERR_NO_MEM;
+
+    i2c_master_start(cmd);
+    if (transaction->tx_len)
+    {
+        i2c_master_write_byte(cmd, (device->address << 1) | I2C_MASTER_WRITE, I2C_ACK_CHECK_EN);
+        i2c_master_write(cmd, transaction->tx, transaction->tx_len, I2C_ACK_CHECK_EN);
+        if (transaction->rx_len)
+            i2c_master_start(cmd); // Repeated start
+    }
+    if (transaction->rx_len)
+    {
+        i2c_master_write_byte(cmd, (device->address << 1) | I2C_MASTER_READ, I2C_ACK_CHECK_EN);
+        i2c_master_read(cmd, transaction->rx, transaction->rx_len, I2C_MASTER_LAST_NACK);
+    }
+    i2c_master_stop(cmd);
+
+    ret = i2c_master_cmd_begin(device->port, cmd, I2C_TRANSACTION_TIMEOUT_MS / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+
+    return ret;
+}
+
+/**
+ * @brief    Connect the bus segment of a device. A device on the
+ *           controller bus disconnects the enabled multiplexer channel,
+ *           as a device behind it could have the same address.
+ * 
+ * @param    device: Target device
+ * @return   esp_err_t status
+ */
+static esp_err_t i2c_mux_select(const i2c_device_t *device)
+{
+    i2c_mux_state_t *state = &rtc_i2c_mux[device->port];
+    esp_err_t ret;
+
+    if (state->address == device->mux_address &&
+        (device->mux_address == I2C_MUX_NONE || state->channel == device->mux_channel))
+        return ESP_OK; // Already connected
+
+    if (state->address != I2C_MUX_NONE && state->address != device->mux_address)
+    {
+        ret = i2c_mux_write(device->port, state->address, 0); // Disconnect the other multiplexer
+        if (ret != ESP_OK)
+            return ret;
+        state->address = I2C_MUX_NONE;
+    }
+
+    if (device->mux_address == I2C_MUX_NONE)
+        return ESP_OK;
+
+    ret = i2c_mux_write(device->port, device->mux_address, 1 << device->mux_channel);
+    if (ret == ESP_OK)
+    {
+        state->address = device->mux_address;
+        state->channel = device->mux_channel;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief    Write the channel register of a TCA9548A multiplexer
+ * 
+ * @param    port: I2C port of the multiplexer
+ * @param    mux_address: Multiplexer address
+ * @param    channels: Bit mask of the enabled channels
+ * @return   esp_err_t status
+ */
+static esp_err_t i2c_mux_write(i2c_port_t port, uint8_t mux_address, uint8_t channels)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL)
+        return ESP_ERR_NO_MEM;
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (mux_address << 1) | I2C_MASTER_WRITE, I2C_ACK_CHECK_EN);
+    i2c_master_write_byte(cmd, channels, I2C_ACK_CHECK_EN);
+    i2c_master_stop(cmd);
 
-    i2c_master_port = I2C_MASTER_NUM;
-    i2c_param_config(i2c_master_port, &conf); // I2C configuration
+    esp_err_t ret = i2c_master_cmd_begin(port, cmd, I2C_TRANSACTION_TIMEOUT_MS / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
 
-    return i2c_driver_install(i2c_master_port, conf.mode, 0, 0, 0); // I2C driver start
+    return ret;
 }
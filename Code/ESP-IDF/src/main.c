@@ -22,31 +22,36 @@
 
 #include "gpio.h"
 #include "i2c.h"
+#include "devices.h"
 #include "bh1750.h"
 #include "si7021.h"
+#include "sensors.h"
+#include "channels.h"
+#include "settings.h"
+#include "schedule.h"
 #include "wifi.h"
 #include "mqtt.h"
+#include "batch.h"
+#include "backlog.h"
+#include "wake_stub.h"
+#include "trace.h"
+#include "wake.h"
 
 // Global variables
 struct timeval timestamp;
 
 // RTC variables
-RTC_DATA_ATTR float rtc_temperature;
-RTC_DATA_ATTR float rtc_humidity;
-RTC_DATA_ATTR uint16_t rtc_light;
-RTC_DATA_ATTR uint8_t rtc_pir;
-RTC_DATA_ATTR uint8_t rtc_pir_pending;
-RTC_DATA_ATTR struct timeval rtc_temperature_timestamp;
-RTC_DATA_ATTR struct timeval rtc_humidity_timestamp;
-RTC_DATA_ATTR struct timeval rtc_light_timestamp;
-RTC_DATA_ATTR uint8_t rtc_temperature_valid;
-RTC_DATA_ATTR uint8_t rtc_humidity_valid;
-RTC_DATA_ATTR uint8_t rtc_light_valid;
+RTC_DATA_ATTR wake_pir_t rtc_pir;      // Motion state, after the hold-off
+RTC_DATA_ATTR uint8_t rtc_pir_pending; // Motion edges received while awake
 
 // Private function declarations
 esp_err_t setup(void);
+esp_err_t setup_sensors(void);
 esp_err_t check_measurements(void);
-uint8_t handle_measurement(measurement_type type, void *measurement, uint8_t *rtc_measurement_valid, void *rtc_measurement, float update_threshold, struct timeval timestamp, struct timeval *rtc_timestamp);
+void store_unsent(uint8_t unsent);
+uint8_t piggyback_measurements(void);
+uint8_t report_expected(void);
+uint32_t full_boot_in(void);
 void start_deep_sleep(void);
 
 // Functions
@@ -60,20 +65,30 @@ void app_main(void)
     gettimeofday(&timestamp, NULL); // Get current timestamp
 
     esp_sleep_wakeup_cause_t wakeup_cause = esp_sleep_get_wakeup_cause();
+    trace_wake(timestamp.tv_sec, wakeup_cause); // Boot phase ends here
+
+    settings_load(); // Cached in RTC memory, NVS is only read after a reset
 
     switch (wakeup_cause)
     {
 
     // Actions to execute after a routine wakeup
     case ESP_SLEEP_WAKEUP_TIMER:
+        trace_phase_begin(TRACE_PHASE_SETUP);
         i2c_setup();
+        if (settings_sensors_changed()) // New resolutions received in the last session
+            ESP_ERROR_CHECK_WITHOUT_ABORT(setup_sensors());
+        trace_phase_end(TRACE_PHASE_SETUP);
         check_measurements();
+        if (pir_is_due(timestamp.tv_sec)) // Hold-off of the last motion expired
+            handle_pir(0);
         break;
 
     // Actions to execute after a PIR interrupt wakeup
     case ESP_SLEEP_WAKEUP_EXT0:
         gpio_setup();
-        handle_pir();
+        if (pir_is_due(timestamp.tv_sec)) // Edges within the hold-off merge into the reported motion
+            handle_pir(piggyback_measurements());
         break;
 
     // Actions to execute after every other wakeup cause
@@ -84,7 +99,9 @@ void app_main(void)
     }
 
     if (rtc_pir_pending)
-        handle_pir();
+        handle_pir(0); // Edges received while connected
+
+    trace_report(wakeup_cause);
 
     start_deep_sleep();
 }
@@ -96,70 +113,135 @@ void app_main(void)
  */
 esp_err_t setup(void)
 {
-    rtc_light_valid = 0;
-    rtc_temperature_valid = 0;
-    rtc_humidity_valid = 0;
+    channels_reset();
+#if SLEEP_ADAPTIVE
+    schedule_reset(timestamp.tv_sec);
+#endif
 
-    ESP_ERROR_CHECK(i2c_setup());
+    trace_phase_begin(TRACE_PHASE_SETUP);
 
-    bh1750_mode_t bh1750_mode = BH1750_MODE;
-    bh1750_resolution_t bh1750_resolution = BH1750_RESOLUTION;
-    ESP_ERROR_CHECK(bh1750_setup(bh1750_mode, bh1750_resolution));
+    ESP_ERROR_CHECK(i2c_setup());
+    ESP_ERROR_CHECK(devices_reset_muxes()); // Multiplexer channels are unknown after a reset
+    settings_sensors_changed(); // Resolutions are set below
+    ESP_ERROR_CHECK(setup_sensors());
 
-    si7021_resolution_t si7021_resolution = SI7021_RESOLUTION;
-    ESP_ERROR_CHECK(si7021_setup(si7021_resolution));
+    trace_phase_end(TRACE_PHASE_SETUP);
 
     return ESP_OK;
 }
 
+/**
+ * @brief    Set the sensor parameters, I2C must be already setup
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t setup_sensors(void)
+{
+    bh1750_mode_t bh1750_mode = BH1750_MODE;
+    bh1750_resolution_t bh1750_resolution = rtc_settings.bh1750_resolution;
+    for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+    {
+        esp_err_t ret = bh1750_setup(sensor, bh1750_mode, bh1750_resolution);
+        if (ret != ESP_OK)
+            return ret;
+    }
+
+    si7021_resolution_t si7021_resolution = rtc_settings.si7021_resolution;
+    return si7021_setup(si7021_resolution);
+}
+
 /**
  * @brief    Sensor reading and measurements handler function.
- *           This function reads the value of the light, temperature and humidity
- *           measurements, then checks if the new measurements need to be sent
+ *           This function reads the value of every measurement channel,
+ *           then checks if the new measurements need to be sent
  *           and if so, requests the Wi-Fi connection to be established and sends
  *           the required measurements via MQTT.
+ *           With BATCH_ENABLE the measurements are stored in RTC memory
+ *           instead, and sent together once the batch is due.
  * 
  * @return   esp_err_t status
  */
 esp_err_t check_measurements(void)
 {
-    uint8_t light_needs_update = 0,
-            temperature_needs_update = 0,
-            humidity_needs_update = 0;
-
-    // BH1750 measurement
-    uint16_t light;
-    ESP_ERROR_CHECK(bh1750_read(&light)); // Sensor reading
-    light_needs_update = handle_measurement(int_t,
-                                            &light,
-                                            &rtc_light_valid,
-                                            &rtc_light,
-                                            LIGHT_UPDATE_THRESHOLD,
-                                            timestamp,
-                                            &rtc_light_timestamp);
-
-    // Si7021 measurement
-    float temperature, humidity;
-    ESP_ERROR_CHECK(si7021_measure(&temperature, &humidity)); // Sensor reading
-    temperature_needs_update = handle_measurement(float_t,
-                                                  &temperature,
-                                                  &rtc_temperature_valid,
-                                                  &rtc_temperature,
-                                                  TEMPERATURE_UPDATE_THRESHOLD,
-                                                  timestamp,
-                                                  &rtc_temperature_timestamp);
-
-    humidity_needs_update = handle_measurement(float_t,
-                                               &humidity,
-                                               &rtc_humidity_valid,
-                                               &rtc_humidity,
-                                               HUMIDITY_UPDATE_THRESHOLD,
-                                               timestamp,
-                                               &rtc_humidity_timestamp);
+    uint8_t needs_update = 0; // Bit mask of the channels to send
+
+    // Connect while reading sensors if Wi-Fi is going to be needed
+    if (WIFI_SPECULATIVE_START == 2 || (WIFI_SPECULATIVE_START == 1 && report_expected()))
+        ESP_ERROR_CHECK_WITHOUT_ABORT(wifi_setup_background());
+
+    trace_phase_begin(TRACE_PHASE_SENSOR_READ);
+
+    ESP_ERROR_CHECK(sensors_acquire()); // Burst of readings of every sensor, filtered
+
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+    {
+        int32_t value;
+
+        if (channels[id].read(channels[id].sensor, &value) != ESP_OK)
+            continue;
+
+        if (handle_measurement(id, value, timestamp.tv_sec))
+            needs_update |= 1 << id;
+#if SLEEP_ADAPTIVE
+        schedule_update(id, value, timestamp.tv_sec);
+#endif
+    }
+
+    trace_phase_end(TRACE_PHASE_SENSOR_READ);
+
+#if BATCH_ENABLE
+
+    // Store the readings that need an update
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+        if (needs_update & (1 << id))
+            batch_push(id, rtc_channels[id].value, rtc_channels[id].timestamp); // Swinging door reports a past sample
+
+#if SLEEP_ADAPTIVE
+    schedule_plan(timestamp.tv_sec); // Plan after the batch, its deadline counts too
+#endif
+
+    // Check if the stored readings need to be sent, unless waiting after a failed session
+    if (batch_is_due(timestamp.tv_sec) && !backlog_is_offline(timestamp.tv_sec))
+    {
+        ESP_ERROR_CHECK(wifi_setup());     // Turn on Wi-Fi
+        esp_err_t ret = wifi_event_wait(); // Wait for Wi-Fi connection
+
+        if (ret == ESP_OK) // If Wi-Fi connection is established
+        {
+            ESP_ERROR_CHECK(mqtt_setup()); // Setup MQTT
+
+            trace_phase_begin(TRACE_PHASE_MQTT_PUBLISH);
+            backlog_replay();    // Send readings of failed sessions first
+            ret = batch_flush(); // Send stored readings
+            trace_publish();     // Send wake trace
+            trace_phase_end(TRACE_PHASE_MQTT_PUBLISH);
+        }
+        backlog_result(ret, timestamp.tv_sec);
+        return ret;
+    }
+
+    if (!pir_is_due(timestamp.tv_sec))
+        wifi_stop(); // Cancel speculative connection
+    return ESP_OK;
+
+#else
+
+#if SLEEP_ADAPTIVE
+    schedule_plan(timestamp.tv_sec);
+#endif
+
+    // Store the update while waiting after a failed session
+    if (needs_update && backlog_is_offline(timestamp.tv_sec))
+    {
+        store_unsent(needs_update);
+        needs_update = 0;
+    }
 
     // Check if an update is needed
-    if (light_needs_update || temperature_needs_update || humidity_needs_update)
+    if (needs_update)
     {
+        uint8_t sent = 0; // Bit mask of the channels acknowledged
+
         ESP_ERROR_CHECK(wifi_setup());     // Turn on Wi-Fi
         esp_err_t ret = wifi_event_wait(); // Wait for Wi-Fi connection
 
@@ -167,92 +249,149 @@ esp_err_t check_measurements(void)
         {
             ESP_ERROR_CHECK(mqtt_setup()); // Setup MQTT
 
-            // Light update check
-            if (light_needs_update)
-            {
-                ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_light(light)); // Send light value
-                if (mqtt_event_wait() != ESP_OK)                       // Wait for MQTT ack
-                    ret = ESP_FAIL;
-            }
-
-            // Temperature update check
-            if (temperature_needs_update)
-            {
-                ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_temperature(temperature)); // Send temperature value
-                if (mqtt_event_wait() != ESP_OK)                                   // Wait for MQTT ack
-                    ret = ESP_FAIL;
-            }
-
-            // Humidity update check
-            if (humidity_needs_update)
-            {
-                ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_humidity(humidity)); // Send humidity value
-                if (mqtt_event_wait() != ESP_OK)                             // Wait for MQTT ack
-                    ret = ESP_FAIL;
-            }
+            trace_phase_begin(TRACE_PHASE_MQTT_PUBLISH);
+
+            backlog_replay(); // Send readings of failed sessions first
+
+#if MQTT_COMBINED_PAYLOAD
+            ESP_ERROR_CHECK_WITHOUT_ABORT(mqtt_send_state()); // Send all values in one message
+
+            if (mqtt_event_wait() != ESP_OK) // Wait for MQTT ack
+                ret = ESP_FAIL;
+            if (mqtt_message_status(0) == ESP_OK)
+                sent = needs_update;
+#else
+            channel_id_t order[CHANNEL_MAX]; // Channel of every queued message
+            uint8_t queued = 0;
+
+            for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+                if (needs_update & (1 << id))
+                    if (ESP_ERROR_CHECK_WITHOUT_ABORT(channels[id].publish(channels[id].sensor, rtc_channels[id].value, rtc_channels[id].timestamp)) == ESP_OK) // Send channel value
+                        order[queued++] = id;
+
+            if (mqtt_event_wait() != ESP_OK) // Wait for all MQTT acks
+                ret = ESP_FAIL;
+            for (uint8_t i = 0; i < queued; i++)
+                if (mqtt_message_status(i) == ESP_OK)
+                    sent |= 1 << order[i];
+#endif
+            trace_publish(); // Send wake trace
+
+            trace_phase_end(TRACE_PHASE_MQTT_PUBLISH);
         }
+
+        store_unsent(needs_update & ~sent);
+        backlog_result(ret, timestamp.tv_sec);
         return ret;
     }
+
+    if (!pir_is_due(timestamp.tv_sec))
+        wifi_stop(); // Cancel speculative connection
     return ESP_OK;
+
+#endif
 }
 
 /**
- * @brief    Checks if new measurement needs to be sent.
+ * @brief    Stores the last reported value of some channels in the
+ *           backlog, to be sent in a later session
  * 
- * @param    type: int_t or float_t 
- * @param    measurement: pointer to new measurement
- * @param    rtc_measurement_valid: pointer to valid rtc measurement flag
- * @param    rtc_measurement: pointer to rtc measurement
- * @param    update_threshold: threshold to cross for sending a measurement
- * @param    timestamp: actual timestamp
- * @param    rtc_timestamp: pointer to rtc measurement timestamp
- * @return   uint8_t: 0-1 needs update, -1 error
+ * @param    unsent: Bit mask of the channels
  */
-uint8_t handle_measurement(measurement_type type, void *measurement, uint8_t *rtc_measurement_valid, void *rtc_measurement, float update_threshold, struct timeval timestamp, struct timeval *rtc_timestamp)
+void store_unsent(uint8_t unsent)
 {
-    float delta, value, rtc_value;
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+        if (unsent & (1 << id))
+            backlog_store(id, rtc_channels[id].value, rtc_channels[id].timestamp);
+}
 
-    if (type == int_t) // If measurement type is integer
-    {
-        value = *((int16_t *)measurement); // Cast values with integer type
-        rtc_value = *((int16_t *)rtc_measurement);
-    }
-    else if (type == float_t) // If measurement type is float
-    {
-        value = *((float *)measurement); // Cast values with float type
-        rtc_value = *((float *)rtc_measurement);
-    }
-    else           // If measurement type is not correct
-        return -1; // Return error value
+/**
+ * @brief    Reads the channels close to their report deadline, so they
+ *           are sent with the motion state instead of in a Wi-Fi session
+ *           of their own
+ * 
+ * @return   uint8_t bit mask of the channels to send
+ */
+uint8_t piggyback_measurements(void)
+{
+    uint8_t due = 0;
+
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+        if (channel_is_expired(id, timestamp.tv_sec + rtc_settings.pir_piggyback_sec))
+            due |= 1 << id;
+
+    if (!due)
+        return 0;
 
-    if (*rtc_measurement_valid == 1) // If RTC measurement is valid
+    trace_phase_begin(TRACE_PHASE_SETUP);
+    i2c_setup();
+    trace_phase_end(TRACE_PHASE_SETUP);
+
+    trace_phase_begin(TRACE_PHASE_SENSOR_READ);
+
+    ESP_ERROR_CHECK(sensors_acquire()); // Burst of readings of every sensor, filtered
+
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
     {
-        delta = abs(value - rtc_value);
+        int32_t value;
 
-        if (delta > update_threshold || (timestamp.tv_sec - rtc_timestamp->tv_sec) >= SENSOR_UPDATE_INTERVAL_MAX) // If delta is bigger than thresold or last value is expired
+        if (!(due & (1 << id)) || channels[id].read(channels[id].sensor, &value) != ESP_OK)
         {
-            if (type == int_t)
-                *((int16_t *)rtc_measurement) = *((int16_t *)measurement); // Save measurement as integer
-            else if (type == float_t)
-                *((float *)rtc_measurement) = *((float *)measurement); // Save measurement as float
-
-            *rtc_measurement_valid = 1;
-            *rtc_timestamp = timestamp;
-            return 1;
+            due &= ~(1 << id);
+            continue;
         }
-        return 0;
+
+        channel_force(id, value, timestamp.tv_sec);
+#if SLEEP_ADAPTIVE
+        schedule_update(id, value, timestamp.tv_sec);
+#endif
     }
-    else // If RTC measurement is not valid
-    {
-        if (type == int_t)
-            *((int16_t *)rtc_measurement) = *((int16_t *)measurement); // Save measurement as integer
-        else if (type == float_t)
-            *((float *)rtc_measurement) = *((float *)measurement); // Save measurement as float
 
-        *rtc_measurement_valid = 1;
+    trace_phase_end(TRACE_PHASE_SENSOR_READ);
+
+    return due;
+}
 
+/**
+ * @brief    Checks, before reading the sensors, if this wakeup is going
+ *           to need Wi-Fi regardless of the new measurements
+ * 
+ * @return   uint8_t: 1 report expected, 0 otherwise
+ */
+uint8_t report_expected(void)
+{
+    if (pir_is_due(timestamp.tv_sec))
         return 1;
-    }
+
+    if (backlog_is_offline(timestamp.tv_sec))
+        return 0; // Readings go to the backlog
+
+#if BATCH_ENABLE
+    return batch_is_due(timestamp.tv_sec);
+#else
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+        if (channel_is_expired(id, timestamp.tv_sec))
+            return 1;
+    return 0;
+#endif
+}
+
+/**
+ * @brief    Time left before a full boot is needed whatever the light
+ *           level: a channel expiring, the batch or the motion hold-off
+ * 
+ * @return   uint32_t time left [sec]
+ */
+uint32_t full_boot_in(void)
+{
+    time_t left = channels_expire_in(timestamp.tv_sec);
+
+#if BATCH_ENABLE
+    if (batch_count() && batch_due_in(timestamp.tv_sec) < left)
+        left = batch_due_in(timestamp.tv_sec);
+#endif
+
+    return pir_sleep_time(timestamp.tv_sec, left > 0 ? left : 0);
 }
 
 /**
@@ -261,8 +400,21 @@ uint8_t handle_measurement(measurement_type type, void *measurement, uint8_t *rt
  */
 void start_deep_sleep(void)
 {
-    esp_sleep_enable_timer_wakeup(SLEEP_INTERVAL_SEC * 1000000);  // Enable wakeup after time interval
-    esp_sleep_enable_ext0_wakeup((gpio_num_t)PIR_GPIO, !rtc_pir); // Enable wakeup after PIR interrupt
+    settings_apply(); // Settings received in this session
+
+    gettimeofday(&timestamp, NULL); // Awake time counts toward the planned interval
+
+#if SLEEP_ADAPTIVE
+    uint64_t sleep_time = schedule_sleep_time(timestamp.tv_sec); // Time left to the planned measurement
+#else
+    uint64_t sleep_time = rtc_settings.sleep_interval_sec;
+#endif
+    sleep_time = pir_sleep_time(timestamp.tv_sec, sleep_time); // Wake up when the motion hold-off expires
+
+    wake_stub_arm(sleep_time, full_boot_in()); // Next wakes may only check the light level
+
+    esp_sleep_enable_timer_wakeup(sleep_time * 1000000);                // Enable wakeup after time interval
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)PIR_GPIO, !rtc_pir.level); // Enable wakeup after PIR edge
 
     fflush(stdout); // Empty the stdout stream
 
@@ -8,37 +8,139 @@
  */
 
 // Include libraries
+#include <string.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "mqtt_client.h"
+#include "nvs_flash.h"
 
 #include "configuration.h"
 
 #include "mqtt.h"
 #include "wifi.h"
+#include "channels.h"
+#include "settings.h"
+#include "trace.h"
+#include "wake.h"
+
+// Topics and discovery payloads, built at compile time
+#define LIGHT_TOPIC(n) MQTT_NODE_NAME "/" MQTT_LIGHT_TOPIC n // Light sensor n, none for the first one
+#define TEMPERATURE_TOPIC MQTT_NODE_NAME "/" MQTT_TEMPERATURE_TOPIC
+#define HUMIDITY_TOPIC MQTT_NODE_NAME "/" MQTT_HUMIDITY_TOPIC
+#define PIR_TOPIC MQTT_NODE_NAME "/" MQTT_PIR_TOPIC
+#define STATE_TOPIC MQTT_NODE_NAME "/" MQTT_STATE_TOPIC
+#define SETTINGS_TOPIC MQTT_NODE_NAME "/" MQTT_SETTINGS_TOPIC
+
+#define CONFIGURATION_TOPIC(discovery_topic, topic) discovery_topic "/" MQTT_NODE_NAME " " topic "/config"
+
+// Measurements are sent with their age, {"value":21.50,"age":0} on their
+// own topics, "temperature":21.50,"temperature_age":0 in the state message
+#if MQTT_COMBINED_PAYLOAD
+#define STATE_FIELDS(topic, key) "\"state_topic\": \"" STATE_TOPIC "\", \"value_template\": \"{{ value_json." key " }}\""
+#define MEASUREMENT_FIELDS(topic, key) STATE_FIELDS(topic, key)
+#define PIR_PAYLOADS ", \"payload_on\": \"on\", \"payload_off\": \"off\""
+#else
+#define STATE_FIELDS(topic, key) "\"state_topic\": \"" topic "\""
+#define MEASUREMENT_FIELDS(topic, key) STATE_FIELDS(topic, key) ", \"value_template\": \"{{ value_json.value }}\""
+#define PIR_PAYLOADS ""
+#endif
+
+#if TEMPERATURE_USE_FAHRENHEIT
+#define TEMPERATURE_UNIT "°F"
+#else
+#define TEMPERATURE_UNIT "°C"
+#endif
+
+// Imported variables
+extern RTC_DATA_ATTR wake_pir_t rtc_pir;
+
+// RTC variables
+RTC_DATA_ATTR uint8_t rtc_discovery_requested; // Publish discovery config in the next session
 
 // Global variables
 esp_mqtt_client_handle_t client;
 EventGroupHandle_t mqtt_event_group;
 uint8_t mqtt_already_setup = 0;
 
-char light_topic[MQTT_TOPIC_MAX_LEN];
-char temperature_topic[MQTT_TOPIC_MAX_LEN];
-char humidity_topic[MQTT_TOPIC_MAX_LEN];
-char pir_topic[MQTT_TOPIC_MAX_LEN];
+// In-flight publish window
+typedef struct
+{
+    int msg_id;       // Message id returned by the client
+    esp_err_t status; // ESP_OK when acknowledged
+} mqtt_message_t;
+
+mqtt_message_t mqtt_window[MQTT_WINDOW_SIZE];
+uint8_t mqtt_window_count = 0;
+uint8_t mqtt_window_acked = 0;
+uint8_t mqtt_window_closed = 0;
+int mqtt_early_acks[MQTT_WINDOW_SIZE]; // Acks received before their msg_id was stored
+uint8_t mqtt_early_acks_count = 0;
+portMUX_TYPE mqtt_window_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const light_topics[LIGHT_SENSORS] = {
+    LIGHT_TOPIC(""),
+#if LIGHT_SENSORS > 1
+    LIGHT_TOPIC("2"),
+#endif
+#if LIGHT_SENSORS > 2
+    LIGHT_TOPIC("3"),
+#endif
+#if LIGHT_SENSORS > 3
+    LIGHT_TOPIC("4"),
+#endif
+};
+static const char temperature_topic[] = TEMPERATURE_TOPIC;
+static const char humidity_topic[] = HUMIDITY_TOPIC;
+static const char pir_topic[] = PIR_TOPIC;
+static const char state_topic[] = STATE_TOPIC;
+
+#if MQTT_ENABLE_DISCOVERY
 
-char light_configuration_topic[MQTT_TOPIC_MAX_LEN];
-char temperature_configuration_topic[MQTT_TOPIC_MAX_LEN];
-char humidity_configuration_topic[MQTT_TOPIC_MAX_LEN];
-char pir_configuration_topic[MQTT_TOPIC_MAX_LEN];
+static const char temperature_configuration_topic[] = CONFIGURATION_TOPIC(MQTT_SENSOR_DISCOVERY_TOPIC, MQTT_TEMPERATURE_TOPIC);
+static const char humidity_configuration_topic[] = CONFIGURATION_TOPIC(MQTT_SENSOR_DISCOVERY_TOPIC, MQTT_HUMIDITY_TOPIC);
+static const char pir_configuration_topic[] = CONFIGURATION_TOPIC(MQTT_BINARY_SENSOR_DISCOVERY_TOPIC, MQTT_PIR_TOPIC);
 
-char light_configuration_payload[MQTT_CONFIGURATION_PAYLOAD_MAX_LEN];
-char temperature_configuration_payload[MQTT_CONFIGURATION_PAYLOAD_MAX_LEN];
-char humidity_configuration_payload[MQTT_CONFIGURATION_PAYLOAD_MAX_LEN];
-char pir_configuration_payload[MQTT_CONFIGURATION_PAYLOAD_MAX_LEN];
+#define LIGHT_CONFIGURATION_TOPIC(n) CONFIGURATION_TOPIC(MQTT_SENSOR_DISCOVERY_TOPIC, MQTT_LIGHT_TOPIC n)
+#define LIGHT_CONFIGURATION_PAYLOAD(n) "{\"device_class\":\"illuminance\", \"name\": \"" MQTT_NODE_NAME "-light" n "\", " MEASUREMENT_FIELDS(LIGHT_TOPIC(n), "light" n) ", \"unit_of_measurement\": \"lx\"}"
+static const char temperature_configuration_payload[] = "{\"device_class\": \"temperature\", \"name\": \"" MQTT_NODE_NAME "-temperature\", " MEASUREMENT_FIELDS(TEMPERATURE_TOPIC, "temperature") ", \"unit_of_measurement\": \"" TEMPERATURE_UNIT "\"}";
+static const char humidity_configuration_payload[] = "{\"device_class\": \"humidity\", \"name\": \"" MQTT_NODE_NAME "-humidity\", " MEASUREMENT_FIELDS(HUMIDITY_TOPIC, "humidity") ", \"unit_of_measurement\": \"%\"}";
+static const char pir_configuration_payload[] = "{\"device_class\": \"motion\", \"name\": \"" MQTT_NODE_NAME "-motion\", " STATE_FIELDS(PIR_TOPIC, "motion") PIR_PAYLOADS "}";
+
+static const char *const discovery_messages[][2] = {
+    {LIGHT_CONFIGURATION_TOPIC(""), LIGHT_CONFIGURATION_PAYLOAD("")},
+#if LIGHT_SENSORS > 1
+    {LIGHT_CONFIGURATION_TOPIC("2"), LIGHT_CONFIGURATION_PAYLOAD("2")},
+#endif
+#if LIGHT_SENSORS > 2
+    {LIGHT_CONFIGURATION_TOPIC("3"), LIGHT_CONFIGURATION_PAYLOAD("3")},
+#endif
+#if LIGHT_SENSORS > 3
+    {LIGHT_CONFIGURATION_TOPIC("4"), LIGHT_CONFIGURATION_PAYLOAD("4")},
+#endif
+    {temperature_configuration_topic, temperature_configuration_payload},
+    {humidity_configuration_topic, humidity_configuration_payload},
+    {pir_configuration_topic, pir_configuration_payload},
+};
+
+#define DISCOVERY_MESSAGES (sizeof(discovery_messages) / sizeof(discovery_messages[0]))
+#define DISCOVERY_HASH_KEY "discovery"
+
+#endif
 
 // Private function declarations
 static void event_handler(void *args, esp_event_base_t event, int32_t event_id, void *event_data);
+static esp_err_t mqtt_publish_message(const char *topic, const char *payload, int retain);
+static uint8_t mqtt_window_ack(int msg_id);
+#if MQTT_ENABLE_DISCOVERY
+static uint32_t discovery_hash(void);
+static uint32_t discovery_hash_load(void);
+static esp_err_t discovery_publish(void);
+#endif
+static esp_err_t send_measurement(const char *topic, int32_t value, uint8_t decimals, time_t timestamp);
+static int32_t measurement_age(time_t timestamp);
+static size_t format_fixed(char *buffer, int32_t value, uint8_t decimals);
+static size_t append(char *buffer, size_t len, const char *string);
 
 // Functions
 
@@ -52,30 +154,9 @@ esp_err_t mqtt_setup(void)
     if (mqtt_already_setup)
         return ESP_OK;
 
-    mqtt_event_group = xEventGroupCreate(); // create MQTT event group
-
-    snprintf(light_topic, MQTT_TOPIC_MAX_LEN, "%s/%s", MQTT_NODE_NAME, MQTT_LIGHT_TOPIC); // Create MQTT topic strings
-    snprintf(temperature_topic, MQTT_TOPIC_MAX_LEN, "%s/%s", MQTT_NODE_NAME, MQTT_TEMPERATURE_TOPIC);
-    snprintf(humidity_topic, MQTT_TOPIC_MAX_LEN, "%s/%s", MQTT_NODE_NAME, MQTT_HUMIDITY_TOPIC);
-    snprintf(pir_topic, MQTT_TOPIC_MAX_LEN, "%s/%s", MQTT_NODE_NAME, MQTT_PIR_TOPIC);
-
-#if MQTT_ENABLE_DISCOVERY
-
-    snprintf(light_configuration_topic, MQTT_TOPIC_MAX_LEN, "%s/%s %s/config", MQTT_SENSOR_DISCOVERY_TOPIC, MQTT_NODE_NAME, MQTT_LIGHT_TOPIC);
-    snprintf(temperature_configuration_topic, MQTT_TOPIC_MAX_LEN, "%s/%s %s/config", MQTT_SENSOR_DISCOVERY_TOPIC, MQTT_NODE_NAME, MQTT_TEMPERATURE_TOPIC);
-    snprintf(humidity_configuration_topic, MQTT_TOPIC_MAX_LEN, "%s/%s %s/config", MQTT_SENSOR_DISCOVERY_TOPIC, MQTT_NODE_NAME, MQTT_HUMIDITY_TOPIC);
-    snprintf(pir_configuration_topic, MQTT_TOPIC_MAX_LEN, "%s/%s %s/config", MQTT_BINARY_SENSOR_DISCOVERY_TOPIC, MQTT_NODE_NAME, MQTT_PIR_TOPIC);
+    trace_phase_begin(TRACE_PHASE_MQTT_SETUP);
 
-    snprintf(light_configuration_payload, MQTT_CONFIGURATION_PAYLOAD_MAX_LEN, "{\"device_class\":\"illuminance\", \"name\": \"%s-light\", \"state_topic\": \"%s\", \"unit_of_measurement\": \"lx\"}", MQTT_NODE_NAME, light_topic);
-#if TEMPERATURE_USE_FAHRENHEIT
-    snprintf(temperature_configuration_payload, MQTT_CONFIGURATION_PAYLOAD_MAX_LEN, "{\"device_class\": \"temperature\", \"name\": \"%s-temperature\", \"state_topic\": \"%s\", \"unit_of_measurement\": \"°F\"}", MQTT_NODE_NAME, temperature_topic);
-#else
-    snprintf(temperature_configuration_payload, MQTT_CONFIGURATION_PAYLOAD_MAX_LEN, "{\"device_class\": \"temperature\", \"name\": \"%s-temperature\", \"state_topic\": \"%s\", \"unit_of_measurement\": \"°C\"}", MQTT_NODE_NAME, temperature_topic);
-#endif
-    snprintf(humidity_configuration_payload, MQTT_CONFIGURATION_PAYLOAD_MAX_LEN, "{\"device_class\": \"humidity\", \"name\": \"%s-humidity\", \"state_topic\": \"%s\", \"unit_of_measurement\": \"%%\"}", MQTT_NODE_NAME, humidity_topic);
-    snprintf(pir_configuration_payload, MQTT_CONFIGURATION_PAYLOAD_MAX_LEN, "{\"device_class\": \"motion\", \"name\": \"%s-motion\", \"state_topic\": \"%s\"}", MQTT_NODE_NAME, pir_topic);
-
-#endif
+    mqtt_event_group = xEventGroupCreate(); // create MQTT event group
 
     esp_mqtt_client_config_t mqtt_cfg = {
         .uri = MQTT_BROKER,
@@ -91,7 +172,16 @@ esp_err_t mqtt_setup(void)
                                                    client)); // Register MQTT event handler
     mqtt_already_setup = 1;
 
-    return esp_mqtt_client_start(client); // Start MQTT client
+    esp_err_t ret = esp_mqtt_client_start(client); // Start MQTT client
+
+    trace_phase_end(TRACE_PHASE_MQTT_SETUP);
+
+#if MQTT_ENABLE_DISCOVERY
+    if (ret == ESP_OK && rtc_discovery_requested)
+        discovery_publish(); // Kept requested on failure, retried in the next session
+#endif
+
+    return ret;
 }
 
 /**
@@ -105,14 +195,20 @@ esp_err_t mqtt_setup(void)
 static void event_handler(void *args, esp_event_base_t event, int32_t event_id, void *event_data)
 {
     BaseType_t ret, higher_priority_task_woken = pdFALSE;
+    esp_mqtt_event_handle_t mqtt_event = event_data;
 
     if (event_id == MQTT_EVENT_PUBLISHED || event_id == MQTT_EVENT_ERROR)
     {
         if (event_id == MQTT_EVENT_PUBLISHED)
+        {
+            trace_mark(TRACE_PHASE_MQTT_ACK);
+            if (!mqtt_window_ack(mqtt_event->msg_id)) // Mark message as acknowledged
+                return;                               // Other messages still in flight
+
             ret = xEventGroupSetBitsFromISR(mqtt_event_group,
                                             MQTT_PUBLISHED_BIT,
-                                            &higher_priority_task_woken); // Set event bits to signal MQTT published event
-
+                                            &higher_priority_task_woken); // Set event bits to signal all messages published
+        }
         else
             ret = xEventGroupSetBitsFromISR(mqtt_event_group,
                                             MQTT_ERROR_BIT,
@@ -121,129 +217,339 @@ static void event_handler(void *args, esp_event_base_t event, int32_t event_id,
         if (ret == pdPASS)
             portYIELD_FROM_ISR(); // Request context switch
     }
+    else if (event_id == MQTT_EVENT_CONNECTED)
+    {
+#if MQTT_ENABLE_DISCOVERY
+        esp_mqtt_client_subscribe(client, MQTT_STATUS_TOPIC, 0); // Listen for Home Assistant restarts
+#endif
+#if SETTINGS_REMOTE
+        esp_mqtt_client_subscribe(client, SETTINGS_TOPIC, 0); // Retained, received in every session
+#endif
+    }
+    else if (event_id == MQTT_EVENT_DATA)
+    {
+#if MQTT_ENABLE_DISCOVERY
+        if (mqtt_event->topic_len == sizeof(MQTT_STATUS_TOPIC) - 1 &&
+            !strncmp(mqtt_event->topic, MQTT_STATUS_TOPIC, mqtt_event->topic_len) &&
+            mqtt_event->data_len == sizeof(MQTT_STATUS_ONLINE) - 1 &&
+            !strncmp(mqtt_event->data, MQTT_STATUS_ONLINE, mqtt_event->data_len))
+            rtc_discovery_requested = 1; // Home Assistant restarted, send discovery again
+#endif
+#if SETTINGS_REMOTE
+        if (mqtt_event->topic_len == sizeof(SETTINGS_TOPIC) - 1 &&
+            !strncmp(mqtt_event->topic, SETTINGS_TOPIC, mqtt_event->topic_len) &&
+            mqtt_event->data_len == mqtt_event->total_data_len) // Not split over several events
+            settings_receive(mqtt_event->data, mqtt_event->data_len);
+#endif
+    }
+}
+
+/**
+ * @brief    Mark a message of the in-flight window as acknowledged
+ * 
+ * @param    msg_id: Acknowledged message id
+ * @return   uint8_t: 1 if the window is closed and every message in it
+ *           is acknowledged, 0 otherwise
+ */
+static uint8_t mqtt_window_ack(int msg_id)
+{
+    uint8_t i, done;
+
+    portENTER_CRITICAL(&mqtt_window_mux);
+    for (i = 0; i < mqtt_window_count; i++)
+    {
+        if (mqtt_window[i].msg_id == msg_id && mqtt_window[i].status != ESP_OK)
+        {
+            mqtt_window[i].status = ESP_OK;
+            mqtt_window_acked++;
+            break;
+        }
+    }
+    if (i == mqtt_window_count && mqtt_early_acks_count < MQTT_WINDOW_SIZE)
+        mqtt_early_acks[mqtt_early_acks_count++] = msg_id; // Publish call has not returned yet
+    done = mqtt_window_closed && mqtt_window_count && mqtt_window_acked == mqtt_window_count; // More messages can be queued until the wait
+    portEXIT_CRITICAL(&mqtt_window_mux);
+
+    return done;
+}
+
+/**
+ * @brief    Queue a message in the in-flight window without waiting for its ack
+ * 
+ * @param    topic: Topic
+ * @param    payload: Payload
+ * @return   esp_err_t status
+ */
+esp_err_t mqtt_publish(const char *topic, const char *payload)
+{
+    return mqtt_publish_message(topic, payload, 0);
 }
 
 /**
- * @brief    Wait for MQTT event
+ * @brief    Queue a message in the in-flight window without waiting for its ack
  * 
+ * @param    topic: Topic
+ * @param    payload: Payload
+ * @param    retain: 1 if the broker keeps the message for new subscribers
  * @return   esp_err_t status
  */
+static esp_err_t mqtt_publish_message(const char *topic, const char *payload, int retain)
+{
+    if (mqtt_window_closed) // Start a new window after the last wait
+    {
+        portENTER_CRITICAL(&mqtt_window_mux);
+        mqtt_window_count = 0;
+        mqtt_window_acked = 0;
+        mqtt_early_acks_count = 0;
+        mqtt_window_closed = 0;
+        portEXIT_CRITICAL(&mqtt_window_mux);
+        xEventGroupClearBits(mqtt_event_group, MQTT_PUBLISHED_BIT | MQTT_ERROR_BIT);
+    }
+
+    if (mqtt_window_count >= MQTT_WINDOW_SIZE)
+        return ESP_ERR_NO_MEM;
+
+    int msg_id = esp_mqtt_client_publish(client, topic, payload, 0, 1, retain);
+    if (msg_id == -1)
+        return ESP_FAIL;
+    trace_mark(TRACE_PHASE_MQTT_SEND);
+
+    portENTER_CRITICAL(&mqtt_window_mux);
+    mqtt_message_t *message = &mqtt_window[mqtt_window_count++];
+    message->msg_id = msg_id;
+    message->status = ESP_ERR_TIMEOUT;
+    for (uint8_t i = 0; i < mqtt_early_acks_count; i++)
+    {
+        if (mqtt_early_acks[i] == msg_id) // Ack already received
+        {
+            message->status = ESP_OK;
+            mqtt_window_acked++;
+            mqtt_early_acks[i] = mqtt_early_acks[--mqtt_early_acks_count];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&mqtt_window_mux);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief    Wait once for the acks of every message queued since the last wait
+ * 
+ * @return   esp_err_t status: ESP_OK if every message was acknowledged
+ */
 esp_err_t mqtt_event_wait(void)
 {
+    portENTER_CRITICAL(&mqtt_window_mux);
+    mqtt_window_closed = 1; // From here the last ack sets MQTT_PUBLISHED_BIT
+    uint8_t done = mqtt_window_acked == mqtt_window_count;
+    portEXIT_CRITICAL(&mqtt_window_mux);
+
+    if (done) // Nothing in flight
+        return ESP_OK;
+
     EventBits_t bits = xEventGroupWaitBits(mqtt_event_group,
                                            MQTT_PUBLISHED_BIT | MQTT_ERROR_BIT,
                                            pdTRUE,
                                            pdFALSE,
                                            MQTT_SEND_TIMEOUT_MS); // Wait for MQTT event bits
 
-    // Received a MQTT ack
+    // Received every MQTT ack
     if (bits & MQTT_PUBLISHED_BIT)
         return ESP_OK;
 
-    // Error during publishing MQTT message
-    else if (bits & MQTT_ERROR_BIT)
+    // Error during publishing MQTT messages
+    if (bits & MQTT_ERROR_BIT)
     {
-        printf("Failed to send message\n");
+        portENTER_CRITICAL(&mqtt_window_mux);
+        for (uint8_t i = 0; i < mqtt_window_count; i++)
+            if (mqtt_window[i].status != ESP_OK)
+                mqtt_window[i].status = ESP_FAIL;
+        portEXIT_CRITICAL(&mqtt_window_mux);
+
+        printf("Failed to send messages\n");
         return ESP_FAIL;
     }
 
-    // Timeout for publishing MQTT message
+    // Timeout for publishing MQTT messages
     else
     {
-        printf("Timeout sending message\n");
+        printf("Timeout sending messages\n");
         return ESP_ERR_TIMEOUT;
     }
 }
 
 /**
- * @brief    Send Home Assistant autodiscovery config
+ * @brief    Status of a message of the last waited window
+ * 
+ * @param    index: Message position in publish order
+ * @return   esp_err_t status: ESP_OK if acknowledged
+ */
+esp_err_t mqtt_message_status(uint8_t index)
+{
+    if (index >= mqtt_window_count)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&mqtt_window_mux);
+    esp_err_t status = mqtt_window[index].status;
+    portEXIT_CRITICAL(&mqtt_window_mux);
+
+    return status;
+}
+
+/**
+ * @brief    Send Home Assistant autodiscovery config after a reset.
+ *           The config is retained by the broker, so it is sent only if it
+ *           changed since the last time it was published, or if Home Assistant
+ *           sent its birth message during an earlier session.
  * 
- * @return   esp_err_t 
+ * @return   esp_err_t status
  */
 esp_err_t mqtt_send_autodiscovery(void)
 {
+#if MQTT_ENABLE_DISCOVERY
+    if (discovery_hash_load() != discovery_hash())
+        rtc_discovery_requested = 1;
+    if (!rtc_discovery_requested)
+        return ESP_OK; // Retained config on the broker is current
+
     ESP_ERROR_CHECK(wifi_setup());     // Turn on Wi-Fi
     esp_err_t ret = wifi_event_wait(); // Wait for Wi-Fi connection
 
     if (ret == ESP_OK)
     {
-        ESP_ERROR_CHECK(mqtt_setup()); // Setup MQTT
+        ESP_ERROR_CHECK(mqtt_setup()); // Setup MQTT, sends the requested config
 
-        if (esp_mqtt_client_publish(client, light_configuration_topic, light_configuration_payload, 0, 1, 0) != -1)
-            ret = ESP_FAIL;
-        if (mqtt_event_wait() != ESP_OK) // Wait for MQTT ack
+        if (rtc_discovery_requested)
             ret = ESP_FAIL;
+    }
+    return ret;
+#else
+    return ESP_OK;
+#endif
+}
 
-        if (esp_mqtt_client_publish(client, temperature_configuration_topic, temperature_configuration_payload, 0, 1, 0) != -1)
-            ret = ESP_FAIL;
-        if (mqtt_event_wait() != ESP_OK) // Wait for MQTT ack
-            ret = ESP_FAIL;
+#if MQTT_ENABLE_DISCOVERY
 
-        if (esp_mqtt_client_publish(client, humidity_configuration_topic, humidity_configuration_payload, 0, 1, 0) != -1)
-            ret = ESP_FAIL;
-        if (mqtt_event_wait() != ESP_OK) // Wait for MQTT ack
-            ret = ESP_FAIL;
+/**
+ * @brief    FNV-1a hash of every discovery topic and payload
+ * 
+ * @return   uint32_t hash
+ */
+static uint32_t discovery_hash(void)
+{
+    uint32_t hash = 2166136261u;
 
-        if (esp_mqtt_client_publish(client, pir_configuration_topic, pir_configuration_payload, 0, 1, 0) != -1)
-            ret = ESP_FAIL;
-        if (mqtt_event_wait() != ESP_OK) // Wait for MQTT ack
+    for (uint8_t i = 0; i < DISCOVERY_MESSAGES; i++)
+    {
+        for (uint8_t j = 0; j < 2; j++)
+        {
+            for (const char *c = discovery_messages[i][j]; *c; c++)
+                hash = (hash ^ (uint8_t)*c) * 16777619u;
+            hash *= 16777619u; // Zero separator, so text can't shift between topic and payload
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief    Hash of the last published discovery config, stored in NVS
+ * 
+ * @return   uint32_t hash, 0 if never published
+ */
+static uint32_t discovery_hash_load(void)
+{
+    nvs_handle handle;
+    uint32_t hash = 0;
+
+    if (nvs_flash_init() != ESP_OK) // Also done by the Wi-Fi setup, repeating it is harmless
+        return 0;
+
+    if (nvs_open(MQTT_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        nvs_get_u32(handle, DISCOVERY_HASH_KEY, &hash);
+        nvs_close(handle);
+    }
+    return hash;
+}
+
+/**
+ * @brief    Publish the discovery config as retained messages,
+ *           MQTT must be already setup. The config hash is stored in NVS
+ *           once every message is acknowledged.
+ * 
+ * @return   esp_err_t status
+ */
+static esp_err_t discovery_publish(void)
+{
+    esp_err_t ret = ESP_OK;
+    nvs_handle handle;
+
+    trace_phase_begin(TRACE_PHASE_MQTT_PUBLISH);
+
+    for (uint8_t i = 0; i < DISCOVERY_MESSAGES; i++)
+        if (mqtt_publish_message(discovery_messages[i][0], discovery_messages[i][1], 1) != ESP_OK)
             ret = ESP_FAIL;
+    if (mqtt_event_wait() != ESP_OK) // Wait for all MQTT acks
+        ret = ESP_FAIL;
 
+    trace_phase_end(TRACE_PHASE_MQTT_PUBLISH);
+
+    if (ret != ESP_OK)
         return ret;
+
+    rtc_discovery_requested = 0;
+
+    ret = nvs_open(MQTT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_u32(handle, DISCOVERY_HASH_KEY, discovery_hash());
+        if (ret == ESP_OK)
+            ret = nvs_commit(handle);
+        nvs_close(handle);
     }
-    else
-        return ret;
+    return ret;
 }
 
+#endif
+
 /**
  * @brief    Send light measurement
  * 
- * @param    light: Light value
+ * @param    sensor: Light sensor index in devices.c
+ * @param    light: Light value [lx]
+ * @param    timestamp: Measurement timestamp [sec]
  * @return   esp_err_t status
  */
-esp_err_t mqtt_send_light(uint16_t light)
+esp_err_t mqtt_send_light(uint8_t sensor, int32_t light, time_t timestamp)
 {
-    char temp[MQTT_MEASUREMENT_MAX_LEN];
-    snprintf(temp, MQTT_MEASUREMENT_MAX_LEN, "%hu", light);
-
-    if (esp_mqtt_client_publish(client, light_topic, temp, 0, 1, 0) != -1)
-        return ESP_OK;
-    else
-        return ESP_FAIL;
+    return send_measurement(light_topics[sensor], light, 0, timestamp);
 }
 
 /**
  * @brief    Send temperature measurement
  * 
- * @param    temperature: Temperature value
+ * @param    sensor: Unused, a single temperature sensor
+ * @param    temperature: Temperature value [°C/°F / 100]
+ * @param    timestamp: Measurement timestamp [sec]
  * @return   esp_err_t status
  */
-esp_err_t mqtt_send_temperature(float temperature)
+esp_err_t mqtt_send_temperature(uint8_t sensor, int32_t temperature, time_t timestamp)
 {
-    char temp[MQTT_MEASUREMENT_MAX_LEN];
-    snprintf(temp, MQTT_MEASUREMENT_MAX_LEN, "%.2f", temperature);
-
-    if (esp_mqtt_client_publish(client, temperature_topic, temp, 0, 1, 0) != -1)
-        return ESP_OK;
-    else
-        return ESP_FAIL;
+    return send_measurement(temperature_topic, temperature, 2, timestamp);
 }
 
 /**
  * @brief    Send humidity measurement
  * 
- * @param    humidity: Humidity value
+ * @param    sensor: Unused, a single humidity sensor
+ * @param    humidity: Humidity value [% / 100]
+ * @param    timestamp: Measurement timestamp [sec]
  * @return   esp_err_t status
  */
-esp_err_t mqtt_send_humidity(float humidity)
+esp_err_t mqtt_send_humidity(uint8_t sensor, int32_t humidity, time_t timestamp)
 {
-    char temp[MQTT_MEASUREMENT_MAX_LEN];
-    snprintf(temp, MQTT_MEASUREMENT_MAX_LEN, "%.2f", humidity);
-
-    if (esp_mqtt_client_publish(client, humidity_topic, temp, 0, 1, 0) != -1)
-        return ESP_OK;
-    else
-        return ESP_FAIL;
+    return send_measurement(humidity_topic, humidity, 2, timestamp);
 }
 
 /**
@@ -254,14 +560,160 @@ esp_err_t mqtt_send_humidity(float humidity)
  */
 esp_err_t mqtt_send_pir(uint8_t pir)
 {
-    char temp[MQTT_MEASUREMENT_MAX_LEN];
-    if (pir)
-        snprintf(temp, MQTT_MEASUREMENT_MAX_LEN, "on");
-    else
-        snprintf(temp, MQTT_MEASUREMENT_MAX_LEN, "off");
+    return mqtt_publish(pir_topic, pir ? "on" : "off");
+}
 
-    if (esp_mqtt_client_publish(client, pir_topic, temp, 0, 1, 0) != -1)
-        return ESP_OK;
-    else
-        return ESP_FAIL;
-}
\ No newline at end of file
+/**
+ * @brief    Send every valid measurement in a single JSON message
+ *           on the combined state topic, each with its age
+ * 
+ * @return   esp_err_t status, ESP_ERR_INVALID_SIZE if a value or the
+ *           message doesn't fit, nothing is sent
+ */
+esp_err_t mqtt_send_state(void)
+{
+    char temp[MQTT_STATE_MAX_LEN];
+    char value[MQTT_MEASUREMENT_MAX_LEN], age[MQTT_MEASUREMENT_MAX_LEN];
+    size_t len = 0;
+
+    len = append(temp, len, rtc_pir.motion ? "{\"motion\":\"on\"" : "{\"motion\":\"off\"");
+    for (uint8_t id = 0; id < CHANNEL_MAX; id++)
+    {
+        if (!rtc_channels[id].valid)
+            continue;
+
+        if (!format_fixed(value, rtc_channels[id].value, channels[id].decimals) ||
+            !format_fixed(age, measurement_age(rtc_channels[id].timestamp), 0))
+            return ESP_ERR_INVALID_SIZE;
+        len = append(temp, len, ",\"");
+        len = append(temp, len, channels[id].key);
+        len = append(temp, len, "\":");
+        len = append(temp, len, value);
+        len = append(temp, len, ",\"");
+        len = append(temp, len, channels[id].key);
+        len = append(temp, len, "_age\":");
+        len = append(temp, len, age);
+    }
+    len = append(temp, len, "}");
+    if (len >= MQTT_STATE_MAX_LEN)
+        return ESP_ERR_INVALID_SIZE;
+
+    return mqtt_publish(state_topic, temp);
+}
+
+/**
+ * @brief    Send a measurement with its age on its own topic, so a
+ *           reading sent late (batch, backlog, swinging door) can be
+ *           placed at its time: receive time - age. The node clock
+ *           isn't synchronized, an age needs no common clock.
+ * 
+ * @param    topic: Topic
+ * @param    value: Value scaled by 10^decimals
+ * @param    decimals: Number of decimal digits
+ * @param    timestamp: Measurement timestamp [sec], CHANNEL_TIMESTAMP_UNKNOWN
+ *           to send a null age
+ * @return   esp_err_t status, ESP_ERR_INVALID_SIZE if the value doesn't fit
+ */
+static esp_err_t send_measurement(const char *topic, int32_t value, uint8_t decimals, time_t timestamp)
+{
+    char temp[MQTT_STATE_MAX_LEN];
+    char number[MQTT_MEASUREMENT_MAX_LEN], age[MQTT_MEASUREMENT_MAX_LEN];
+    size_t len = 0;
+
+    if (!format_fixed(number, value, decimals))
+        return ESP_ERR_INVALID_SIZE;
+    if (timestamp == CHANNEL_TIMESTAMP_UNKNOWN)
+        strcpy(age, "null"); // Stored before a reset
+    else if (!format_fixed(age, measurement_age(timestamp), 0))
+        return ESP_ERR_INVALID_SIZE;
+
+    len = append(temp, len, "{\"value\":");
+    len = append(temp, len, number);
+    len = append(temp, len, ",\"age\":");
+    len = append(temp, len, age);
+    append(temp, len, "}"); // Always fits
+
+    return mqtt_publish(topic, temp);
+}
+
+/**
+ * @brief    Age of a measurement
+ * 
+ * @param    timestamp: Measurement timestamp [sec]
+ * @return   int32_t age [sec], capped to always fit MQTT_MEASUREMENT_MAX_LEN
+ */
+static int32_t measurement_age(time_t timestamp)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    if (now.tv_sec <= timestamp)
+        return 0;
+    return now.tv_sec - timestamp < 999999999 ? now.tv_sec - timestamp : 999999999;
+}
+
+/**
+ * @brief    Format a fixed point value without the printf float support
+ * 
+ * @param    buffer: Output buffer, at least MQTT_MEASUREMENT_MAX_LEN bytes
+ * @param    value: Value scaled by 10^decimals
+ * @param    decimals: Number of decimal digits, at most 9
+ * @return   size_t formatted length, 0 if the value doesn't fit the
+ *           buffer, never truncated
+ */
+static size_t format_fixed(char *buffer, int32_t value, uint8_t decimals)
+{
+    char digits[11]; // uint32_t magnitude, or the decimals and a leading zero
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+    size_t count = 0, len = 0;
+
+    do
+    {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while ((magnitude || count <= decimals) && count < sizeof(digits));
+
+    if ((value < 0) + count + (decimals > 0) >= MQTT_MEASUREMENT_MAX_LEN)
+    {
+        buffer[0] = '\0';
+        return 0; // Dropping digits would publish a wrong value
+    }
+
+    if (value < 0)
+        buffer[len++] = '-';
+    while (count)
+    {
+        if (count == decimals)
+            buffer[len++] = '.';
+        buffer[len++] = digits[--count];
+    }
+    buffer[len] = '\0';
+
+    return len;
+}
+
+/**
+ * @brief    Append a string to the state message buffer, as much as
+ *           fits. As snprintf(), the returned length counts the whole
+ *           string, a length of MQTT_STATE_MAX_LEN or more means the
+ *           message was truncated.
+ * 
+ * @param    buffer: State message buffer, MQTT_STATE_MAX_LEN bytes
+ * @param    len: Current length
+ * @param    string: String to append
+ * @return   size_t new length
+ */
+static size_t append(char *buffer, size_t len, const char *string)
+{
+    size_t string_len = strlen(string);
+
+    if (len < MQTT_STATE_MAX_LEN - 1)
+    {
+        size_t copy_len = len + string_len < MQTT_STATE_MAX_LEN ? string_len : MQTT_STATE_MAX_LEN - 1 - len;
+
+        memcpy(buffer + len, string, copy_len);
+        buffer[len + copy_len] = '\0';
+    }
+
+    return len + string_len;
+}
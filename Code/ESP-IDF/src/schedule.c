@@ -0,0 +1,88 @@
+/**
+ * @file     schedule.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Adaptive measurement scheduling.
+ *           Every channel keeps an exponentially weighted average of its
+ *           rate of change in RTC memory. The next wakeup is planned when
+ *           the fastest channel is expected to cross its update threshold,
+ *           within the shortest and longest interval of the settings, and
+ *           never after a channel or the batch buffer needs to be sent.
+ */
+
+// Include libraries
+#include <esp_sleep.h>
+
+#include "configuration.h"
+
+#include "schedule.h"
+#include "settings.h"
+#include "batch.h"
+#include "wake.h"
+
+#if SLEEP_ADAPTIVE
+
+// RTC variables
+RTC_DATA_ATTR wake_rate_t rtc_schedule[CHANNEL_MAX];
+RTC_DATA_ATTR time_t rtc_schedule_next; // Next planned measurement [sec]
+
+// Functions
+
+/**
+ * @brief    Forget the rates of change, until they are measured again every
+ *           channel is assumed to cross its threshold at the shortest interval
+ *
+ * @param    timestamp: actual timestamp
+ */
+void schedule_reset(time_t timestamp)
+{
+    for (uint8_t id = 0; id < CHANNEL_MAX; id++)
+        wake_rate_reset(&rtc_schedule[id], rtc_settings.decision[id].threshold, rtc_settings.sleep_interval_min_sec);
+    rtc_schedule_next = timestamp + rtc_settings.sleep_interval_min_sec;
+}
+
+/**
+ * @brief    Update the rate of change of a channel with a new measurement
+ *
+ * @param    id: Channel
+ * @param    value: new measurement
+ * @param    timestamp: actual timestamp
+ */
+void schedule_update(channel_id_t id, int32_t value, time_t timestamp)
+{
+    wake_rate_update(&rtc_schedule[id], value, timestamp, SLEEP_RATE_EWMA_SHIFT);
+}
+
+/**
+ * @brief    Plan the next measurement after the channels have been updated
+ *
+ * @param    timestamp: actual timestamp
+ */
+void schedule_plan(time_t timestamp)
+{
+    time_t batch_left = rtc_settings.sleep_interval_max_sec; // Time before the batch must be sent
+
+#if BATCH_ENABLE
+    if (batch_count())
+        batch_left = batch_due_in(timestamp);
+#endif
+
+    rtc_schedule_next = timestamp + wake_plan(rtc_channels, rtc_settings.decision, rtc_schedule, CHANNEL_MAX, batch_left,
+                                              rtc_settings.sleep_interval_min_sec, rtc_settings.sleep_interval_max_sec, timestamp);
+}
+
+/**
+ * @brief    Time left before the next planned measurement,
+ *           wakeups in between (PIR) don't move it
+ *
+ * @param    timestamp: actual timestamp
+ * @return   uint32_t sleep time [sec]
+ */
+uint32_t schedule_sleep_time(time_t timestamp)
+{
+    return wake_sleep_time(rtc_schedule_next, rtc_settings.sleep_interval_max_sec, timestamp);
+}
+
+#endif
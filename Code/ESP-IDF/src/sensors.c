@@ -0,0 +1,217 @@
+/**
+ * @file     sensors.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Sensor acquisition scheduler.
+ *           Conversions of every sensor are started together, so the
+ *           acquisition lasts as long as the slowest conversion instead
+ *           of the sum of all of them.
+ *           A measurement can be a burst of readings taken back to back
+ *           on the awake bus, filtered into one value with filter.h, so
+ *           a single noisy reading doesn't trip the report threshold.
+ *           Every light sensor of devices.c is read in the same burst,
+ *           sensors on the second I2C controller in parallel.
+ */
+
+// Include libraries
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <rom/ets_sys.h>
+
+#include "configuration.h"
+
+#include "sensors.h"
+#include "bh1750.h"
+#include "si7021.h"
+#include "i2c.h"
+#include "filter.h"
+#include "settings.h"
+#include "trace.h"
+
+#define BURST_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define BURST_SIZE BURST_MAX(LIGHT_OVERSAMPLE, BURST_MAX(TEMPERATURE_OVERSAMPLE, HUMIDITY_OVERSAMPLE))
+
+_Static_assert(LIGHT_OVERSAMPLE >= 1 && TEMPERATURE_OVERSAMPLE >= 1 && HUMIDITY_OVERSAMPLE >= 1, "At least one reading per measurement");
+_Static_assert(BURST_SIZE <= 255, "Burst readings are counted in 8 bits");
+
+// Global variables
+uint32_t sensors_light_reading[LIGHT_SENSORS]; // Readings of the last conversion
+int32_t sensors_temperature_reading;
+int32_t sensors_humidity_reading;
+
+int32_t sensors_light[LIGHT_SENSORS]; // Filtered measurements
+int32_t sensors_temperature;
+int32_t sensors_humidity;
+
+// Private function declarations
+static int32_t sensors_filter(filter_t filter, int32_t *samples, uint8_t oversample, uint8_t count);
+static void sensors_delay_us(int64_t wait);
+
+// Functions
+
+/**
+ * @brief    Start the conversions of every sensor
+ * 
+ * @param    light: 1 to read the light sensors too
+ * @return   esp_err_t status
+ */
+esp_err_t sensors_start(uint8_t light)
+{
+    trace_phase_begin(TRACE_PHASE_SENSOR_START);
+    ESP_ERROR_CHECK(si7021_start_measurement_submit());
+    for (uint8_t sensor = 0; light && sensor < LIGHT_SENSORS; sensor++)
+        ESP_ERROR_CHECK(bh1750_start_submit(sensor, &sensors_light_reading[sensor])); // One-time conversion, or the last continuous one, while Si7021 is converting
+
+    esp_err_t ret = i2c_bus_run(); // Run all transactions back to back
+    trace_phase_end(TRACE_PHASE_SENSOR_START);
+
+    return ret;
+}
+
+/**
+ * @brief    Wait for the conversions still running and store the results
+ * 
+ * @param    light: 1 if the light sensors were started too
+ * @return   esp_err_t status
+ */
+esp_err_t sensors_read(uint8_t light)
+{
+    trace_phase_begin(TRACE_PHASE_SI7021_WAIT);
+    esp_err_t ret = si7021_read_result(&sensors_temperature_reading, &sensors_humidity_reading); // Polls until Si7021 conversion is done
+    for (uint8_t sensor = 0; ret == ESP_OK && light && sensor < LIGHT_SENSORS; sensor++)
+        ret = bh1750_read_result(sensor, &sensors_light_reading[sensor]); // Waits for what is left of the one-time conversion
+    if (ret == ESP_OK && light)
+        ret = i2c_bus_run(); // Read every light sensor
+    trace_phase_end(TRACE_PHASE_SI7021_WAIT);
+
+    return ret;
+}
+
+/**
+ * @brief    Take a burst of readings of every sensor and filter them
+ *           into one measurement per channel. Every channel keeps its
+ *           first *_OVERSAMPLE readings. A failed reading ends the burst,
+ *           the measurements use the readings taken before it.
+ * 
+ * @return   esp_err_t status, error only if no reading was taken
+ */
+esp_err_t sensors_acquire(void)
+{
+    int32_t light[LIGHT_SENSORS][BURST_SIZE], temperature[BURST_SIZE], humidity[BURST_SIZE];
+    int64_t last_start = 0, light_interval = OVERSAMPLE_INTERVAL_US;
+    esp_err_t ret = ESP_OK;
+    uint8_t count;
+
+    for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+    {
+        if (LIGHT_OVERSAMPLE > 1 && rtc_bh1750_range[sensor].mode != BH1750_MODE_ONE_TIME && light_interval < bh1750_conversion_time_us(sensor))
+            light_interval = bh1750_conversion_time_us(sensor); // Every light reading from a new continuous conversion of the slowest sensor
+        bh1750_wait_conversion(sensor);
+    }
+
+    for (count = 0; count < BURST_SIZE; count++)
+    {
+        uint8_t light_wanted = count < LIGHT_OVERSAMPLE; // Light readings only as many as the light channel keeps
+
+        int64_t wait = last_start + (light_wanted ? light_interval : OVERSAMPLE_INTERVAL_US) - esp_timer_get_time();
+        if (count && wait > 0)
+            sensors_delay_us(wait); // Let the BH1750 finish a new conversion
+        last_start = esp_timer_get_time();
+
+        ret = sensors_start(light_wanted); // Start all conversions
+        if (ret == ESP_OK)
+            ret = sensors_read(light_wanted); // Sensor reading
+        if (ret != ESP_OK)
+            break;
+
+        for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+            light[sensor][count] = sensors_light_reading[sensor];
+        temperature[count] = sensors_temperature_reading;
+        humidity[count] = sensors_humidity_reading;
+    }
+
+    if (count == 0)
+        return ret;
+
+    for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+        sensors_light[sensor] = sensors_filter(LIGHT_FILTER, light[sensor], LIGHT_OVERSAMPLE, count);
+    sensors_temperature = sensors_filter(TEMPERATURE_FILTER, temperature, TEMPERATURE_OVERSAMPLE, count);
+    sensors_humidity = sensors_filter(HUMIDITY_FILTER, humidity, HUMIDITY_OVERSAMPLE, count);
+
+    for (uint8_t sensor = 0; rtc_settings.bh1750_resolution == BH1750_RES_AUTO && sensor < LIGHT_SENSORS; sensor++)
+        ESP_ERROR_CHECK_WITHOUT_ABORT(bh1750_auto_range(sensor, sensors_light[sensor])); // Range of the next acquisition
+
+    return ESP_OK;
+}
+
+/**
+ * @brief    Filter the readings of one channel
+ * 
+ * @param    filter: Filter
+ * @param    samples: Readings of the burst
+ * @param    oversample: Readings wanted by the channel
+ * @param    count: Readings taken
+ * @return   int32_t measurement
+ */
+static int32_t sensors_filter(filter_t filter, int32_t *samples, uint8_t oversample, uint8_t count)
+{
+    return filter_apply(filter, samples, count < oversample ? count : oversample);
+}
+
+/**
+ * @brief    Wait between the readings of a burst without keeping the
+ *           CPU busy, as bh1750.c waits for a conversion
+ * 
+ * @param    wait: Wait time [us]
+ */
+static void sensors_delay_us(int64_t wait)
+{
+    int64_t end = esp_timer_get_time() + wait;
+
+    vTaskDelay(pdMS_TO_TICKS(wait / 1000)); // Never longer than the wait
+    wait = end - esp_timer_get_time();
+    if (wait > 0)
+        ets_delay_us(wait);
+}
+
+/**
+ * @brief    Light level of the last acquisition
+ * 
+ * @param    sensor: Light sensor index in devices.c
+ * @param    light: Pointer to light variable [lx]
+ * @return   esp_err_t status
+ */
+esp_err_t sensors_read_light(uint8_t sensor, int32_t *light)
+{
+    *light = sensors_light[sensor];
+    return ESP_OK;
+}
+
+/**
+ * @brief    Temperature of the last acquisition
+ * 
+ * @param    sensor: Unused, a single temperature sensor
+ * @param    temperature: Pointer to temperature variable [°C/°F / 100]
+ * @return   esp_err_t status
+ */
+esp_err_t sensors_read_temperature(uint8_t sensor, int32_t *temperature)
+{
+    *temperature = sensors_temperature;
+    return ESP_OK;
+}
+
+/**
+ * @brief    Humidity of the last acquisition
+ * 
+ * @param    sensor: Unused, a single humidity sensor
+ * @param    humidity: Pointer to humidity variable [% / 100]
+ * @return   esp_err_t status
+ */
+esp_err_t sensors_read_humidity(uint8_t sensor, int32_t *humidity)
+{
+    *humidity = sensors_humidity;
+    return ESP_OK;
+}
@@ -0,0 +1,458 @@
+/**
+ * @file     settings.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Runtime configuration.
+ *           The tunables of configuration.h are only defaults: the node
+ *           subscribes to a retained settings topic in every connected
+ *           session, and a changed payload is stored in NVS. The parsed
+ *           settings are cached in RTC memory with a CRC, so wakes only
+ *           check the CRC, NVS is read after a reset.
+ *
+ *           The payload lists the settings that differ from the defaults,
+ *           as key=value pairs separated by commas, spaces or new lines:
+ *           sleep_interval_min=10,light_threshold=5,temperature_policy=hysteresis
+ *           A setting missing from the payload goes back to its default,
+ *           an invalid payload is ignored as a whole. Values are in the
+ *           units of configuration.h.
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <esp32/rom/crc.h>
+#include "freertos/FreeRTOS.h"
+#include "nvs_flash.h"
+
+#include "configuration.h"
+
+#include "settings.h"
+
+#define SETTINGS_NVS_KEY "settings"
+#define SETTINGS_SEPARATORS ", \t\r\n"
+
+// Interval setting
+typedef struct
+{
+    const char *key;
+    size_t offset; // Field offset in settings_t
+    uint32_t min;  // Smallest valid value [sec]
+} settings_interval_t;
+
+// RTC variables
+RTC_DATA_ATTR settings_t rtc_settings;
+RTC_DATA_ATTR uint8_t rtc_settings_sensors_changed; // Sensor resolutions changed since the last setup
+
+// Global variables
+#if SETTINGS_REMOTE
+static const settings_interval_t settings_intervals[] = {
+    {"sleep_interval", offsetof(settings_t, sleep_interval_sec), 1},
+    {"sleep_interval_min", offsetof(settings_t, sleep_interval_min_sec), 1},
+    {"sleep_interval_max", offsetof(settings_t, sleep_interval_max_sec), 1},
+    {"batch_max_latency", offsetof(settings_t, batch_max_latency_sec), 0},
+    {"pir_holdoff", offsetof(settings_t, pir_holdoff_sec), 0},
+    {"pir_piggyback", offsetof(settings_t, pir_piggyback_sec), 0},
+};
+
+static const char *const policy_names[] = {"delta", "relative", "hysteresis", "swinging_door"}; // decision_policy_t
+static const char *const bh1750_resolution_names[] = {"low", "high", "high2", "auto"};         // bh1750_resolution_t
+static const char *const si7021_resolution_names[] = {"high2", "high", "high1", "low"};         // si7021_resolution_t
+
+settings_t settings_pending; // Last received settings, applied before deep sleep
+uint8_t settings_pending_valid = 0;
+portMUX_TYPE settings_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Private function declarations
+static void settings_defaults(settings_t *settings);
+static uint32_t settings_crc(const settings_t *settings);
+#if SETTINGS_REMOTE
+static esp_err_t settings_parse(char *payload, settings_t *settings);
+static esp_err_t settings_set(settings_t *settings, const char *key, const char *value);
+static esp_err_t settings_set_channel(decision_config_t *decision, uint8_t decimals, const char *key, const char *value);
+static esp_err_t settings_store(const settings_t *settings);
+static esp_err_t parse_uint(const char *string, uint32_t max, uint32_t *output);
+static esp_err_t parse_fixed(const char *string, uint8_t decimals, int32_t *output);
+static esp_err_t parse_name(const char *string, const char *const *names, uint8_t count, uint8_t *output);
+#endif
+
+// Functions
+
+/**
+ * @brief    Fill the settings with the defaults of configuration.h
+ *
+ * @param    settings: Pointer to settings
+ */
+static void settings_defaults(settings_t *settings)
+{
+    memset(settings, 0, sizeof(*settings)); // Padding included, settings are compared as a whole
+
+    settings->sleep_interval_sec = SLEEP_INTERVAL_SEC;
+    settings->sleep_interval_min_sec = SLEEP_INTERVAL_MIN_SEC;
+    settings->sleep_interval_max_sec = SLEEP_INTERVAL_MAX_SEC;
+    settings->batch_max_latency_sec = BATCH_MAX_LATENCY_SEC;
+    settings->pir_holdoff_sec = PIR_HOLDOFF_SEC;
+    settings->pir_piggyback_sec = PIR_PIGGYBACK_SEC;
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+        settings->decision[id] = channels[id].decision;
+    settings->bh1750_resolution = BH1750_RESOLUTION;
+    settings->si7021_resolution = SI7021_RESOLUTION;
+}
+
+/**
+ * @brief    CRC of the settings
+ *
+ * @param    settings: Pointer to settings
+ * @return   uint32_t CRC-32
+ */
+static uint32_t settings_crc(const settings_t *settings)
+{
+    return crc32_le(0, (const uint8_t *)settings, offsetof(settings_t, crc));
+}
+
+/**
+ * @brief    Make the settings available in rtc_settings. The RTC copy is
+ *           kept if its CRC matches, otherwise, as after a reset, the
+ *           settings stored in NVS or the defaults are loaded.
+ *
+ */
+void settings_load(void)
+{
+    if (rtc_settings.crc == settings_crc(&rtc_settings))
+        return; // Cached by a previous wake
+
+    settings_defaults(&rtc_settings);
+
+#if SETTINGS_REMOTE
+    nvs_handle handle;
+    settings_t stored;
+    size_t size = sizeof(stored);
+
+    if (nvs_flash_init() == ESP_OK && nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        if (nvs_get_blob(handle, SETTINGS_NVS_KEY, &stored, &size) == ESP_OK &&
+            size == sizeof(stored) &&
+            stored.crc == settings_crc(&stored)) // Written by a firmware with the same layout
+            memcpy(&rtc_settings, &stored, sizeof(stored));
+        nvs_close(handle);
+    }
+#endif
+
+    rtc_settings.crc = settings_crc(&rtc_settings);
+}
+
+/**
+ * @brief    Checks if the sensor resolutions changed since the sensors
+ *           were set up, and clears the request
+ *
+ * @return   uint8_t: 1 the sensors must be set up again, 0 otherwise
+ */
+uint8_t settings_sensors_changed(void)
+{
+    uint8_t changed = rtc_settings_sensors_changed;
+
+    rtc_settings_sensors_changed = 0;
+    return changed;
+}
+
+#if SETTINGS_REMOTE
+
+/**
+ * @brief    Parse a payload of the settings topic, called by the MQTT
+ *           event handler. Valid settings are applied by settings_apply().
+ *
+ * @param    payload: Payload, not null terminated
+ * @param    len: Payload length
+ */
+void settings_receive(const char *payload, size_t len)
+{
+    char buffer[SETTINGS_PAYLOAD_MAX_LEN + 1];
+    settings_t settings;
+
+    if (len > SETTINGS_PAYLOAD_MAX_LEN)
+    {
+        printf("Settings payload too long\n");
+        return;
+    }
+    memcpy(buffer, payload, len);
+    buffer[len] = '\0';
+
+    if (settings_parse(buffer, &settings) != ESP_OK)
+        return;
+
+    portENTER_CRITICAL(&settings_mux);
+    memcpy(&settings_pending, &settings, sizeof(settings)); // Padding included
+    settings_pending_valid = 1;
+    portEXIT_CRITICAL(&settings_mux);
+}
+
+/**
+ * @brief    Apply the settings received in this session, if they differ
+ *           from the cached ones, and store them in NVS
+ *
+ */
+void settings_apply(void)
+{
+    settings_t settings;
+
+    portENTER_CRITICAL(&settings_mux);
+    uint8_t valid = settings_pending_valid;
+    memcpy(&settings, &settings_pending, sizeof(settings));
+    settings_pending_valid = 0;
+    portEXIT_CRITICAL(&settings_mux);
+
+    if (!valid)
+        return;
+
+    settings.crc = settings_crc(&settings);
+    if (!memcmp(&settings, &rtc_settings, sizeof(settings)))
+        return; // Retained payload already applied
+
+    if (settings.bh1750_resolution != rtc_settings.bh1750_resolution ||
+        settings.si7021_resolution != rtc_settings.si7021_resolution)
+        rtc_settings_sensors_changed = 1;
+
+    memcpy(&rtc_settings, &settings, sizeof(settings));
+    if (settings_store(&settings) != ESP_OK)
+        printf("Failed to store settings\n"); // Kept until the next reset
+
+    printf("Settings updated\n");
+}
+
+/**
+ * @brief    Store the settings in NVS
+ *
+ * @param    settings: Pointer to settings
+ * @return   esp_err_t status
+ */
+static esp_err_t settings_store(const settings_t *settings)
+{
+    nvs_handle handle;
+
+    esp_err_t ret = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_blob(handle, SETTINGS_NVS_KEY, settings, sizeof(*settings));
+        if (ret == ESP_OK)
+            ret = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    return ret;
+}
+
+/**
+ * @brief    Parse the key=value pairs of a payload over the defaults
+ *
+ * @param    payload: Null terminated payload, modified
+ * @param    settings: Pointer to the parsed settings
+ * @return   esp_err_t status
+ */
+static esp_err_t settings_parse(char *payload, settings_t *settings)
+{
+    char *save;
+
+    settings_defaults(settings);
+
+    for (char *pair = strtok_r(payload, SETTINGS_SEPARATORS, &save); pair; pair = strtok_r(NULL, SETTINGS_SEPARATORS, &save))
+    {
+        char *value = strchr(pair, '=');
+
+        if (value)
+            *value++ = '\0'; // Split key and value
+        if (!value || settings_set(settings, pair, value) != ESP_OK)
+        {
+            printf("Invalid setting %s\n", pair);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (settings->sleep_interval_min_sec > settings->sleep_interval_max_sec)
+    {
+        printf("Invalid sleep interval range\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief    Set one setting
+ *
+ * @param    settings: Pointer to settings
+ * @param    key: Setting key
+ * @param    value: Setting value
+ * @return   esp_err_t status
+ */
+static esp_err_t settings_set(settings_t *settings, const char *key, const char *value)
+{
+    uint8_t index;
+
+    for (uint8_t i = 0; i < sizeof(settings_intervals) / sizeof(settings_intervals[0]); i++)
+    {
+        if (strcmp(key, settings_intervals[i].key))
+            continue;
+
+        uint32_t *field = (uint32_t *)((uint8_t *)settings + settings_intervals[i].offset);
+        if (parse_uint(value, SETTINGS_INTERVAL_MAX_SEC, field) != ESP_OK || *field < settings_intervals[i].min)
+            return ESP_ERR_INVALID_ARG;
+        return ESP_OK;
+    }
+
+    if (!strcmp(key, "update_interval_max"))
+    {
+        uint32_t interval;
+
+        if (parse_uint(value, SETTINGS_INTERVAL_MAX_SEC, &interval) != ESP_OK || interval == 0)
+            return ESP_ERR_INVALID_ARG;
+        for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+            settings->decision[id].interval_max = interval;
+        return ESP_OK;
+    }
+
+    if (!strcmp(key, "bh1750_resolution"))
+    {
+        if (parse_name(value, bh1750_resolution_names, sizeof(bh1750_resolution_names) / sizeof(bh1750_resolution_names[0]), &index) != ESP_OK)
+            return ESP_ERR_INVALID_ARG;
+        settings->bh1750_resolution = index;
+        return ESP_OK;
+    }
+
+    if (!strcmp(key, "si7021_resolution"))
+    {
+        if (parse_name(value, si7021_resolution_names, sizeof(si7021_resolution_names) / sizeof(si7021_resolution_names[0]), &index) != ESP_OK)
+            return ESP_ERR_INVALID_ARG;
+        settings->si7021_resolution = index;
+        return ESP_OK;
+    }
+
+    for (channel_id_t id = 0; id < CHANNEL_MAX; id++)
+    {
+        size_t len = strlen(channels[id].key);
+
+        if (!strncmp(key, channels[id].key, len) && key[len] == '_') // Channel key prefix, as in light_threshold
+            return settings_set_channel(&settings->decision[id], channels[id].decimals, key + len + 1, value);
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief    Set one report setting of a channel
+ *
+ * @param    decision: Pointer to the channel report settings
+ * @param    decimals: Decimal digits of the channel fixed point values
+ * @param    key: Setting key, without the channel prefix
+ * @param    value: Setting value
+ * @return   esp_err_t status
+ */
+static esp_err_t settings_set_channel(decision_config_t *decision, uint8_t decimals, const char *key, const char *value)
+{
+    int32_t number;
+    uint32_t interval;
+    uint8_t index;
+
+    if (!strcmp(key, "threshold"))
+    {
+        if (parse_fixed(value, decimals, &number) != ESP_OK || number < 0)
+            return ESP_ERR_INVALID_ARG;
+        decision->threshold = number;
+    }
+    else if (!strcmp(key, "relative"))
+    {
+        if (parse_fixed(value, 1, &number) != ESP_OK || number < 0 || number > UINT16_MAX) // [%] to [1/1000]
+            return ESP_ERR_INVALID_ARG;
+        decision->relative_permille = number;
+    }
+    else if (!strcmp(key, "policy"))
+    {
+        if (parse_name(value, policy_names, sizeof(policy_names) / sizeof(policy_names[0]), &index) != ESP_OK)
+            return ESP_ERR_INVALID_ARG;
+        decision->policy = index;
+    }
+    else if (!strcmp(key, "interval_max"))
+    {
+        if (parse_uint(value, SETTINGS_INTERVAL_MAX_SEC, &interval) != ESP_OK || interval == 0)
+            return ESP_ERR_INVALID_ARG;
+        decision->interval_max = interval;
+    }
+    else
+        return ESP_ERR_NOT_FOUND;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief    Parse an unsigned integer, out of range values are rejected
+ *           instead of saturated
+ *
+ * @param    string: Value
+ * @param    max: Largest valid value
+ * @param    output: Pointer to the parsed value
+ * @return   esp_err_t status
+ */
+static esp_err_t parse_uint(const char *string, uint32_t max, uint32_t *output)
+{
+    char *end;
+    unsigned long value;
+
+    errno = 0;
+    value = strtoul(string, &end, 10);
+    if (end == string || *end || *string == '-' || errno == ERANGE || value > max)
+        return ESP_ERR_INVALID_ARG;
+
+    *output = value;
+    return ESP_OK;
+}
+
+/**
+ * @brief    Parse a decimal number into a fixed point integer
+ *
+ * @param    string: Value
+ * @param    decimals: Decimal digits of the fixed point integer
+ * @param    output: Pointer to the parsed value
+ * @return   esp_err_t status
+ */
+static esp_err_t parse_fixed(const char *string, uint8_t decimals, int32_t *output)
+{
+    char *end;
+    double value = strtod(string, &end);
+
+    if (end == string || *end)
+        return ESP_ERR_INVALID_ARG;
+
+    for (uint8_t i = 0; i < decimals; i++)
+        value *= 10;
+    value = value < 0 ? value - 0.5 : value + 0.5;
+    if (!(value > INT32_MIN - 1.0 && value < INT32_MAX + 1.0)) // Also rejects nan
+        return ESP_ERR_INVALID_ARG;
+
+    *output = (int32_t)value;
+    return ESP_OK;
+}
+
+/**
+ * @brief    Parse a name of an enumeration
+ *
+ * @param    string: Value
+ * @param    names: Names, indexed by enumeration value
+ * @param    count: Number of names
+ * @param    output: Pointer to the enumeration value
+ * @return   esp_err_t status
+ */
+static esp_err_t parse_name(const char *string, const char *const *names, uint8_t count, uint8_t *output)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!strcmp(string, names[i]))
+        {
+            *output = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+#endif
@@ -8,21 +8,39 @@
  */
 
 // Include libraries
-#include <driver/i2c.h>
+#include <esp_timer.h>
+#include <rom/ets_sys.h>
 
 #include "configuration.h"
 
 #include "si7021.h"
+#include "i2c.h"
+#include "devices.h"
+#include "conversions.h"
 
-// Imported variables
-extern i2c_port_t i2c_master_port;
+// Maximum conversion times from datasheet, indexed by si7021_resolution_t [us]
+static const uint16_t si7021_rh_conversion_us[] = {22800, 6900, 10700, 9400}; // RH conversion includes temperature
+static const uint16_t si7021_temp_conversion_us[] = {10800, 3800, 6200, 2400};
+
+// Global variables
+int64_t si7021_conversion_start;
+
+i2c_transaction_t si7021_command_transaction;
+i2c_transaction_t si7021_start_transaction;
+i2c_transaction_t si7021_register_transaction;
+i2c_transaction_t si7021_code_transaction;
+i2c_transaction_t si7021_code_crc_transaction;
+
+// RTC variables
+RTC_DATA_ATTR si7021_resolution_t rtc_si7021_resolution = SI7021_RESOLUTION;
 
 // Private function declarations
 esp_err_t si7021_send_command(uint8_t *command, size_t nbytes);
-esp_err_t si7021_read_measurement(uint8_t measure_cmd, float *output, float (*fn)(uint16_t));
-float si7021_code_to_rh_pct(const uint16_t code);
-float si7021_code_to_celsius(const uint16_t code);
-float si7021_code_to_fahrenheit(const uint16_t code);
+esp_err_t si7021_read_code(uint16_t *code, uint8_t check_crc);
+esp_err_t si7021_poll_code(uint8_t measure_cmd, uint16_t *code);
+esp_err_t si7021_read_measurement(uint8_t measure_cmd, int32_t *output, int32_t (*fn)(uint16_t));
+uint8_t si7021_crc(const uint8_t *data, size_t nbytes);
+static void si7021_start_done(esp_err_t status, void *args);
 
 // Functions
 
@@ -34,9 +52,21 @@ float si7021_code_to_fahrenheit(const uint16_t code);
  */
 esp_err_t si7021_setup(si7021_resolution_t resolution)
 {
+    uint8_t settings;
+
     if (resolution < 0 || resolution > 3)
         return ESP_ERR_INVALID_ARG;
-    return si7021_write_register(resolution << 4);
+
+    ESP_ERROR_CHECK(si7021_read_register(&settings));
+    settings &= ~(SI7021_REG_RES1 | SI7021_REG_RES0); // Keep reserved and heater bits
+    if (resolution & 0x2)
+        settings |= SI7021_REG_RES1;
+    if (resolution & 0x1)
+        settings |= SI7021_REG_RES0;
+
+    rtc_si7021_resolution = resolution;
+
+    return si7021_write_register(settings);
 }
 
 /**
@@ -48,15 +78,10 @@ esp_err_t si7021_setup(si7021_resolution_t resolution)
  */
 esp_err_t si7021_send_command(uint8_t *command, size_t nbytes)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, I2C_MASTER_ACK);
+    i2c_transaction_init(&si7021_command_transaction, &si7021_device, nbytes, 0);
     for (size_t i = 0; i < nbytes; i++)
-        i2c_master_write_byte(cmd, command[i], I2C_MASTER_ACK);
-
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_master_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+        si7021_command_transaction.tx[i] = command[i];
+    esp_err_t ret = i2c_bus_transfer(&si7021_command_transaction);
 
     ESP_ERROR_CHECK(ret);
 
@@ -83,22 +108,70 @@ esp_err_t si7021_write_register(uint8_t settings)
  */
 esp_err_t si7021_read_register(uint8_t *output)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, I2C_MASTER_ACK);
-    i2c_master_write_byte(cmd, SI7021_REG_READ, I2C_MASTER_ACK);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_ACK);
-    i2c_master_read_byte(cmd, output, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_master_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    i2c_transaction_init(&si7021_register_transaction, &si7021_device, 1, 1);
+    si7021_register_transaction.tx[0] = SI7021_REG_READ;
+    esp_err_t ret = i2c_bus_transfer(&si7021_register_transaction);
 
     ESP_ERROR_CHECK(ret);
 
+    *output = si7021_register_transaction.rx[0];
+
+    return ret;
+}
+
+/**
+ * @brief    Read a 16 bit measurement code from Si7021
+ * 
+ * @param    code: Pointer to code variable
+ * @param    check_crc: Read and verify the checksum byte
+ * @return   esp_err_t status: ESP_FAIL if Si7021 is still converting
+ */
+esp_err_t si7021_read_code(uint16_t *code, uint8_t check_crc)
+{
+    i2c_transaction_t *transaction = check_crc ? &si7021_code_crc_transaction : &si7021_code_transaction;
+    uint8_t *buf = transaction->rx;
+
+    i2c_transaction_init(transaction, &si7021_device, 0, check_crc ? 3 : 2);
+    esp_err_t ret = i2c_bus_transfer(transaction);
+
+    if (ret != ESP_OK)
+        return ret;
+
+    if (check_crc && si7021_crc(buf, 2) != buf[2])
+        return ESP_ERR_INVALID_CRC;
+
+    *code = buf[0] << 8 | buf[1];
+
     return ret;
 }
 
+/**
+ * @brief    Poll a no hold master conversion until Si7021 acknowledges the read,
+ *           giving up after the datasheet maximum conversion time
+ * 
+ * @param    measure_cmd: Measurement command of the running conversion
+ * @param    code: Pointer to code variable
+ * @return   esp_err_t status
+ */
+esp_err_t si7021_poll_code(uint8_t measure_cmd, uint16_t *code)
+{
+    int64_t deadline = si7021_conversion_start + SI7021_POLL_INTERVAL_US +
+                       (measure_cmd == SI7021_COMMAND_READ_RH ? si7021_rh_conversion_us[rtc_si7021_resolution]
+                                                              : si7021_temp_conversion_us[rtc_si7021_resolution]);
+
+    while (1)
+    {
+        esp_err_t ret = si7021_read_code(code, 1);
+        if (ret != ESP_FAIL) // Data read or corrupted
+            return ret;
+
+        if (esp_timer_get_time() > deadline)
+            return ESP_ERR_TIMEOUT;
+
+        ets_delay_us(SI7021_POLL_INTERVAL_US); // Conversion still running
+    }
+}
+
 /**
  * @brief    Temperature or humidity measurement reading
  * 
@@ -107,121 +180,172 @@ esp_err_t si7021_read_register(uint8_t *output)
  * @param    fn: Function to convert measurement (temperature or humidity)
  * @return   esp_err_t status
  */
-esp_err_t si7021_read_measurement(uint8_t measure_cmd, float *output, float (*fn)(uint16_t))
+esp_err_t si7021_read_measurement(uint8_t measure_cmd, int32_t *output, int32_t (*fn)(uint16_t))
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, I2C_MASTER_ACK);
-    i2c_master_write_byte(cmd, measure_cmd, I2C_MASTER_ACK);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_master_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    uint16_t data;
+    esp_err_t ret;
 
-    ESP_ERROR_CHECK(ret);
+    for (uint8_t attempt = 0; attempt <= SI7021_CRC_RETRIES; attempt++)
+    {
+        ESP_ERROR_CHECK(si7021_send_command(&measure_cmd, 1));
+        si7021_conversion_start = esp_timer_get_time();
 
-    vTaskDelay(MEASUREMENT_WAIT / portTICK_PERIOD_MS);
+        ret = si7021_poll_code(measure_cmd, &data);
+        if (ret != ESP_ERR_INVALID_CRC) // Retry only on corrupted data
+            break;
+    }
 
-    uint8_t buf[2];
-    uint16_t data;
+    if (ret == ESP_OK)
+        *output = fn(data);
 
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_ACK);
-    i2c_master_read(cmd, buf, 2, I2C_MASTER_LAST_NACK);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(i2c_master_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    return ret;
+}
 
-    ESP_ERROR_CHECK(ret);
+/**
+ * @brief    Start a humidity measurement without waiting for it,
+ *           temperature is measured together with humidity
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t si7021_start_measurement(void)
+{
+    ESP_ERROR_CHECK(si7021_start_measurement_submit());
+    esp_err_t ret = i2c_bus_run();
 
-    data = buf[0] << 8 | buf[1];
-    *output = fn(data);
+    ESP_ERROR_CHECK(ret);
 
     return ret;
 }
 
 /**
- * @brief    Temperature and humidity measurement
+ * @brief    Queue the start of a humidity measurement on the I2C bus
  * 
- * @param    temperature: Pointer to temperature variable
- * @param    humidity: Pointer to humidity variable
  * @return   esp_err_t status
  */
-esp_err_t si7021_measure(float *temperature, float *humidity)
+esp_err_t si7021_start_measurement_submit(void)
 {
-    si7021_read_humidity(humidity);
-    return si7021_read_temperature_after_humidity(temperature);
+    i2c_transaction_init(&si7021_start_transaction, &si7021_device, 1, 0);
+    si7021_start_transaction.tx[0] = SI7021_COMMAND_READ_RH;
+    return i2c_bus_submit(&si7021_start_transaction, si7021_start_done, NULL);
 }
 
 /**
- * @brief    Temperature measurement
+ * @brief    Measurement start completion callback
  * 
- * @param    temperature: Pointer to temperature variable
- * @return   esp_err_t status
+ * @param    status: Transaction status
+ * @param    args: Unused
  */
-esp_err_t si7021_read_temperature(float *temperature)
+static void si7021_start_done(esp_err_t status, void *args)
 {
-#if TEMPERATURE_USE_FAHRENHEIT
-    return si7021_read_measurement(SI7021_COMMAND_READ_TEMP, temperature, &si7021_code_to_fahrenheit);
-#else
-    return si7021_read_measurement(SI7021_COMMAND_READ_TEMP, temperature, &si7021_code_to_celsius);
-#endif
+    si7021_conversion_start = esp_timer_get_time(); // Conversion time counts from here
 }
 
 /**
- * @brief    Temperature reading after humidity measurement
+ * @brief    Read humidity and temperature of a measurement started with
+ *           si7021_start_measurement, as soon as its conversion is done
  * 
- * @param    temperature: Pointer to temperature variable
+ * @param    temperature: Pointer to temperature variable [°C/°F / 100]
+ * @param    humidity: Pointer to humidity variable [% / 100]
  * @return   esp_err_t status
  */
-esp_err_t si7021_read_temperature_after_humidity(float *temperature)
+esp_err_t si7021_read_result(int32_t *temperature, int32_t *humidity)
 {
-    if (TEMPERATURE_USE_FAHRENHEIT)
-        return si7021_read_measurement(SI7021_COMMAND_READ_TEMP_AFTER_RH, temperature, &si7021_code_to_fahrenheit);
-    else
-        return si7021_read_measurement(SI7021_COMMAND_READ_TEMP_AFTER_RH, temperature, &si7021_code_to_celsius);
+    uint16_t data;
+
+    esp_err_t ret = si7021_poll_code(SI7021_COMMAND_READ_RH, &data);
+    for (uint8_t attempt = 0; attempt < SI7021_CRC_RETRIES && ret == ESP_ERR_INVALID_CRC; attempt++)
+    {
+        ESP_ERROR_CHECK(si7021_start_measurement()); // Measure again only on corrupted data
+        ret = si7021_poll_code(SI7021_COMMAND_READ_RH, &data);
+    }
+    if (ret != ESP_OK)
+        return ret;
+
+    *humidity = si7021_code_to_rh_centi(data);
+
+    return si7021_read_temperature_after_humidity(temperature);
 }
 
 /**
- * @brief    Humidity measurement
+ * @brief    Si7021 CRC-8 checksum (polynomial x^8 + x^5 + x^4 + 1, init 0x00)
+ * 
+ * @param    data: Pointer to data bytes
+ * @param    nbytes: Number of bytes
+ * @return   uint8_t checksum
+ */
+uint8_t si7021_crc(const uint8_t *data, size_t nbytes)
+{
+    uint8_t crc = 0x00;
+
+    for (size_t i = 0; i < nbytes; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * @brief    Temperature and humidity measurement
  * 
- * @param    humidity: Pointer to humidity variable
+ * @param    temperature: Pointer to temperature variable [°C/°F / 100]
+ * @param    humidity: Pointer to humidity variable [% / 100]
  * @return   esp_err_t status
  */
-esp_err_t si7021_read_humidity(float *humidity)
+esp_err_t si7021_measure(int32_t *temperature, int32_t *humidity)
 {
-    return si7021_read_measurement(SI7021_COMMAND_READ_TEMP, humidity, &si7021_code_to_rh_pct);
+    ESP_ERROR_CHECK(si7021_start_measurement());
+    return si7021_read_result(temperature, humidity);
 }
 
 /**
- * @brief    Code conversion to percentual humidity
+ * @brief    Temperature measurement
  * 
- * @param    code: raw humidity sensor reading
- * @return   float status
+ * @param    temperature: Pointer to temperature variable [°C/°F / 100]
+ * @return   esp_err_t status
  */
-float si7021_code_to_rh_pct(const uint16_t code)
+esp_err_t si7021_read_temperature(int32_t *temperature)
 {
-    return (((125.0 * code) / 65536.0) - 6.0);
+#if TEMPERATURE_USE_FAHRENHEIT
+    return si7021_read_measurement(SI7021_COMMAND_READ_TEMP, temperature, &si7021_code_to_fahrenheit_centi);
+#else
+    return si7021_read_measurement(SI7021_COMMAND_READ_TEMP, temperature, &si7021_code_to_celsius_centi);
+#endif
 }
 
 /**
- * @brief    Code conversion to celsius temperature
+ * @brief    Temperature reading after humidity measurement
  * 
- * @param    code: raw temperature sensor reading
- * @return   float status
+ * @param    temperature: Pointer to temperature variable [°C/°F / 100]
+ * @return   esp_err_t status
  */
-float si7021_code_to_celsius(const uint16_t code)
+esp_err_t si7021_read_temperature_after_humidity(int32_t *temperature)
 {
-    return (((175.72 * code) / 65536.0) - 46.85);
+    uint16_t data;
+    uint8_t command = SI7021_COMMAND_READ_TEMP_AFTER_RH;
+
+    ESP_ERROR_CHECK(si7021_send_command(&command, 1)); // No conversion needed, temperature is already measured
+    esp_err_t ret = si7021_read_code(&data, 0);        // No checksum for this command
+    if (ret != ESP_OK)
+        return ret;
+
+#if TEMPERATURE_USE_FAHRENHEIT
+    *temperature = si7021_code_to_fahrenheit_centi(data);
+#else
+    *temperature = si7021_code_to_celsius_centi(data);
+#endif
+
+    return ret;
 }
 
 /**
- * @brief    Code conversion to fahrenheit temperature
+ * @brief    Humidity measurement
  * 
- * @param    code: raw temperature sensor reading
- * @return   float status
+ * @param    humidity: Pointer to humidity variable [% / 100]
+ * @return   esp_err_t status
  */
-float si7021_code_to_fahrenheit(const uint16_t code)
+esp_err_t si7021_read_humidity(int32_t *humidity)
 {
-    return (((175.72 * code) / 65536.0) - 46.85) * 1.8 + 32;
-}
\ No newline at end of file
+    return si7021_read_measurement(SI7021_COMMAND_READ_RH, humidity, &si7021_code_to_rh_centi);
+}
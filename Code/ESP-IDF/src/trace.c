@@ -0,0 +1,292 @@
+/**
+ * @file     trace.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ * 
+ * @brief    Wake phase timing functions.
+ *           Phase totals of the current wake are printed before deep sleep.
+ *           With TRACE_PUBLISH every phase is also kept as an event in an
+ *           RTC memory ring buffer, so the last wakes can be published on
+ *           the diagnostics topic once a connection is up.
+ *           tools/trace_to_perfetto.py turns the published events into
+ *           a Chrome trace / Perfetto file.
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+
+#include "configuration.h"
+
+#include "trace.h"
+#include "mqtt.h"
+#include "wake_stub.h"
+
+#if TRACE_ENABLE
+
+#if TRACE_PUBLISH
+
+#define DIAGNOSTICS_TOPIC MQTT_NODE_NAME "/" MQTT_DIAGNOSTICS_TOPIC
+#define TRACE_EVENT_MAX_LEN 48 // Longest event line
+
+typedef struct
+{
+    uint32_t wake_time; // Wakeup timestamp [sec]
+    uint32_t start;     // Event start since boot [us]
+    uint32_t duration;  // Event duration, 0 for instants [us]
+    uint8_t phase;      // trace_phase_t
+    uint8_t cause;      // esp_sleep_wakeup_cause_t
+} trace_event_t;
+
+// RTC variables
+RTC_DATA_ATTR trace_event_t rtc_trace[TRACE_BUFFER_SIZE];
+RTC_DATA_ATTR uint8_t rtc_trace_head; // Index of the oldest event
+RTC_DATA_ATTR uint8_t rtc_trace_count;
+
+portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t trace_wake_time;
+uint8_t trace_wake_cause;
+uint32_t trace_dropped; // Oldest events dropped by a full buffer since boot
+
+#endif
+
+// Global variables
+static int64_t phase_start[TRACE_PHASE_MAX];
+static int64_t phase_time[TRACE_PHASE_MAX];
+static int64_t radio_on_time = -1;
+static int64_t radio_time = 0;
+
+static const char *phase_names[TRACE_PHASE_MAX] = {
+    "boot",
+    "setup",
+    "sensor read",
+    "wifi setup",
+    "wifi connect",
+    "mqtt setup",
+    "mqtt publish",
+    "sensor start",
+    "si7021 wait",
+    "radio",
+    "mqtt send",
+    "mqtt ack",
+    "deep sleep",
+};
+
+// Private function declarations
+static void trace_event(trace_phase_t phase, int64_t start, int64_t duration);
+
+// Functions
+
+/**
+ * @brief    Mark the end of the boot phase and start the trace of this wake
+ * 
+ * @param    timestamp: Wakeup timestamp
+ * @param    wakeup_cause: Wakeup cause of this cycle
+ */
+void trace_wake(time_t timestamp, esp_sleep_wakeup_cause_t wakeup_cause)
+{
+#if TRACE_PUBLISH
+    trace_wake_time = timestamp;
+    trace_wake_cause = wakeup_cause;
+#endif
+    trace_phase_end(TRACE_PHASE_BOOT); // Boot phase starts at reset
+}
+
+/**
+ * @brief    Mark the beginning of a wake phase
+ * 
+ * @param    phase: Phase
+ */
+void trace_phase_begin(trace_phase_t phase)
+{
+    phase_start[phase] = esp_timer_get_time();
+}
+
+/**
+ * @brief    Mark the end of a wake phase and add its duration to the phase total
+ * 
+ * @param    phase: Phase
+ */
+void trace_phase_end(trace_phase_t phase)
+{
+    int64_t duration = esp_timer_get_time() - phase_start[phase];
+
+    phase_time[phase] += duration;
+    trace_event(phase, phase_start[phase], duration);
+}
+
+/**
+ * @brief    Mark an instant event
+ * 
+ * @param    phase: Phase
+ */
+void trace_mark(trace_phase_t phase)
+{
+    trace_event(phase, esp_timer_get_time(), 0);
+}
+
+/**
+ * @brief    Mark the moment the radio is turned on
+ * 
+ */
+void trace_radio_on(void)
+{
+    if (radio_on_time < 0)
+        radio_on_time = esp_timer_get_time();
+}
+
+/**
+ * @brief    Mark the moment the radio is turned off, otherwise it stays on until deep sleep
+ * 
+ */
+void trace_radio_off(void)
+{
+    if (radio_on_time >= 0)
+    {
+        int64_t duration = esp_timer_get_time() - radio_on_time;
+
+        radio_time += duration;
+        trace_event(TRACE_PHASE_RADIO, radio_on_time, duration);
+    }
+    radio_on_time = -1;
+}
+
+/**
+ * @brief    Print how long every phase of this wake kept the CPU and the radio awake,
+ *           the radio and deep sleep events close the trace of this wake
+ * 
+ * @param    wakeup_cause: Wakeup cause of this cycle
+ */
+void trace_report(esp_sleep_wakeup_cause_t wakeup_cause)
+{
+    trace_radio_off(); // Radio turns off with deep sleep
+    trace_mark(TRACE_PHASE_DEEP_SLEEP);
+
+    int64_t now = esp_timer_get_time();
+    int64_t accounted = 0;
+
+    printf("Wake budget (cause %d):\n", wakeup_cause);
+    for (int i = 0; i < TRACE_PHASE_TOP_MAX; i++)
+    {
+        if (phase_time[i] == 0)
+            continue;
+        printf("  %-14s %7d us\n", phase_names[i], (int)phase_time[i]);
+        accounted += phase_time[i];
+    }
+    if (now >= accounted)
+        printf("  %-14s %7d us\n", "other", (int)(now - accounted));
+    else
+        printf("  %-14s %7d us\n", "overlap", (int)(accounted - now)); // Background Wi-Fi setup runs during the sensor read
+    printf("  %-14s %7d us\n", "cpu awake", (int)now);
+    printf("  %-14s %7d us\n", "radio on", (int)radio_time);
+    printf("  %-14s %7d\n", "stub wakes", wake_stub_skipped()); // Timer wakes before this one ended in the stub
+}
+
+/**
+ * @brief    Store an event in the RTC trace, the oldest one is overwritten if full
+ * 
+ * @param    phase: Phase
+ * @param    start: Event start since boot [us]
+ * @param    duration: Event duration [us]
+ */
+static void trace_event(trace_phase_t phase, int64_t start, int64_t duration)
+{
+#if TRACE_PUBLISH
+    portENTER_CRITICAL(&trace_mux); // Events come from the MQTT and Wi-Fi tasks too
+    trace_event_t *event = &rtc_trace[(rtc_trace_head + rtc_trace_count) % TRACE_BUFFER_SIZE];
+    event->wake_time = trace_wake_time;
+    event->start = start;
+    event->duration = duration;
+    event->phase = phase;
+    event->cause = trace_wake_cause;
+
+    if (rtc_trace_count < TRACE_BUFFER_SIZE)
+        rtc_trace_count++;
+    else
+    {
+        rtc_trace_head = (rtc_trace_head + 1) % TRACE_BUFFER_SIZE; // Drop the oldest event
+        trace_dropped++;
+    }
+    portEXIT_CRITICAL(&trace_mux);
+#endif
+}
+
+#if TRACE_PUBLISH
+
+/**
+ * @brief    Publish the stored trace on the diagnostics topic, MQTT must be
+ *           already setup. Events are sent TRACE_PUBLISH_EVENTS per message,
+ *           one "wake_time,cause,phase,start_us,duration_us" line each, and
+ *           removed once acknowledged. Events are pushed while publishing,
+ *           the buffer is walked from a snapshot, and the events it drops
+ *           meanwhile are counted out of the snapshot.
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t trace_publish(void)
+{
+    char payload[TRACE_PUBLISH_EVENTS * TRACE_EVENT_MAX_LEN];
+    uint8_t queued = 0, acked = 0;
+    uint16_t events = 0;
+    uint8_t head, count;
+    uint32_t dropped, lost;
+
+    portENTER_CRITICAL(&trace_mux);
+    head = rtc_trace_head;
+    count = rtc_trace_count;
+    dropped = trace_dropped;
+    portEXIT_CRITICAL(&trace_mux);
+
+    while (events < count && queued < MQTT_WINDOW_SIZE)
+    {
+        size_t len = 0;
+
+        payload[0] = '\0';
+        for (uint8_t i = 0; i < TRACE_PUBLISH_EVENTS && events < count; i++, events++)
+        {
+            trace_event_t event;
+
+            portENTER_CRITICAL(&trace_mux);
+            lost = trace_dropped - dropped;
+            event = rtc_trace[(head + events) % TRACE_BUFFER_SIZE];
+            portEXIT_CRITICAL(&trace_mux);
+            if (events < lost)
+                continue; // Overwritten by a newer event
+
+            len += snprintf(payload + len, sizeof(payload) - len, "%u,%u,%s,%u,%u\n",
+                            (unsigned)event.wake_time,
+                            (unsigned)event.cause,
+                            phase_names[event.phase],
+                            (unsigned)event.start,
+                            (unsigned)event.duration);
+        }
+
+        if (mqtt_publish(DIAGNOSTICS_TOPIC, payload) != ESP_OK)
+            break;
+        queued++;
+    }
+    mqtt_event_wait(); // Wait for all MQTT acks
+
+    while (acked < queued && mqtt_message_status(acked) == ESP_OK)
+        acked++;
+
+    // Messages are acknowledged in order of the events they carry
+    uint16_t sent = acked == queued ? events : acked * TRACE_PUBLISH_EVENTS;
+
+    portENTER_CRITICAL(&trace_mux);
+    lost = trace_dropped - dropped; // Already removed from the buffer by trace_event()
+    if (sent > lost)
+    {
+        rtc_trace_head = (rtc_trace_head + sent - lost) % TRACE_BUFFER_SIZE;
+        rtc_trace_count -= sent - lost;
+    }
+    portEXIT_CRITICAL(&trace_mux);
+
+    return acked == queued ? ESP_OK : ESP_FAIL;
+}
+
+#endif
+
+#endif
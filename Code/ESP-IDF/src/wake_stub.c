@@ -0,0 +1,482 @@
+/**
+ * @file     wake_stub.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Deep sleep wake stub light check.
+ *           On a timer wake the stub runs from RTC fast memory before the
+ *           bootloader. It reads every BH1750 of devices.c with bit-banged
+ *           I2C on the pins of its controller, through its TCA9548A channel,
+ *           the last conversion in continuous mode, a new one in one-time
+ *           mode, and runs decision_is_quiet() on every light channel.
+ *           One-time conversions are started, and the node sleeps again
+ *           until they end, their results are read on the next stub entry.
+ *           All quiet goes straight back to deep sleep, anything else
+ *           continues into the full boot, which reads and reports every
+ *           channel.
+ *
+ *           The stub only sees the light levels: before deep sleep the
+ *           full boot arms it with the time left before another reason
+ *           to boot (a channel or the batch expiring, the motion hold-off),
+ *           and the stub handles at most WAKE_STUB_SKIP_MAX wakes in a row,
+ *           so temperature and humidity are still read regularly.
+ *
+ *           Stub code can't call flash functions: every function here is
+ *           in RTC fast memory, the header inline functions are flattened
+ *           into the check, and only ROM functions are called, including
+ *           the libgcc helpers of their 64 bit arithmetic (see
+ *           decision_threshold()).
+ */
+
+// Include libraries
+#include <stdint.h>
+#include <stdlib.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+#include "esp32/clk.h"
+#include "esp32/rom/ets_sys.h"
+#include "esp32/rom/rtc.h"
+#include "soc/rtc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/gpio_reg.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/io_mux_reg.h"
+#include "soc/timer_group_reg.h"
+
+#include "configuration.h"
+
+#include "wake_stub.h"
+#include "channels.h"
+#include "settings.h"
+#include "conversions.h"
+#include "bh1750.h"
+#include "devices.h"
+
+#if WAKE_STUB_ENABLE
+
+_Static_assert(I2C_MASTER_SDA_IO < 32 && I2C_MASTER_SCL_IO < 32, "Stub I2C pins must be GPIO 0-31");
+#if I2C_SECONDARY_ENABLE
+_Static_assert(I2C_SECONDARY_SDA_IO < 32 && I2C_SECONDARY_SCL_IO < 32, "Stub I2C pins must be GPIO 0-31");
+#endif
+
+#define STUB_IO_MUX_REG(pin) STUB_IO_MUX_REG_(pin)
+#define STUB_IO_MUX_REG_(pin) PERIPHS_IO_MUX_GPIO##pin##_U
+
+// GPIO setup of the pins of a bus, lines are driven low or released to the pull-ups
+#define STUB_PINS_SETUP(sda, scl)                                            \
+    do                                                                       \
+    {                                                                        \
+        PIN_FUNC_SELECT(STUB_IO_MUX_REG(sda), PIN_FUNC_GPIO);                \
+        PIN_FUNC_SELECT(STUB_IO_MUX_REG(scl), PIN_FUNC_GPIO);                \
+        PIN_INPUT_ENABLE(STUB_IO_MUX_REG(sda));                              \
+        PIN_INPUT_ENABLE(STUB_IO_MUX_REG(scl));                              \
+        REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + (sda) * 4, SIG_GPIO_OUT_IDX); \
+        REG_WRITE(GPIO_FUNC0_OUT_SEL_CFG_REG + (scl) * 4, SIG_GPIO_OUT_IDX); \
+        REG_WRITE(GPIO_OUT_W1TC_REG, BIT(sda) | BIT(scl));                   \
+                                                                             \
+    } while (0)
+
+typedef struct
+{
+    uint32_t sda; // Data line GPIO mask
+    uint32_t scl; // Clock line GPIO mask
+} stub_bus_t;
+
+typedef struct
+{
+    uint64_t deadline;   // Full boot needed from this time, whatever the light [RTC slow clock ticks]
+    uint64_t interval;   // Time between measurements [RTC slow clock ticks]
+    uint64_t conversion; // Longest one-time conversion of the light sensors, 0 if none [RTC slow clock ticks]
+    uint64_t wake;       // Timer wake that started the conversions [RTC slow clock ticks]
+    uint8_t skipped;     // Wakes handled by the stub since the last full boot
+    uint8_t armed;       // Stub may send the node back to sleep
+    uint8_t converting;  // One-time conversions started, read on the next stub entry
+} wake_stub_t;
+
+typedef enum
+{
+    STUB_BOOT = 0,  // Continue into the full boot
+    STUB_QUIET,     // Every light is quiet, back to sleep
+    STUB_CONVERTING // One-time conversions started, sleep until they end
+} stub_result_t;
+
+// RTC variables
+RTC_DATA_ATTR wake_stub_t rtc_wake_stub;
+
+RTC_RODATA_ATTR static const stub_bus_t stub_buses[I2C_NUM_MAX] = {
+    [I2C_MASTER_NUM] = {.sda = BIT(I2C_MASTER_SDA_IO), .scl = BIT(I2C_MASTER_SCL_IO)},
+#if I2C_SECONDARY_ENABLE
+    [I2C_SECONDARY_NUM] = {.sda = BIT(I2C_SECONDARY_SDA_IO), .scl = BIT(I2C_SECONDARY_SCL_IO)},
+#endif
+};
+
+// Private function declarations
+static stub_result_t wake_stub_check(void);
+static uint64_t stub_rtc_time(void);
+static void stub_sleep(uint64_t wakeup_time);
+static uint8_t stub_start_light(uint8_t sensor);
+static uint8_t stub_read_light(uint8_t sensor, uint16_t *count);
+static uint8_t stub_mux_select(const i2c_device_t *device);
+static uint8_t stub_send_byte(const stub_bus_t *bus, uint8_t address, uint8_t byte);
+static void stub_line_low(uint32_t line);
+static void stub_line_release(uint32_t line);
+static void stub_i2c_start(const stub_bus_t *bus);
+static void stub_i2c_stop(const stub_bus_t *bus);
+static uint8_t stub_i2c_write(const stub_bus_t *bus, uint8_t byte);
+static uint8_t stub_i2c_read(const stub_bus_t *bus, uint8_t ack);
+
+// Functions
+
+/**
+ * @brief    Arm the stub before deep sleep, called by the full boot
+ *
+ * @param    sleep_time: Time between measurements [sec]
+ * @param    boot_in: Time left before a full boot is needed anyway [sec]
+ */
+void wake_stub_arm(uint32_t sleep_time, uint32_t boot_in)
+{
+    uint32_t cal = esp_clk_slowclk_cal_get();
+    uint64_t now = rtc_time_get();
+    uint32_t conversion_us = 0;
+
+    rtc_wake_stub.skipped = 0;
+    rtc_wake_stub.interval = rtc_time_us_to_slowclk(sleep_time * 1000000ULL, cal);
+    rtc_wake_stub.deadline = now + rtc_time_us_to_slowclk(boot_in * 1000000ULL, cal);
+    rtc_wake_stub.armed = boot_in > sleep_time; // At least the first wake can be skipped
+    rtc_wake_stub.converting = 0;
+
+    for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+    {
+        rtc_wake_stub.armed &= rtc_channels[CHANNEL_LIGHT + sensor].valid;
+        if (rtc_bh1750_range[sensor].mode == BH1750_MODE_ONE_TIME && rtc_bh1750_range[sensor].conversion_us > conversion_us)
+            conversion_us = rtc_bh1750_range[sensor].conversion_us;
+    }
+    rtc_wake_stub.conversion = rtc_time_us_to_slowclk(conversion_us, cal); // Ranges only change in the full boot
+}
+
+/**
+ * @brief    Wakes handled by the stub before this full boot
+ *
+ * @return   uint8_t count
+ */
+uint8_t wake_stub_skipped(void)
+{
+    return rtc_wake_stub.skipped;
+}
+
+/**
+ * @brief    Deep sleep wake stub, replaces the default one
+ *
+ */
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+    esp_default_wake_deep_sleep();
+
+    uint64_t now = stub_rtc_time();
+    stub_result_t result = now < rtc_wake_stub.deadline ? wake_stub_check() : STUB_BOOT;
+
+    if (result == STUB_BOOT)
+    {
+        rtc_wake_stub.converting = 0; // The full boot starts its own conversions
+        return;
+    }
+
+    if (result == STUB_CONVERTING)
+    {
+        rtc_wake_stub.converting = 1;
+        rtc_wake_stub.wake = now;
+        stub_sleep(now + rtc_wake_stub.conversion); // Instead of spinning through the conversions
+    }
+
+    if (rtc_wake_stub.converting)
+        now = rtc_wake_stub.wake; // Measurement interval from the wake that started the conversions
+    rtc_wake_stub.converting = 0;
+    rtc_wake_stub.skipped++;
+    if (now + rtc_wake_stub.interval < rtc_wake_stub.deadline)
+        stub_sleep(now + rtc_wake_stub.interval);
+    else
+        stub_sleep(rtc_wake_stub.deadline);
+}
+
+/**
+ * @brief    Checks if the node can go back to sleep without a full boot.
+ *           Flattened, so the decision.h and conversions.h functions are
+ *           inlined in RTC fast memory.
+ *
+ * @return   stub_result_t: STUB_QUIET every light is quiet, STUB_CONVERTING
+ *           one-time conversions started, STUB_BOOT full boot needed
+ */
+static stub_result_t RTC_IRAM_ATTR __attribute__((flatten)) wake_stub_check(void)
+{
+    if (!rtc_wake_stub.armed || rtc_wake_stub.skipped >= WAKE_STUB_SKIP_MAX)
+        return STUB_BOOT;
+    if (!(REG_GET_FIELD(RTC_CNTL_WAKEUP_STATE_REG, RTC_CNTL_WAKEUP_CAUSE) & RTC_TIMER_TRIG_EN))
+        return STUB_BOOT; // Motion
+
+    STUB_PINS_SETUP(I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO);
+#if I2C_SECONDARY_ENABLE
+    STUB_PINS_SETUP(I2C_SECONDARY_SDA_IO, I2C_SECONDARY_SCL_IO);
+#endif
+
+    if (rtc_wake_stub.conversion && !rtc_wake_stub.converting)
+    {
+        for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+        {
+            if (rtc_bh1750_range[sensor].mode == BH1750_MODE_ONE_TIME && !stub_start_light(sensor))
+                return STUB_BOOT;
+        }
+        return STUB_CONVERTING; // Every one-time conversion at once, the sensors power down after it
+    }
+
+    for (uint8_t sensor = 0; sensor < LIGHT_SENSORS; sensor++)
+    {
+        const bh1750_range_t *range = &rtc_bh1750_range[sensor];
+        uint16_t count;
+
+        if (!stub_read_light(sensor, &count))
+            return STUB_BOOT;
+
+        uint32_t lux = bh1750_count_to_lux(count, range->mtreg, range->resolution == BH1750_RES_HIGH2);
+        if (lux < range->lux_min || lux >= range->lux_max)
+            return STUB_BOOT; // Out of the auto-ranging range, switched by the full boot
+
+        if (!decision_is_quiet(&rtc_channels[CHANNEL_LIGHT + sensor], &rtc_settings.decision[CHANNEL_LIGHT + sensor], lux))
+            return STUB_BOOT;
+    }
+
+    return STUB_QUIET;
+}
+
+/**
+ * @brief    RTC time, as rtc_time_get() that is in flash
+ *
+ * @return   uint64_t time [RTC slow clock ticks]
+ */
+static uint64_t RTC_IRAM_ATTR stub_rtc_time(void)
+{
+    SET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_UPDATE);
+    while (GET_PERI_REG_MASK(RTC_CNTL_TIME_UPDATE_REG, RTC_CNTL_TIME_VALID) == 0)
+        ets_delay_us(1); // Takes up to one slow clock period
+    SET_PERI_REG_MASK(RTC_CNTL_INT_CLR_REG, RTC_CNTL_TIME_VALID_INT_CLR);
+
+    return READ_PERI_REG(RTC_CNTL_TIME0_REG) | (uint64_t)READ_PERI_REG(RTC_CNTL_TIME1_REG) << 32;
+}
+
+/**
+ * @brief    Back to deep sleep, with the wakeup sources of the last sleep
+ *
+ * @param    wakeup_time: Timer wakeup [RTC slow clock ticks]
+ */
+static void RTC_IRAM_ATTR stub_sleep(uint64_t wakeup_time)
+{
+    WRITE_PERI_REG(RTC_CNTL_SLP_TIMER0_REG, wakeup_time & UINT32_MAX);
+    WRITE_PERI_REG(RTC_CNTL_SLP_TIMER1_REG, wakeup_time >> 32);
+
+    REG_WRITE(TIMG_WDTFEED_REG(0), 1);                             // Feed the watchdog enabled by the ROM
+    REG_WRITE(RTC_ENTRY_ADDR_REG, (uint32_t)&esp_wake_deep_sleep); // Run the stub again on the next wake
+
+    CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    SET_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_SLEEP_EN);
+    while (1) // Sleep starts within a few cycles
+        ;
+}
+
+/**
+ * @brief    Start a one-time conversion of a BH1750
+ *
+ * @param    sensor: Sensor index in devices.c
+ * @return   uint8_t: 1 on success, 0 otherwise
+ */
+static uint8_t RTC_IRAM_ATTR stub_start_light(uint8_t sensor)
+{
+    const i2c_device_t *device = &bh1750_devices[sensor];
+    const stub_bus_t *bus = &stub_buses[device->port];
+
+    return stub_mux_select(device) &&
+           stub_send_byte(bus, device->address, BH1750_OPCODE_POWER_ON) &&
+           stub_send_byte(bus, device->address, rtc_bh1750_range[sensor].opcode);
+}
+
+/**
+ * @brief    Read the last conversion of a BH1750
+ *
+ * @param    sensor: Sensor index in devices.c
+ * @param    count: Pointer to raw light sensor reading
+ * @return   uint8_t: 1 on success, 0 otherwise
+ */
+static uint8_t RTC_IRAM_ATTR stub_read_light(uint8_t sensor, uint16_t *count)
+{
+    const i2c_device_t *device = &bh1750_devices[sensor];
+    const stub_bus_t *bus = &stub_buses[device->port];
+
+    if (!stub_mux_select(device))
+        return 0;
+
+    stub_i2c_start(bus);
+    uint8_t ack = stub_i2c_write(bus, device->address << 1 | 1);
+    if (ack)
+    {
+        *count = stub_i2c_read(bus, 1) << 8;
+        *count |= stub_i2c_read(bus, 0);
+    }
+    stub_i2c_stop(bus);
+
+    return ack;
+}
+
+/**
+ * @brief    Connect the bus of a device through its multiplexer channel,
+ *           as i2c_mux_select() that is in flash
+ *
+ * @param    device: Pointer to device
+ * @return   uint8_t: 1 on success, 0 otherwise
+ */
+static uint8_t RTC_IRAM_ATTR stub_mux_select(const i2c_device_t *device)
+{
+    const stub_bus_t *bus = &stub_buses[device->port];
+    i2c_mux_state_t *state = &rtc_i2c_mux[device->port];
+
+    if (state->address == device->mux_address &&
+        (device->mux_address == I2C_MUX_NONE || state->channel == device->mux_channel))
+        return 1; // Already connected
+
+    if (state->address != I2C_MUX_NONE && state->address != device->mux_address)
+    {
+        if (!stub_send_byte(bus, state->address, 0)) // Disconnect the other multiplexer
+            return 0;
+        state->address = I2C_MUX_NONE;
+    }
+
+    if (device->mux_address == I2C_MUX_NONE)
+        return 1;
+
+    if (!stub_send_byte(bus, device->mux_address, 1 << device->mux_channel))
+        return 0;
+    state->address = device->mux_address;
+    state->channel = device->mux_channel;
+
+    return 1;
+}
+
+/**
+ * @brief    Write a single byte to a device, a BH1750 command or the
+ *           TCA9548A channels
+ *
+ * @param    bus: Pointer to bus
+ * @param    address: Device address
+ * @param    byte: Byte to write
+ * @return   uint8_t: 1 acknowledged, 0 otherwise
+ */
+static uint8_t RTC_IRAM_ATTR stub_send_byte(const stub_bus_t *bus, uint8_t address, uint8_t byte)
+{
+    stub_i2c_start(bus);
+    uint8_t ack = stub_i2c_write(bus, address << 1) && stub_i2c_write(bus, byte);
+    stub_i2c_stop(bus);
+
+    return ack;
+}
+
+/**
+ * @brief    Drive an I2C line low
+ *
+ * @param    line: Line GPIO mask
+ */
+static void RTC_IRAM_ATTR stub_line_low(uint32_t line)
+{
+    REG_WRITE(GPIO_ENABLE_W1TS_REG, line);
+    ets_delay_us(WAKE_STUB_I2C_DELAY_US);
+}
+
+/**
+ * @brief    Release an I2C line, pulled up
+ *
+ * @param    line: Line GPIO mask
+ */
+static void RTC_IRAM_ATTR stub_line_release(uint32_t line)
+{
+    REG_WRITE(GPIO_ENABLE_W1TC_REG, line);
+    ets_delay_us(WAKE_STUB_I2C_DELAY_US);
+}
+
+/**
+ * @brief    I2C start condition
+ *
+ * @param    bus: Pointer to bus
+ */
+static void RTC_IRAM_ATTR stub_i2c_start(const stub_bus_t *bus)
+{
+    stub_line_release(bus->sda);
+    stub_line_release(bus->scl);
+    stub_line_low(bus->sda);
+    stub_line_low(bus->scl);
+}
+
+/**
+ * @brief    I2C stop condition
+ *
+ * @param    bus: Pointer to bus
+ */
+static void RTC_IRAM_ATTR stub_i2c_stop(const stub_bus_t *bus)
+{
+    stub_line_low(bus->sda);
+    stub_line_release(bus->scl);
+    stub_line_release(bus->sda);
+}
+
+/**
+ * @brief    Write a byte on the I2C bus
+ *
+ * @param    bus: Pointer to bus
+ * @param    byte: Byte to write
+ * @return   uint8_t: 1 acknowledged, 0 otherwise
+ */
+static uint8_t RTC_IRAM_ATTR stub_i2c_write(const stub_bus_t *bus, uint8_t byte)
+{
+    for (uint8_t mask = 0x80; mask; mask >>= 1)
+    {
+        if (byte & mask)
+            stub_line_release(bus->sda);
+        else
+            stub_line_low(bus->sda);
+        stub_line_release(bus->scl);
+        stub_line_low(bus->scl);
+    }
+
+    stub_line_release(bus->sda);
+    stub_line_release(bus->scl);
+    uint8_t ack = !(REG_READ(GPIO_IN_REG) & bus->sda);
+    stub_line_low(bus->scl);
+
+    return ack;
+}
+
+/**
+ * @brief    Read a byte from the I2C bus
+ *
+ * @param    bus: Pointer to bus
+ * @param    ack: 1 to acknowledge the byte, 0 for the last one
+ * @return   uint8_t byte
+ */
+static uint8_t RTC_IRAM_ATTR stub_i2c_read(const stub_bus_t *bus, uint8_t ack)
+{
+    uint8_t byte = 0;
+
+    stub_line_release(bus->sda);
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        stub_line_release(bus->scl);
+        byte = byte << 1 | !!(REG_READ(GPIO_IN_REG) & bus->sda);
+        stub_line_low(bus->scl);
+    }
+
+    if (ack)
+        stub_line_low(bus->sda);
+    stub_line_release(bus->scl);
+    stub_line_low(bus->scl);
+    stub_line_release(bus->sda);
+
+    return byte;
+}
+
+#endif
@@ -8,8 +8,11 @@
  */
 
 // Include libraries
+#include <string.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
@@ -18,29 +21,141 @@
 #include "configuration.h"
 
 #include "wifi.h"
+#include "trace.h"
+
+// Access point and IP lease of the last successful connection
+typedef struct
+{
+    uint8_t valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    tcpip_adapter_ip_info_t ip_info;
+    time_t timestamp; // Time of the last DHCP lease [sec]
+} wifi_cache_t;
 
 // Global variables
-EventGroupHandle_t wifi_event_group;
+EventGroupHandle_t wifi_event_group = NULL;
 uint8_t retry_num = 0;
 uint8_t wifi_already_setup = 0;
+uint8_t wifi_setup_in_background = 0;
+uint8_t wifi_stopped = 0;
+uint8_t wifi_cache_in_use = 0;
+uint8_t wifi_lease_cached = 0;
+wifi_event_sta_connected_t wifi_connected_ap;
+
+// RTC variables
+RTC_DATA_ATTR wifi_cache_t rtc_wifi_cache;
 
 // Private function declarations
 static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+static void wifi_setup_task(void *args);
+esp_err_t wifi_start(void);
 void wifi_init_sta(void);
+void wifi_cache_apply(wifi_config_t *wifi_config);
+void wifi_cache_fallback(void);
+void wifi_cache_store(const tcpip_adapter_ip_info_t *ip_info);
 
 // Functions
 
 /**
- * @brief    Wi-Fi setup
+ * @brief    Wi-Fi setup, waits for a setup already started in background
  * 
  * @return   esp_err_t 
  */
 esp_err_t wifi_setup(void)
 {
+    if (wifi_setup_in_background)
+    {
+        xEventGroupWaitBits(wifi_event_group,
+                            WIFI_SETUP_DONE_BIT,
+                            pdFALSE,
+                            pdFALSE,
+                            portMAX_DELAY); // Wait for background setup
+        wifi_setup_in_background = 0;
+    }
+
+    return wifi_start();
+}
+
+/**
+ * @brief    Wi-Fi setup on the second core, so that the connection can be
+ *           established while the main core reads the sensors
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t wifi_setup_background(void)
+{
+    if (wifi_already_setup || wifi_setup_in_background)
+        return ESP_OK;
+
+    wifi_event_group = xEventGroupCreate(); // create Wi-Fi event group
+    wifi_setup_in_background = 1;
+
+    if (xTaskCreatePinnedToCore(wifi_setup_task,
+                                "wifi_setup",
+                                WIFI_SETUP_TASK_STACK_SIZE,
+                                NULL,
+                                WIFI_SETUP_TASK_PRIORITY,
+                                NULL,
+                                1) != pdPASS)
+    {
+        wifi_setup_in_background = 0;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief    Background Wi-Fi setup task
+ * 
+ * @param    args: Pointer to task arguments
+ */
+static void wifi_setup_task(void *args)
+{
+    ESP_ERROR_CHECK(wifi_start());
+    xEventGroupSetBits(wifi_event_group, WIFI_SETUP_DONE_BIT); // Signal setup completion
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief    Turn off Wi-Fi, used to cancel a connection that is not needed anymore
+ * 
+ * @return   esp_err_t status
+ */
+esp_err_t wifi_stop(void)
+{
+    if (wifi_stopped || (!wifi_already_setup && !wifi_setup_in_background))
+        return ESP_OK;
+
+    wifi_setup(); // Wait for pending setup
+
+    trace_radio_off();
+    wifi_stopped = 1;
+    xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+
+    return esp_wifi_stop();
+}
+
+/**
+ * @brief    Wi-Fi driver start
+ * 
+ * @return   esp_err_t 
+ */
+esp_err_t wifi_start(void)
+{
+    if (wifi_stopped) // Restart after a cancelled connection
+    {
+        trace_radio_on();
+        wifi_stopped = 0;
+        return esp_wifi_start();
+    }
 
     if (wifi_already_setup)
         return ESP_OK;
 
+    trace_phase_begin(TRACE_PHASE_WIFI_SETUP);
+    trace_radio_on();
+
     WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0); // Disable brownout detector
 
     esp_err_t ret = nvs_flash_init();
@@ -52,6 +167,8 @@ esp_err_t wifi_setup(void)
     ESP_ERROR_CHECK(ret);
     wifi_init_sta();
 
+    trace_phase_end(TRACE_PHASE_WIFI_SETUP);
+
     return ret;
 }
 
@@ -70,9 +187,17 @@ static void event_handler(void *args, esp_event_base_t event_base, int32_t event
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) // Station mode enabled event
         esp_wifi_connect();                                           // Connect to Wi-Fi
 
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) // Connected event
+        wifi_connected_ap = *(wifi_event_sta_connected_t *)event_data;         // Save access point details
+
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) // Disconnected event
     {
-        if (retry_num < WIFI_MAXIMUM_RETRY) // If less than maximum connection attempts
+        if (wifi_cache_in_use) // If the cached access point is not reachable
+        {
+            wifi_cache_fallback(); // Retry with a full scan and DHCP
+            esp_wifi_connect();    // Connect to Wi-Fi
+        }
+        else if (retry_num < WIFI_MAXIMUM_RETRY) // If less than maximum connection attempts
         {
             esp_wifi_connect(); // Connect to Wi-Fi
             retry_num++;
@@ -89,6 +214,7 @@ static void event_handler(void *args, esp_event_base_t event_base, int32_t event
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) // IP received event
     {
         retry_num = 0;
+        wifi_cache_store(&((ip_event_got_ip_t *)event_data)->ip_info); // Save connection details for next wakeups
         ret = xEventGroupSetBitsFromISR(wifi_event_group,
                                         WIFI_CONNECTED_BIT,
                                         &higher_priority_task_woken); // Set event bits to signal Wi-Fi connection success
@@ -103,7 +229,8 @@ static void event_handler(void *args, esp_event_base_t event_base, int32_t event
  */
 void wifi_init_sta(void)
 {
-    wifi_event_group = xEventGroupCreate(); // create Wi-Fi event group
+    if (wifi_event_group == NULL)
+        wifi_event_group = xEventGroupCreate(); // create Wi-Fi event group
 
     ESP_ERROR_CHECK(esp_event_loop_create_default()); // Create event loop
 
@@ -138,6 +265,11 @@ void wifi_init_sta(void)
         },
     }; // Setup Wi-Fi config
 
+#if WIFI_FAST_RECONNECT
+    if (rtc_wifi_cache.valid)
+        wifi_cache_apply(&wifi_config); // Directed connection with cached details
+#endif
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));                   // Set Wi-Fi station mode
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config)); // Configure Wi-Fi configuration
     wifi_already_setup = 1;
@@ -152,11 +284,13 @@ void wifi_init_sta(void)
  */
 esp_err_t wifi_event_wait(void)
 {
+    trace_phase_begin(TRACE_PHASE_WIFI_CONNECT);
     EventBits_t bits = xEventGroupWaitBits(wifi_event_group,
                                            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
                                            pdFALSE,
                                            pdFALSE,
                                            WIFI_SETUP_TIMEOUT_MS); // Wait for Wi-Fi event bits
+    trace_phase_end(TRACE_PHASE_WIFI_CONNECT);
 
     // Connected to Wi-Fi
     if (bits & WIFI_CONNECTED_BIT)
@@ -165,6 +299,7 @@ esp_err_t wifi_event_wait(void)
     // Error during Wi-Fi connection
     else if (bits & WIFI_FAIL_BIT)
     {
+        rtc_wifi_cache.valid = 0; // Don't trust cached details on the next wakeup
         printf("Failed to connect to AP %s with password: %s\n", WIFI_SSID, WIFI_PASSWORD);
         return ESP_FAIL;
     }
@@ -172,7 +307,79 @@ esp_err_t wifi_event_wait(void)
     // Timeout for Wi-Fi connection
     else
     {
+        rtc_wifi_cache.valid = 0; // Don't trust cached details on the next wakeup
         printf("Timeout connecting to AP %s\n", WIFI_SSID);
         return ESP_ERR_TIMEOUT;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief    Configure a directed connection to the cached access point
+ *           and the cached IP lease, skipping scan and DHCP
+ * 
+ * @param    wifi_config: Pointer to Wi-Fi configuration
+ */
+void wifi_cache_apply(wifi_config_t *wifi_config)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    wifi_config->sta.bssid_set = 1;
+    memcpy(wifi_config->sta.bssid, rtc_wifi_cache.bssid, sizeof(rtc_wifi_cache.bssid));
+    wifi_config->sta.channel = rtc_wifi_cache.channel;
+
+#if !WIFI_STATIC_IP
+    if (now.tv_sec - rtc_wifi_cache.timestamp < WIFI_CACHE_LEASE_SEC) // If cached lease is still fresh
+    {
+        tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);                                            // Stop DHCP client
+        ESP_ERROR_CHECK(tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &rtc_wifi_cache.ip_info)); // Configure cached IP configuration
+        wifi_lease_cached = 1;
+    }
+#endif
+
+    wifi_cache_in_use = 1;
+}
+
+/**
+ * @brief    Drop cached connection details and go back to full scan and DHCP
+ * 
+ */
+void wifi_cache_fallback(void)
+{
+    wifi_config_t wifi_config;
+
+    rtc_wifi_cache.valid = 0;
+    wifi_cache_in_use = 0;
+    wifi_lease_cached = 0;
+
+    esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config);
+    wifi_config.sta.bssid_set = 0;
+    wifi_config.sta.channel = 0;
+    esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+
+#if !WIFI_STATIC_IP
+    tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA); // Start DHCP client
+#endif
+}
+
+/**
+ * @brief    Save access point and IP lease of the current connection in RTC memory
+ * 
+ * @param    ip_info: Pointer to IP configuration
+ */
+void wifi_cache_store(const tcpip_adapter_ip_info_t *ip_info)
+{
+    if (!wifi_lease_cached) // If lease comes from DHCP
+    {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        rtc_wifi_cache.timestamp = now.tv_sec;
+    }
+
+    memcpy(rtc_wifi_cache.bssid, wifi_connected_ap.bssid, sizeof(rtc_wifi_cache.bssid));
+    rtc_wifi_cache.channel = wifi_connected_ap.channel;
+    rtc_wifi_cache.ip_info = *ip_info;
+    rtc_wifi_cache.valid = 1;
+    wifi_cache_in_use = 0;
+    wifi_lease_cached = 0;
+}
@@ -0,0 +1,413 @@
+/**
+ * @file     battery_replay.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host replay of a recorded sensor trace through the wake cycle
+ *           of main.c, with the settings of configuration.h.
+ *           Timer wakeups read the trace and run decision.h with the
+ *           thresholds of channels.c. The per-wake decisions of wake.h
+ *           plan the sleep interval with SLEEP_ADAPTIVE, flush the batch
+ *           with BATCH_ENABLE and hold the motion state after PIR edges,
+ *           as the firmware does. Each phase is charged with the energy
+ *           model below, measured phase times can be taken from the
+ *           TRACE_ENABLE report and passed with -D.
+ *           Prints wakeups, Wi-Fi sessions and messages per day, the
+ *           charge used by every phase and the projected battery life.
+ *
+ *           Input on stdin, one reading per line:
+ *           timestamp [sec],light [lx],temperature [°C/°F],humidity [%],pir [0/1]
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/battery_replay.c -o battery_replay -lm && ./battery_replay < trace.csv
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "configuration.h"
+#include "typedefs.h"
+#include "decision.h"
+#include "wake.h"
+
+// Energy model, active phase times [ms] and currents [mA]
+#ifndef ENERGY_BOOT_MS
+#define ENERGY_BOOT_MS 35 // Reset to app_main, I2C setup
+#endif
+#ifndef ENERGY_SENSOR_MS
+#define ENERGY_SENSOR_MS 25 // Sensor conversions and reading
+#endif
+#ifndef ENERGY_WIFI_MS
+#if WIFI_FAST_RECONNECT
+#define ENERGY_WIFI_MS 180 // Wi-Fi start, association and cached IP
+#else
+#define ENERGY_WIFI_MS 900 // Wi-Fi start, scan, association and DHCP
+#endif
+#endif
+#ifndef ENERGY_MQTT_SETUP_MS
+#define ENERGY_MQTT_SETUP_MS 40 // Broker connection
+#endif
+#ifndef ENERGY_MESSAGE_MS
+#define ENERGY_MESSAGE_MS 4 // Publish of a single message
+#endif
+#ifndef ENERGY_ACK_WAIT_MS
+#define ENERGY_ACK_WAIT_MS 20 // Ack round trip of a publish window
+#endif
+#ifndef ENERGY_CPU_MA
+#define ENERGY_CPU_MA 40 // CPU awake, radio off
+#endif
+#ifndef ENERGY_RADIO_MA
+#define ENERGY_RADIO_MA 120 // CPU awake, radio on
+#endif
+#ifndef ENERGY_SLEEP_UA
+#define ENERGY_SLEEP_UA 12 // Deep sleep, whole board [uA]
+#endif
+#ifndef ENERGY_BH1750_CONTINUOUS_UA
+#define ENERGY_BH1750_CONTINUOUS_UA 120 // BH1750 converting through deep sleep, BH1750_MODE_CONTINIOUS only [uA]
+#endif
+#ifndef BATTERY_CAPACITY_MAH
+#define BATTERY_CAPACITY_MAH 2500 // Usable battery capacity
+#endif
+
+#define CHANNELS 3
+
+// Same policy and thresholds as channels.c
+static const decision_config_t decisions[CHANNELS] = {
+    {LIGHT_UPDATE_POLICY, LIGHT_UPDATE_THRESHOLD, LIGHT_UPDATE_RELATIVE * 10, SENSOR_UPDATE_INTERVAL_MAX},
+    {TEMPERATURE_UPDATE_POLICY, DECISION_CENTI(TEMPERATURE_UPDATE_THRESHOLD), 0, SENSOR_UPDATE_INTERVAL_MAX},
+    {HUMIDITY_UPDATE_POLICY, DECISION_CENTI(HUMIDITY_UPDATE_THRESHOLD), 0, SENSOR_UPDATE_INTERVAL_MAX},
+};
+
+static const float scales[CHANNELS] = {1, 100, 100}; // Fixed point units per input unit
+
+typedef enum
+{
+    PHASE_WAKE = 0,
+    PHASE_SENSOR,
+    PHASE_WIFI,
+    PHASE_MQTT,
+    PHASE_SLEEP,
+    PHASE_MAX
+} phase_t;
+
+static const char *phase_names[PHASE_MAX] = {"wake", "sensors", "wi-fi", "mqtt", "deep sleep"};
+
+typedef struct
+{
+    time_t timestamp;
+    int32_t value[CHANNELS];
+    uint8_t pir;
+} sample_t;
+
+// Global variables
+sample_t *samples;
+size_t samples_count;
+
+channel_state_t states[CHANNELS];
+wake_rate_t schedule[CHANNELS];
+time_t schedule_next;
+uint8_t batch_count;
+time_t batch_oldest;
+wake_pir_t pir;       // As main.c
+uint8_t pir_reported; // As gpio.c
+uint8_t connected; // Wi-Fi session already open in this wakeup
+
+unsigned long timer_wakeups, pir_wakeups, sessions, messages;
+double awake_ms, charge[PHASE_MAX]; // [mA ms]
+
+// Functions
+
+/**
+ * @brief    Read the trace from stdin
+ *
+ */
+static void read_samples(void)
+{
+    size_t size = 0;
+    long timestamp;
+    float input[CHANNELS];
+    int motion;
+
+    while (scanf("%ld,%f,%f,%f,%d", &timestamp, &input[0], &input[1], &input[2], &motion) == 5)
+    {
+        if (samples_count == size)
+        {
+            size = size ? size * 2 : 1024;
+            samples = realloc(samples, size * sizeof(*samples));
+        }
+
+        samples[samples_count].timestamp = timestamp;
+        for (int id = 0; id < CHANNELS; id++)
+            samples[samples_count].value[id] = lroundf(input[id] * scales[id]);
+        samples[samples_count].pir = motion != 0;
+        samples_count++;
+    }
+}
+
+/**
+ * @brief    Charge a phase
+ *
+ * @param    phase: Phase
+ * @param    ms: Phase time [ms]
+ * @param    ma: Phase current [mA]
+ */
+static void spend(phase_t phase, double ms, double ma)
+{
+    charge[phase] += ms * ma;
+    awake_ms += ms;
+}
+
+/**
+ * @brief    Wi-Fi session publishing some messages, in windows of
+ *           MQTT_WINDOW_SIZE as mqtt.c
+ *
+ * @param    count: Messages to publish
+ */
+static void session(unsigned count)
+{
+    messages += count;
+
+    if (!connected)
+    {
+        sessions++;
+        connected = 1;
+        spend(PHASE_WIFI, ENERGY_WIFI_MS, ENERGY_RADIO_MA);
+        spend(PHASE_MQTT, ENERGY_MQTT_SETUP_MS, ENERGY_RADIO_MA);
+    }
+    spend(PHASE_MQTT, count * ENERGY_MESSAGE_MS, ENERGY_RADIO_MA);
+    spend(PHASE_MQTT, ((count + MQTT_WINDOW_SIZE - 1) / MQTT_WINDOW_SIZE) * ENERGY_ACK_WAIT_MS, ENERGY_RADIO_MA);
+}
+
+#if BATCH_ENABLE
+
+/**
+ * @brief    Messages needed to flush the batch, as batch.c
+ *
+ * @return   unsigned messages
+ */
+static unsigned batch_messages(void)
+{
+#if MQTT_COMBINED_PAYLOAD
+    return batch_count ? 1 : 0;
+#else
+    return batch_count;
+#endif
+}
+
+#endif
+
+/**
+ * @brief    Plan the next timer wakeup, as schedule_plan() or a fixed
+ *           interval
+ *
+ * @param    timestamp: actual timestamp
+ */
+static void plan(time_t timestamp)
+{
+#if SLEEP_ADAPTIVE
+    time_t batch_left = SLEEP_INTERVAL_MAX_SEC;
+
+    if (BATCH_ENABLE && batch_count)
+        batch_left = wake_batch_due_in(batch_count, batch_oldest, BATCH_MAX_LATENCY_SEC, timestamp);
+
+    schedule_next = timestamp + wake_plan(states, decisions, schedule, CHANNELS, batch_left,
+                                          SLEEP_INTERVAL_MIN_SEC, SLEEP_INTERVAL_MAX_SEC, timestamp);
+#else
+    schedule_next = timestamp + SLEEP_INTERVAL_SEC;
+#endif
+}
+
+/**
+ * @brief    Timer wakeup, as check_measurements()
+ *
+ * @param    sample: Trace reading at the wakeup
+ * @param    timestamp: Wakeup timestamp
+ */
+static void timer_wakeup(const sample_t *sample, time_t timestamp)
+{
+    uint8_t needs_update = 0;
+
+    timer_wakeups++;
+    connected = 0;
+    spend(PHASE_WAKE, ENERGY_BOOT_MS, ENERGY_CPU_MA);
+    spend(PHASE_SENSOR, ENERGY_SENSOR_MS, ENERGY_CPU_MA);
+
+    for (int id = 0; id < CHANNELS; id++)
+    {
+        int32_t value = sample->value[id];
+
+        if (decision_update(&states[id], &decisions[id], value, timestamp))
+            needs_update |= 1 << id;
+
+        wake_rate_update(&schedule[id], value, timestamp, SLEEP_RATE_EWMA_SHIFT);
+    }
+
+#if BATCH_ENABLE
+    for (int id = 0; id < CHANNELS; id++)
+    {
+        if (!(needs_update & (1 << id)))
+            continue;
+        if (!batch_count)
+            batch_oldest = states[id].timestamp;
+        if (batch_count < BATCH_SIZE)
+            batch_count++;
+    }
+
+    plan(timestamp);
+
+    if (wake_batch_is_due(batch_count, BATCH_SIZE, batch_oldest, BATCH_MAX_LATENCY_SEC, timestamp))
+    {
+        session(batch_messages());
+        batch_count = 0;
+    }
+#else
+    plan(timestamp);
+
+    if (needs_update)
+    {
+#if MQTT_COMBINED_PAYLOAD
+        session(1);
+#else
+        session(__builtin_popcount(needs_update));
+#endif
+    }
+#endif
+}
+
+/**
+ * @brief    Publish the motion state if it changed, as handle_pir()
+ *
+ * @param    piggyback: Number of channels sent with the motion state
+ */
+static void pir_publish(unsigned piggyback)
+{
+    if (pir.motion == pir_reported)
+        return; // Edge merged into the motion already reported
+    pir_reported = pir.motion;
+
+#if BATCH_ENABLE
+    batch_count += piggyback;
+    session(1 + (MQTT_COMBINED_PAYLOAD ? 0 : batch_messages())); // Combined state carries the stored readings
+    batch_count = 0;
+#else
+    session(1 + (MQTT_COMBINED_PAYLOAD ? 0 : piggyback));
+#endif
+}
+
+/**
+ * @brief    PIR wakeup, as the EXT0 case of app_main()
+ *
+ * @param    sample: Trace reading at the edge
+ */
+static void pir_wakeup(const sample_t *sample)
+{
+    unsigned piggyback = 0;
+
+    pir_wakeups++;
+    connected = 0;
+    spend(PHASE_WAKE, ENERGY_BOOT_MS, ENERGY_CPU_MA);
+
+    wake_pir_edge(&pir, sample->pir, sample->timestamp);
+    wake_pir_expire(&pir, PIR_HOLDOFF_SEC, sample->timestamp); // As pir_is_due()
+
+    if (pir.motion == pir_reported)
+        return;
+
+    for (int id = 0; id < CHANNELS; id++) // As piggyback_measurements()
+    {
+        if (!decision_is_expired(&states[id], decisions[id].interval_max, sample->timestamp + PIR_PIGGYBACK_SEC))
+            continue;
+        if (!piggyback)
+            spend(PHASE_SENSOR, ENERGY_SENSOR_MS, ENERGY_CPU_MA);
+        decision_force(&states[id], &decisions[id], sample->value[id], sample->timestamp);
+        piggyback++;
+    }
+
+    pir_publish(piggyback);
+}
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(void)
+{
+    read_samples();
+    if (samples_count < 2)
+    {
+        fprintf(stderr, "Not enough readings on stdin\n");
+        return 1;
+    }
+
+    time_t start = samples[0].timestamp, end = samples[samples_count - 1].timestamp;
+    time_t now = start; // Last wakeup
+    size_t i = 0;
+
+    // Cold boot, as setup() and mqtt_send_autodiscovery()
+    spend(PHASE_WAKE, ENERGY_BOOT_MS, ENERGY_CPU_MA);
+    session(MQTT_ENABLE_DISCOVERY ? 4 : 0);
+    pir.level = samples[0].pir;
+    for (int id = 0; id < CHANNELS; id++)
+        wake_rate_reset(&schedule[id], decisions[id].threshold, SLEEP_INTERVAL_MIN_SEC);
+    schedule_next = start + (SLEEP_ADAPTIVE ? SLEEP_INTERVAL_MIN_SEC : SLEEP_INTERVAL_SEC);
+
+    for (;;)
+    {
+        // Sleep time as start_deep_sleep()
+        uint32_t sleep_time = SLEEP_ADAPTIVE ? wake_sleep_time(schedule_next, SLEEP_INTERVAL_MAX_SEC, now) : schedule_next - now;
+        time_t wakeup = now + wake_pir_sleep_time(&pir, PIR_HOLDOFF_SEC, now, sleep_time);
+        if (wakeup > end)
+            break;
+
+        size_t edge = i;
+        while (edge < samples_count && samples[edge].timestamp <= wakeup && samples[edge].pir == pir.level)
+            edge++;
+
+        if (edge < samples_count && samples[edge].timestamp <= wakeup) // PIR changes before the timer
+        {
+            i = edge;
+            now = samples[edge].timestamp;
+            pir_wakeup(&samples[edge]);
+#if !SLEEP_ADAPTIVE
+            schedule_next = samples[edge].timestamp + SLEEP_INTERVAL_SEC; // Fixed interval restarts after every wakeup
+#endif
+            continue;
+        }
+
+        while (i + 1 < samples_count && samples[i + 1].timestamp <= wakeup)
+            i++;
+        now = wakeup;
+        timer_wakeup(&samples[i], wakeup);
+
+        wake_pir_expire(&pir, PIR_HOLDOFF_SEC, wakeup);
+        pir_publish(0);
+    }
+
+    double days = (end - start) / 86400.0;
+    double seconds = end - start;
+    double sleep_ua = ENERGY_SLEEP_UA + (BH1750_MODE == BH1750_MODE_CONTINIOUS ? ENERGY_BH1750_CONTINUOUS_UA : 0);
+    charge[PHASE_SLEEP] = (seconds * 1000 - awake_ms) * sleep_ua / 1000.0;
+
+    double total = 0;
+    for (int phase = 0; phase < PHASE_MAX; phase++)
+        total += charge[phase];
+    double average_ma = total / (seconds * 1000);
+
+    printf("trace: %.2f days, %zu readings\n", days, samples_count);
+    printf("timer wakeups/day:  %10.1f\n", timer_wakeups / days);
+    printf("pir wakeups/day:    %10.1f\n", pir_wakeups / days);
+    printf("wi-fi sessions/day: %10.1f\n", sessions / days);
+    printf("messages/day:       %10.1f\n", messages / days);
+    printf("awake time/day:     %10.1f s\n", awake_ms / 1000 / days);
+    printf("charge/day:\n");
+    for (int phase = 0; phase < PHASE_MAX; phase++)
+        printf("  %-16s %10.2f mAh\n", phase_names[phase], charge[phase] / 3600000.0 / days);
+    printf("average current:    %10.3f mA\n", average_ma);
+    printf("battery life:       %10.1f days (%d mAh)\n", BATTERY_CAPACITY_MAH / average_ma / 24, BATTERY_CAPACITY_MAH);
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file     conversion_bench.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host benchmark of the fixed point conversions in conversions.h.
+ *           Sweeps every 16 bit code, reports the maximum error against the
+ *           datasheet formulas and the time per conversion of both paths.
+ *           Timings are host timings, useful to compare the two paths,
+ *           not as absolute ESP32 figures.
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/conversion_bench.c -o conversion_bench -lm && ./conversion_bench
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "conversions.h"
+
+#define SWEEPS 200 // Full code sweeps per timing run
+
+// Global variables
+volatile int32_t sink_int;
+volatile double sink_double;
+
+// Reference conversions, as in the original driver
+static double reference_rh(const uint16_t code) { return (((125.0 * code) / 65536.0) - 6.0); }
+static double reference_celsius(const uint16_t code) { return (((175.72 * code) / 65536.0) - 46.85); }
+static double reference_fahrenheit(const uint16_t code) { return (((175.72 * code) / 65536.0) - 46.85) * 1.8 + 32; }
+static double reference_lux(const uint16_t count) { return count / 1.2; }
+
+// Fixed point conversions, adapted to a common signature
+static int32_t fixed_rh(const uint16_t code) { return si7021_code_to_rh_centi(code); }
+static int32_t fixed_celsius(const uint16_t code) { return si7021_code_to_celsius_centi(code); }
+static int32_t fixed_fahrenheit(const uint16_t code) { return si7021_code_to_fahrenheit_centi(code); }
+static int32_t fixed_lux(const uint16_t count) { return bh1750_count_to_lux(count, BH1750_MTREG_DEFAULT, 0); }
+
+typedef struct
+{
+    const char *name;
+    double (*reference)(uint16_t);
+    int32_t (*fixed)(uint16_t);
+    float scale; // Fixed point units per reference unit
+} conversion_t;
+
+static const conversion_t conversions[] = {
+    {"si7021 humidity", reference_rh, fixed_rh, 100},
+    {"si7021 celsius", reference_celsius, fixed_celsius, 100},
+    {"si7021 fahrenheit", reference_fahrenheit, fixed_fahrenheit, 100},
+    {"bh1750 lux", reference_lux, fixed_lux, 1},
+};
+
+// Functions
+
+/**
+ * @brief    Monotonic time
+ *
+ * @return   double time [ns]
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief    Maximum absolute error of the fixed point path over every code
+ *
+ * @param    conversion: Conversion to check
+ * @return   double error [fixed point units]
+ */
+static double max_error(const conversion_t *conversion)
+{
+    double max = 0;
+
+    for (uint32_t code = 0; code <= UINT16_MAX; code++)
+    {
+        double expected = conversion->reference(code) * conversion->scale;
+        double error = fabs(conversion->fixed(code) - expected);
+        if (error > max)
+            max = error;
+    }
+    return max;
+}
+
+/**
+ * @brief    Time per conversion of the reference path
+ *
+ * @param    conversion: Conversion to time
+ * @return   double time [ns]
+ */
+static double time_reference(const conversion_t *conversion)
+{
+    double start = now_ns();
+    for (int sweep = 0; sweep < SWEEPS; sweep++)
+        for (uint32_t code = 0; code <= UINT16_MAX; code++)
+            sink_double = conversion->reference(code);
+    return (now_ns() - start) / (SWEEPS * 65536.0);
+}
+
+/**
+ * @brief    Time per conversion of the fixed point path
+ *
+ * @param    conversion: Conversion to time
+ * @return   double time [ns]
+ */
+static double time_fixed(const conversion_t *conversion)
+{
+    double start = now_ns();
+    for (int sweep = 0; sweep < SWEEPS; sweep++)
+        for (uint32_t code = 0; code <= UINT16_MAX; code++)
+            sink_int = conversion->fixed(code);
+    return (now_ns() - start) / (SWEEPS * 65536.0);
+}
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(void)
+{
+    printf("%-18s %12s %14s %14s\n", "conversion", "max error", "reference ns", "fixed ns");
+
+    for (size_t i = 0; i < sizeof(conversions) / sizeof(conversions[0]); i++)
+    {
+        const conversion_t *conversion = &conversions[i];
+        printf("%-18s %12.3f %14.2f %14.2f\n",
+               conversion->name,
+               max_error(conversion),
+               time_reference(conversion),
+               time_fixed(conversion));
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file     decision_check.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host check of decision.h against the bounds it documents.
+ *           Random walks go through every report policy, and the trace
+ *           the receiver rebuilds from the reports is compared with the
+ *           measurements:
+ *           - DELTA, RELATIVE, HYSTERESIS: the last report held, within
+ *             the threshold of decision_threshold() at every sample
+ *           - HYSTERESIS: never DECISION_HYSTERESIS_SAMPLES samples in a
+ *             row beyond half threshold after the update
+ *           - SWINGING_DOOR: the reports linearly interpolated at their
+ *             timestamps, within threshold + 1/2 unit at every sample
+ *           At every sample a quiet sample, decision_is_quiet() as run
+ *           alone by the deep sleep wake stub, is also never reported by
+ *           decision_update, and leaves the same state apart from the
+ *           last sample.
+ *           Exits with 1 on the first violation.
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/decision_check.c -o decision_check -lm && ./decision_check
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "decision.h"
+
+#define RUNS 2000   // Random walks per policy
+#define SAMPLES 500 // Samples per walk
+
+typedef struct
+{
+    int32_t value;
+    time_t timestamp;
+} point_t;
+
+// Global variables
+point_t samples[SAMPLES + 1];
+point_t reports[SAMPLES + 2];
+
+// Functions
+
+/**
+ * @brief    Check the swinging door reconstruction of a walk, the
+ *           reports linearly interpolated at every sample
+ *
+ * @param    threshold: Door width [fixed point units]
+ * @param    sample_count: Number of samples
+ * @param    report_count: Number of reports, the last one at the last sample
+ * @return   int sample index of the first violation, -1 if none
+ */
+static int check_door(int32_t threshold, int sample_count, int report_count)
+{
+    int report = 0;
+
+    for (int i = 0; i < sample_count; i++)
+    {
+        while (report + 1 < report_count - 1 && reports[report + 1].timestamp < samples[i].timestamp)
+            report++;
+
+        const point_t *a = &reports[report], *b = &reports[report + 1];
+        double reconstructed = a->value;
+        if (b->timestamp > a->timestamp)
+            reconstructed += (double)(b->value - a->value) * (samples[i].timestamp - a->timestamp) / (b->timestamp - a->timestamp);
+
+        if (samples[i].timestamp < a->timestamp || samples[i].timestamp > b->timestamp ||
+            fabs(samples[i].value - reconstructed) > threshold + 0.5)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief    Compare the states, apart from the last sample
+ *
+ */
+static int same_report_state(const channel_state_t *a, const channel_state_t *b)
+{
+    return a->value == b->value && a->timestamp == b->timestamp &&
+           a->slope_upper == b->slope_upper && a->slope_lower == b->slope_lower &&
+           a->pending == b->pending && a->valid == b->valid;
+}
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(void)
+{
+    static const char *const names[] = {"delta", "relative", "hysteresis", "swinging door"};
+    unsigned long quiet_total = 0, samples_total = 0, reports_total = 0;
+
+    srand(1);
+
+    for (int policy = DECISION_POLICY_DELTA; policy <= DECISION_POLICY_SWINGING_DOOR; policy++)
+    {
+        unsigned long quiet = 0, report_sum = 0;
+
+        for (int run = 0; run < RUNS; run++)
+        {
+            decision_config_t config = {
+                .policy = policy,
+                .threshold = rand() % 200,
+                .relative_permille = rand() % 300,
+                .interval_max = 1 << 30, // Expiry only adds reports
+            };
+            channel_state_t state = {0};
+            int32_t value = rand() % 20000 - 10000;
+            int32_t step = 1 + rand() % 100;
+            time_t timestamp = 0;
+            int report_count = 0, beyond_half = 0;
+
+            decision_force(&state, &config, value, timestamp);
+            samples[0] = (point_t){value, timestamp};
+            reports[report_count++] = (point_t){state.value, state.timestamp};
+
+            for (int i = 1; i <= SAMPLES; i++)
+            {
+                value += rand() % (2 * step + 1) - step;
+                timestamp += 1 + rand() % 60;
+                samples[i] = (point_t){value, timestamp};
+
+                channel_state_t stub = state;
+                uint8_t is_quiet = decision_is_quiet(&stub, &config, value);
+                uint8_t report = decision_update(&state, &config, value, timestamp);
+
+                if (is_quiet && (report || !same_report_state(&stub, &state)))
+                {
+                    printf("%s: quiet sample %ld reported at sample %d of run %d\n", names[policy], (long)value, i, run);
+                    return 1;
+                }
+                quiet += is_quiet;
+
+                if (report)
+                    reports[report_count++] = (point_t){state.value, state.timestamp};
+                if (policy == DECISION_POLICY_SWINGING_DOOR)
+                    continue; // Checked once the walk is over, the reports are in the past
+
+                int32_t error = abs(value - state.value);
+                if (error > decision_threshold(&config, state.value))
+                {
+                    printf("%s: error %ld beyond the threshold at sample %d of run %d\n", names[policy], (long)error, i, run);
+                    return 1;
+                }
+
+                beyond_half = error > config.threshold / 2 ? beyond_half + 1 : 0;
+                if (policy == DECISION_POLICY_HYSTERESIS && beyond_half >= DECISION_HYSTERESIS_SAMPLES)
+                {
+                    printf("%s: %d samples beyond half threshold at sample %d of run %d\n", names[policy], beyond_half, i, run);
+                    return 1;
+                }
+            }
+
+            if (policy == DECISION_POLICY_SWINGING_DOOR)
+            {
+                decision_force(&state, &config, value, timestamp); // Close the open segment at the last sample
+                if (state.timestamp != reports[report_count - 1].timestamp)
+                    reports[report_count++] = (point_t){state.value, state.timestamp};
+
+                int i = check_door(config.threshold, SAMPLES + 1, report_count);
+                if (i >= 0)
+                {
+                    printf("%s: reconstruction beyond threshold + 1/2 at sample %d of run %d\n", names[policy], i, run);
+                    return 1;
+                }
+            }
+            report_sum += report_count;
+        }
+
+        printf("%-14s %5.1f%% of samples quiet, %5.1f%% reported\n", names[policy],
+               100.0 * quiet / (RUNS * SAMPLES), 100.0 * report_sum / (RUNS * (SAMPLES + 1)));
+        quiet_total += quiet;
+        samples_total += RUNS * SAMPLES;
+        reports_total += report_sum;
+    }
+
+    printf("ok, %lu of %lu samples quiet, %lu reports\n", quiet_total, samples_total, reports_total);
+    return 0;
+}
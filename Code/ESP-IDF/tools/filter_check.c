@@ -0,0 +1,109 @@
+/**
+ * @file     filter_check.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host check of the burst filters of filter.h. Random bursts
+ *           with a single outlier, high or low at any position, go
+ *           through every filter and burst size from 3 readings, and
+ *           through the filters and burst sizes of configuration.h:
+ *           - the measurement stays within the readings without the
+ *             outlier, the outlier is dropped
+ *           Exits with 1 on the first mismatch.
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/filter_check.c -o filter_check && ./filter_check
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "configuration.h"
+#include "filter.h"
+
+#define RUNS 2000       // Random bursts per filter and burst size
+#define COUNT_MAX 16    // Largest burst size checked
+#define SPREAD 50       // Spread of the readings [fixed point units]
+#define OUTLIER 100000  // Outlier offset [fixed point units]
+
+typedef struct
+{
+    const char *name;
+    filter_t filter;
+    uint8_t count;
+} check_channel_t;
+
+static const check_channel_t check_channels[] = {
+    {"light", LIGHT_FILTER, LIGHT_OVERSAMPLE},
+    {"temperature", TEMPERATURE_FILTER, TEMPERATURE_OVERSAMPLE},
+    {"humidity", HUMIDITY_FILTER, HUMIDITY_OVERSAMPLE},
+};
+
+// Functions
+
+/**
+ * @brief    Check random bursts with a single outlier
+ *
+ * @param    filter: Filter
+ * @param    count: Number of readings, at least 3
+ * @return   int 0 if the outlier is always dropped, 1 otherwise
+ */
+static int check_outlier(filter_t filter, uint8_t count)
+{
+    for (int run = 0; run < RUNS; run++)
+    {
+        int32_t samples[COUNT_MAX];
+        int32_t base = rand() % 20001 - 10000;
+        int32_t low = INT32_MAX, high = INT32_MIN;
+        uint8_t outlier = rand() % count;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            samples[i] = base + rand() % (2 * SPREAD + 1) - SPREAD;
+            if (i == outlier)
+                continue;
+            if (samples[i] < low)
+                low = samples[i];
+            if (samples[i] > high)
+                high = samples[i];
+        }
+        samples[outlier] = base + (run % 2 ? OUTLIER : -OUTLIER);
+
+        int32_t measurement = filter_apply(filter, samples, count);
+        if (measurement < low || measurement > high)
+        {
+            printf("%s of %u readings: %d outside %d..%d\n", filter == FILTER_MEDIAN ? "median" : "trimmed mean",
+                   count, measurement, low, high);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    srand(1);
+
+    for (filter_t filter = FILTER_MEDIAN; filter <= FILTER_TRIMMED_MEAN; filter++)
+        for (uint8_t count = 3; count <= COUNT_MAX; count++)
+            if (check_outlier(filter, count))
+                return 1;
+
+    for (size_t i = 0; i < sizeof(check_channels) / sizeof(check_channels[0]); i++)
+    {
+        if (check_channels[i].count < 3)
+        {
+            printf("%s: %u readings, no outlier rejection\n", check_channels[i].name, check_channels[i].count);
+            continue;
+        }
+        if (check_outlier(check_channels[i].filter, check_channels[i].count))
+            return 1;
+        printf("%s: outlier dropped\n", check_channels[i].name);
+    }
+
+    printf("Filter check passed\n");
+    return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file     flashlog_host.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host run of flashlog.c on a file, standing in for the flash
+ *           partition. Writes can only clear bits and erases set a whole
+ *           sector to 0xFF, as on NOR flash, so the file is also a valid
+ *           partition image. Commands on stdin, one per line:
+ *           a timestamp,channel,value  append a record
+ *           p count                    print the oldest pending records
+ *           c count                    mark the oldest pending records as sent
+ *           o                          reopen, as after a reset
+ *           Prints the log positions after every command.
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/flashlog_host.c src/flashlog.c -o flashlog_host && ./flashlog_host log.bin 16 < commands.txt
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "flashlog.h"
+
+#define PEEK_MAX 64
+
+// Global variables
+unsigned long erases;
+
+// Functions
+
+/**
+ * @brief    Read from the file
+ *
+ */
+static int file_read(void *context, uint32_t offset, void *data, size_t len)
+{
+    FILE *file = context;
+
+    if (fseek(file, offset, SEEK_SET) != 0 || fread(data, 1, len, file) != len)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief    Program the file, bits can only be cleared
+ *
+ */
+static int file_write(void *context, uint32_t offset, const void *data, size_t len)
+{
+    FILE *file = context;
+    uint8_t old[FLASHLOG_SECTOR_SIZE];
+    const uint8_t *bytes = data;
+
+    if (len > sizeof(old) || file_read(context, offset, old, len) != 0)
+        return -1;
+    for (size_t i = 0; i < len; i++)
+        old[i] &= bytes[i];
+
+    if (fseek(file, offset, SEEK_SET) != 0 || fwrite(old, 1, len, file) != len)
+        return -1;
+    return fflush(file);
+}
+
+/**
+ * @brief    Erase a sector of the file
+ *
+ */
+static int file_erase(void *context, uint32_t offset)
+{
+    FILE *file = context;
+    uint8_t blank[FLASHLOG_SECTOR_SIZE];
+
+    for (size_t i = 0; i < sizeof(blank); i++)
+        blank[i] = 0xFF;
+
+    erases++;
+    if (fseek(file, offset, SEEK_SET) != 0 || fwrite(blank, 1, sizeof(blank), file) != sizeof(blank))
+        return -1;
+    return fflush(file);
+}
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s file sectors\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t size = atoi(argv[2]) * FLASHLOG_SECTOR_SIZE;
+    FILE *file = fopen(argv[1], "r+b");
+    if (!file) // New blank image
+    {
+        file = fopen(argv[1], "w+b");
+        for (uint32_t offset = 0; file && offset < size; offset += FLASHLOG_SECTOR_SIZE)
+            file_erase(file, offset);
+        erases = 0;
+    }
+    if (!file)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    flashlog_storage_t storage = {file_read, file_write, file_erase, file, size};
+    flashlog_record_t records[PEEK_MAX];
+    flashlog_t log;
+    char command;
+
+    if (flashlog_open(&log, &storage) != 0)
+    {
+        fprintf(stderr, "Open failed\n");
+        return 1;
+    }
+
+    while (scanf(" %c", &command) == 1)
+    {
+        unsigned long timestamp, count;
+        unsigned channel;
+        long value;
+        int ret = 0;
+
+        switch (command)
+        {
+        case 'a':
+            if (scanf("%lu,%u,%ld", &timestamp, &channel, &value) != 3)
+                return 1;
+            ret = flashlog_append(&log, &storage, &(flashlog_record_t){timestamp, value, channel});
+            break;
+
+        case 'p':
+            if (scanf("%lu", &count) != 1)
+                return 1;
+            count = flashlog_peek(&log, &storage, records, count < PEEK_MAX ? count : PEEK_MAX);
+            for (unsigned long i = 0; i < count; i++)
+                printf("%lu,%u,%ld\n", (unsigned long)records[i].timestamp, records[i].channel, (long)records[i].value);
+            break;
+
+        case 'c':
+            if (scanf("%lu", &count) != 1)
+                return 1;
+            ret = flashlog_consume(&log, &storage, count);
+            break;
+
+        case 'o':
+            ret = flashlog_open(&log, &storage);
+            break;
+
+        default:
+            fprintf(stderr, "Unknown command %c\n", command);
+            return 1;
+        }
+
+        printf("%c: %s head %lu tail %lu seq %lu pending %lu erases %lu\n",
+               command,
+               ret ? "failed" : "ok",
+               (unsigned long)log.head,
+               (unsigned long)log.tail,
+               (unsigned long)log.head_seq,
+               (unsigned long)log.count,
+               erases);
+    }
+
+    fclose(file);
+    return 0;
+}
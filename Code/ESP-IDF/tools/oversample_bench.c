@@ -0,0 +1,226 @@
+/**
+ * @file     oversample_bench.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host benchmark of burst oversampling, filter.h, against
+ *           noise-driven publishes. The recorded trace is the signal,
+ *           every reading of a burst adds the noise model below: Gaussian
+ *           noise, mains flicker on the light level sampled at a random
+ *           phase, and rare outliers. For every channel, burst size and
+ *           filter the filtered measurements go through decision.h with
+ *           the policy and thresholds of configuration.h, and are compared
+ *           with the trace replayed without noise.
+ *           Prints publishes per day, false publishes per day (publishes
+ *           beyond those of the trace without noise) and the awake time
+ *           the burst adds to every wake. Light readings of a burst are a
+ *           BH1750 conversion apart, as needed for OVERSAMPLE_INTERVAL_US.
+ *
+ *           Input on stdin, one reading per line:
+ *           timestamp [sec],light [lx],temperature [°C/°F],humidity [%]
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/oversample_bench.c -o oversample_bench -lm && ./oversample_bench < readings.csv
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "configuration.h"
+#include "decision.h"
+#include "filter.h"
+
+// Noise model, standard deviations in input units
+#ifndef NOISE_LIGHT
+#define NOISE_LIGHT 1.0 // Light noise [lx]
+#endif
+#ifndef NOISE_LIGHT_FLICKER
+#define NOISE_LIGHT_FLICKER 0.03 // Mains flicker amplitude, fraction of the light level
+#endif
+#ifndef NOISE_TEMPERATURE
+#define NOISE_TEMPERATURE 0.03 // Temperature noise [°C/°F]
+#endif
+#ifndef NOISE_HUMIDITY
+#define NOISE_HUMIDITY 0.4 // Humidity noise [%]
+#endif
+#ifndef NOISE_OUTLIER_PERMILLE
+#define NOISE_OUTLIER_PERMILLE 5 // Readings off by 10 standard deviations [1/1000]
+#endif
+
+// Reading times of a burst [us]
+#ifndef READING_SI7021_US
+#define READING_SI7021_US 23000 // Humidity and temperature conversion, Si7021 high resolution
+#endif
+#ifndef READING_BH1750_US
+#define READING_BH1750_US 120000 // Light conversion, BH1750 high resolution
+#endif
+
+#define CHANNELS 3
+#define BURSTS 4 // Burst sizes compared
+
+typedef struct
+{
+    const char *name;
+    decision_config_t decision; // Same policy and thresholds as channels.c
+    float scale;                // Fixed point units per input unit
+    double noise;               // Standard deviation [input units]
+    double flicker;             // Flicker amplitude, fraction of the value
+    uint32_t reading_us;        // Time between readings of a burst
+} bench_channel_t;
+
+static const bench_channel_t bench_channels[CHANNELS] = {
+    {"light", {LIGHT_UPDATE_POLICY, LIGHT_UPDATE_THRESHOLD, LIGHT_UPDATE_RELATIVE * 10, SENSOR_UPDATE_INTERVAL_MAX}, 1, NOISE_LIGHT, NOISE_LIGHT_FLICKER, READING_BH1750_US},
+    {"temperature", {TEMPERATURE_UPDATE_POLICY, DECISION_CENTI(TEMPERATURE_UPDATE_THRESHOLD), 0, SENSOR_UPDATE_INTERVAL_MAX}, 100, NOISE_TEMPERATURE, 0, READING_SI7021_US},
+    {"humidity", {HUMIDITY_UPDATE_POLICY, DECISION_CENTI(HUMIDITY_UPDATE_THRESHOLD), 0, SENSOR_UPDATE_INTERVAL_MAX}, 100, NOISE_HUMIDITY, 0, READING_SI7021_US},
+};
+
+static const uint8_t bursts[BURSTS] = {1, 3, 5, 7};
+static const char *filter_names[] = {"median", "trimmed mean"};
+
+// Global variables
+time_t *timestamps;
+double *values[CHANNELS];
+size_t samples_count;
+
+// Functions
+
+/**
+ * @brief    Read the readings from stdin
+ *
+ */
+static void read_samples(void)
+{
+    size_t size = 0;
+    long timestamp;
+    double input[CHANNELS];
+
+    while (scanf("%ld,%lf,%lf,%lf", &timestamp, &input[0], &input[1], &input[2]) == 4)
+    {
+        if (samples_count == size)
+        {
+            size = size ? size * 2 : 1024;
+            timestamps = realloc(timestamps, size * sizeof(*timestamps));
+            for (int id = 0; id < CHANNELS; id++)
+                values[id] = realloc(values[id], size * sizeof(*values[id]));
+        }
+
+        timestamps[samples_count] = timestamp;
+        for (int id = 0; id < CHANNELS; id++)
+            values[id][samples_count] = input[id];
+        samples_count++;
+    }
+}
+
+/**
+ * @brief    Standard normal random number, Box-Muller
+ *
+ */
+static double gaussian(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/**
+ * @brief    One noisy reading of a channel
+ *
+ * @param    channel: Pointer to channel
+ * @param    value: Signal [input units]
+ * @return   int32_t reading [fixed point units]
+ */
+static int32_t reading(const bench_channel_t *channel, double value)
+{
+    double noise = channel->noise * gaussian();
+
+    if (rand() % 1000 < NOISE_OUTLIER_PERMILLE)
+        noise = channel->noise * (rand() % 2 ? 10 : -10);
+
+    value += noise + value * channel->flicker * sin(2 * M_PI * rand() / RAND_MAX);
+    return lround(value * channel->scale);
+}
+
+/**
+ * @brief    Publishes of a channel through the decision of configuration.h
+ *
+ * @param    id: Channel
+ * @param    burst: Readings per measurement, 0 for the trace without noise
+ * @param    filter: Filter of the readings
+ * @return   size_t publishes
+ */
+static size_t replay(int id, uint8_t burst, filter_t filter)
+{
+    const bench_channel_t *channel = &bench_channels[id];
+    channel_state_t state = {0};
+    int32_t samples[255];
+    size_t publishes = 0;
+
+    for (size_t i = 0; i < samples_count; i++)
+    {
+        int32_t value;
+
+        if (burst == 0)
+            value = lround(values[id][i] * channel->scale);
+        else
+        {
+            for (uint8_t j = 0; j < burst; j++)
+                samples[j] = reading(channel, values[id][i]);
+            value = filter_apply(filter, samples, burst);
+        }
+
+        publishes += decision_update(&state, &channel->decision, value, timestamps[i]);
+    }
+    return publishes;
+}
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(void)
+{
+    read_samples();
+    if (samples_count == 0)
+    {
+        fprintf(stderr, "No readings on stdin\n");
+        return 1;
+    }
+
+    double days = (timestamps[samples_count - 1] - timestamps[0]) / 86400.0;
+    if (days <= 0)
+        days = 1;
+
+    printf("%-12s %-13s %5s %14s %12s %14s\n", "channel", "filter", "burst", "publishes/day", "false/day", "awake ms/wake");
+    for (int id = 0; id < CHANNELS; id++)
+    {
+        double reference = replay(id, 0, FILTER_MEDIAN) / days;
+
+        printf("%-12s %-13s %5s %14.1f %12s %14s\n", bench_channels[id].name, "no noise", "-", reference, "-", "-");
+        for (filter_t filter = FILTER_MEDIAN; filter <= FILTER_TRIMMED_MEAN; filter++)
+        {
+            for (int b = 0; b < BURSTS; b++)
+            {
+                if (bursts[b] == 1 && filter != FILTER_MEDIAN)
+                    continue; // Single reading, nothing to filter
+
+                srand(1); // Same noise for every filter
+                double publishes = replay(id, bursts[b], filter) / days;
+
+                printf("%-12s %-13s %5d %14.1f %12.1f %14.1f\n",
+                       bench_channels[id].name,
+                       bursts[b] == 1 ? "none" : filter_names[filter],
+                       bursts[b],
+                       publishes,
+                       publishes - reference,
+                       (bursts[b] - 1) * bench_channels[id].reading_us / 1000.0);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file     policy_replay.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host replay of recorded readings through every report policy
+ *           of decision.h, with the thresholds of configuration.h.
+ *           For every channel and policy prints the publishes per day and
+ *           the maximum error between the readings and what a receiver
+ *           reconstructs from the reports: last report held, or reports
+ *           linearly interpolated for the swinging door. The error is
+ *           measured up to the last report of each run.
+ *
+ *           Input on stdin, one reading per line:
+ *           timestamp [sec],light [lx],temperature [°C/°F],humidity [%]
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/policy_replay.c -o policy_replay -lm && ./policy_replay < readings.csv
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "configuration.h"
+#include "decision.h"
+
+#define CHANNELS 3
+
+typedef struct
+{
+    const char *name;
+    int32_t threshold;          // [fixed point units]
+    uint16_t relative_permille; // RELATIVE policy threshold
+    float scale;                // Fixed point units per input unit
+} replay_channel_t;
+
+static const replay_channel_t replay_channels[CHANNELS] = {
+    {"light", LIGHT_UPDATE_THRESHOLD, LIGHT_UPDATE_RELATIVE * 10, 1},
+    {"temperature", DECISION_CENTI(TEMPERATURE_UPDATE_THRESHOLD), 0, 100},
+    {"humidity", DECISION_CENTI(HUMIDITY_UPDATE_THRESHOLD), 0, 100},
+};
+
+static const char *policy_names[] = {"delta", "relative", "hysteresis", "swinging door"};
+
+typedef struct
+{
+    time_t timestamp;
+    int32_t value;
+} point_t;
+
+// Global variables
+time_t *timestamps;
+int32_t *values[CHANNELS];
+point_t *reports;
+size_t samples_count;
+
+// Functions
+
+/**
+ * @brief    Read the readings from stdin
+ *
+ */
+static void read_samples(void)
+{
+    size_t size = 0;
+    long timestamp;
+    float input[CHANNELS];
+
+    while (scanf("%ld,%f,%f,%f", &timestamp, &input[0], &input[1], &input[2]) == 4)
+    {
+        if (samples_count == size)
+        {
+            size = size ? size * 2 : 1024;
+            timestamps = realloc(timestamps, size * sizeof(*timestamps));
+            for (int id = 0; id < CHANNELS; id++)
+                values[id] = realloc(values[id], size * sizeof(*values[id]));
+        }
+
+        timestamps[samples_count] = timestamp;
+        for (int id = 0; id < CHANNELS; id++)
+            values[id][samples_count] = lroundf(input[id] * replay_channels[id].scale);
+        samples_count++;
+    }
+    reports = malloc((samples_count + 1) * sizeof(*reports));
+}
+
+/**
+ * @brief    Value seen by the receiver at a given time
+ *
+ * @param    policy: Report policy
+ * @param    report: Pointer to the last report not after timestamp
+ * @param    timestamp: Reconstruction timestamp
+ * @return   double reconstructed value [fixed point units]
+ */
+static double reconstruct(decision_policy_t policy, const point_t *report, time_t timestamp)
+{
+    const point_t *next = report + 1;
+
+    if (policy != DECISION_POLICY_SWINGING_DOOR || timestamp == report->timestamp)
+        return report->value;
+
+    return report->value + (double)(next->value - report->value) * (timestamp - report->timestamp) / (next->timestamp - report->timestamp);
+}
+
+/**
+ * @brief    Replay a channel through a policy
+ *
+ * @param    id: Channel
+ * @param    policy: Report policy
+ */
+static void replay(int id, decision_policy_t policy)
+{
+    const replay_channel_t *channel = &replay_channels[id];
+    decision_config_t config = {policy, channel->threshold, channel->relative_permille, SENSOR_UPDATE_INTERVAL_MAX};
+    channel_state_t state = {0};
+    size_t reports_count = 0;
+    double error_max = 0;
+
+    for (size_t i = 0; i < samples_count; i++)
+        if (decision_update(&state, &config, values[id][i], timestamps[i]))
+            reports[reports_count++] = (point_t){state.timestamp, state.value};
+
+    for (size_t i = 0, report = 0; reports_count && i < samples_count; i++)
+    {
+        if (timestamps[i] > reports[reports_count - 1].timestamp)
+            break;
+        while (report + 1 < reports_count && reports[report + 1].timestamp <= timestamps[i])
+            report++;
+
+        double error = fabs(values[id][i] - reconstruct(policy, &reports[report], timestamps[i]));
+        if (error > error_max)
+            error_max = error;
+    }
+
+    double days = (timestamps[samples_count - 1] - timestamps[0]) / 86400.0;
+    printf("%-12s %-14s %14.1f %12.2f\n",
+           channel->name,
+           policy_names[policy],
+           days > 0 ? reports_count / days : (double)reports_count,
+           error_max / channel->scale);
+}
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(void)
+{
+    read_samples();
+    if (samples_count == 0)
+    {
+        fprintf(stderr, "No readings on stdin\n");
+        return 1;
+    }
+
+    printf("%-12s %-14s %14s %12s\n", "channel", "policy", "publishes/day", "max error");
+    for (int id = 0; id < CHANNELS; id++)
+        for (decision_policy_t policy = DECISION_POLICY_DELTA; policy <= DECISION_POLICY_SWINGING_DOOR; policy++)
+            replay(id, policy);
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+/**
+ * @file     rtc_io.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ESP-IDF RTC GPIO driver
+ */
+
+#ifndef SIM_DRIVER_RTC_IO_H
+#define SIM_DRIVER_RTC_IO_H
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num);
+
+#endif
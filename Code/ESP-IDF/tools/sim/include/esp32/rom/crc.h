@@ -0,0 +1,17 @@
+/**
+ * @file     crc.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ROM CRC functions
+ */
+
+#ifndef SIM_ESP32_ROM_CRC_H
+#define SIM_ESP32_ROM_CRC_H
+
+#include <stdint.h>
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif
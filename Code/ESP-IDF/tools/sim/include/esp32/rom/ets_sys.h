@@ -0,0 +1,18 @@
+/**
+ * @file     ets_sys.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ROM delay function, the CPU is kept
+ *           busy for the whole delay
+ */
+
+#ifndef SIM_ESP32_ROM_ETS_SYS_H
+#define SIM_ESP32_ROM_ETS_SYS_H
+
+#include <stdint.h>
+
+void ets_delay_us(uint32_t us);
+
+#endif
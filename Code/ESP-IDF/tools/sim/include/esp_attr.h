@@ -0,0 +1,22 @@
+/**
+ * @file     esp_attr.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ESP-IDF memory placement attributes.
+ *           RTC data is collected in a section of its own, saved before
+ *           deep sleep and restored by the next wake, as RTC slow memory
+ *           keeps it powered. Code and constants stay in host memory.
+ */
+
+#ifndef SIM_ESP_ATTR_H
+#define SIM_ESP_ATTR_H
+
+#define RTC_DATA_ATTR __attribute__((section("sim_rtc_data")))
+#define RTC_NOINIT_ATTR RTC_DATA_ATTR
+#define RTC_RODATA_ATTR
+#define RTC_IRAM_ATTR
+#define IRAM_ATTR
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * @file     esp_bit_defs.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ESP-IDF bit definitions
+ */
+
+#ifndef SIM_ESP_BIT_DEFS_H
+#define SIM_ESP_BIT_DEFS_H
+
+#define BIT7 0x00000080
+#define BIT6 0x00000040
+#define BIT5 0x00000020
+#define BIT4 0x00000010
+#define BIT3 0x00000008
+#define BIT2 0x00000004
+#define BIT1 0x00000002
+#define BIT0 0x00000001
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * @file     esp_err.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ESP-IDF error codes and checks.
+ *           A failed ESP_ERROR_CHECK aborts, the simulation turns it
+ *           into a reset as the panic handler does.
+ */
+
+#ifndef SIM_ESP_ERR_H
+#define SIM_ESP_ERR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+#define ESP_ERR_INVALID_MAC 0x10B
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function, const char *expression) __attribute__((noreturn));
+void _esp_error_check_failed_without_abort(esp_err_t rc, const char *file, int line, const char *function, const char *expression);
+
+#define ESP_ERROR_CHECK(x)                                                          \
+    do                                                                              \
+    {                                                                               \
+        esp_err_t __err_rc = (x);                                                   \
+        if (__err_rc != ESP_OK)                                                     \
+            _esp_error_check_failed(__err_rc, __FILE__, __LINE__, __func__, #x);    \
+    } while (0)
+
+#define ESP_ERROR_CHECK_WITHOUT_ABORT(x)                                                          \
+    ({                                                                                            \
+        esp_err_t __err_rc = (x);                                                                 \
+        if (__err_rc != ESP_OK)                                                                   \
+            _esp_error_check_failed_without_abort(__err_rc, __FILE__, __LINE__, __func__, #x);    \
+        __err_rc;                                                                                 \
+    })
+
+#endif
@@ -0,0 +1,16 @@
+/**
+ * @file     esp_task_wdt.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation placeholder, the task watchdog is not used
+ *           by the firmware
+ */
+
+#ifndef SIM_ESP_TASK_WDT_H
+#define SIM_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+
+#endif
@@ -0,0 +1,19 @@
+/**
+ * @file     esp_timer.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the ESP-IDF high resolution timer
+ */
+
+#ifndef SIM_ESP_TIMER_H
+#define SIM_ESP_TIMER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,15 @@
+/**
+ * @file     ets_sys.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the deprecated ROM header path
+ */
+
+#ifndef SIM_ROM_ETS_SYS_H
+#define SIM_ROM_ETS_SYS_H
+
+#include "esp32/rom/ets_sys.h"
+
+#endif
@@ -0,0 +1,15 @@
+/**
+ * @file     gpio_sig_map.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation placeholder, the registers and ROM functions
+ *           of this header are only used by the wake stub, which is not
+ *           simulated
+ */
+
+#ifndef SIM_SOC_GPIO_SIG_MAP_H
+#define SIM_SOC_GPIO_SIG_MAP_H
+
+#endif
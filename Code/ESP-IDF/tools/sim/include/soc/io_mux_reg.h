@@ -0,0 +1,15 @@
+/**
+ * @file     io_mux_reg.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation placeholder, the registers and ROM functions
+ *           of this header are only used by the wake stub, which is not
+ *           simulated
+ */
+
+#ifndef SIM_SOC_IO_MUX_REG_H
+#define SIM_SOC_IO_MUX_REG_H
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file     rtc_cntl_reg.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the RTC control registers, writes are
+ *           discarded
+ */
+
+#ifndef SIM_SOC_RTC_CNTL_REG_H
+#define SIM_SOC_RTC_CNTL_REG_H
+
+#define RTC_CNTL_BROWN_OUT_REG 0
+
+#define WRITE_PERI_REG(addr, val) ((void)(addr), (void)(val))
+
+#endif
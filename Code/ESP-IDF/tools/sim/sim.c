@@ -0,0 +1,383 @@
+/**
+ * @file     sim.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation of the node: the firmware sources run
+ *           unchanged on a simulated HAL (I2C sensors, Wi-Fi, event loop,
+ *           MQTT broker, NVS, flash and deep sleep) with the latency
+ *           model of sim.h, through a recorded environment.
+ *           Every wake runs app_main in its own process, so only RTC
+ *           memory, NVS, flash and the sensors keep their state across
+ *           deep sleep, as on the chip. The next wake is the timer or the
+ *           PIR level configured before deep sleep, whichever comes first.
+ *           Each wake prints the TRACE_ENABLE phase budget, the run ends
+ *           with the awake and radio time per wakeup cause and per day.
+ *
+ *           Input on stdin, one reading per line, values hold until the
+ *           next one, the run ends with the last one:
+ *           timestamp [sec since power on],light [lx],temperature [°C/°F],humidity [%],pir [0/1]
+ *
+ *           Options: -q summary only, -n <wakes> stop after a number of wakes
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude -Itools/sim/include -include tools/sim/sim_config.h $(find src tools/sim -name '*.c') -o wake_sim -lm && ./wake_sim < trace.csv
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <esp_err.h>
+
+#include "sim.h"
+
+#define CAUSES 4
+
+typedef enum
+{
+    CAUSE_POWER_ON = 0,
+    CAUSE_TIMER,
+    CAUSE_EXT0,
+    CAUSE_RESET,
+} cause_t;
+
+typedef struct
+{
+    uint32_t wakes;
+    int64_t awake_us;
+    int64_t radio_us;
+} cause_stats_t;
+
+// Global variables
+sim_shared_t *sim_shared;
+
+static sim_sample_t *samples;
+static size_t samples_count;
+
+static int64_t wall_reset;   // Wall time of the reset of this wake [us]
+static int64_t clock_origin; // Wall time of the last power on or reset, RTC clock zero [us]
+
+static uint8_t *rtc_image; // RTC memory kept through deep sleep
+static uint8_t rtc_valid;
+
+static const char *cause_names[CAUSES] = {"power on", "timer", "ext0", "reset"};
+static const esp_sleep_wakeup_cause_t cause_values[CAUSES] = {ESP_SLEEP_WAKEUP_UNDEFINED, ESP_SLEEP_WAKEUP_TIMER, ESP_SLEEP_WAKEUP_EXT0, ESP_SLEEP_WAKEUP_UNDEFINED};
+
+extern uint8_t __start_sim_rtc_data[];
+extern uint8_t __stop_sim_rtc_data[];
+
+// Private function declarations
+void app_main(void);
+static void read_samples(void);
+static void wake_run(cause_t cause, uint8_t quiet);
+static void panic_handler(int signal);
+
+// Functions
+
+/**
+ * @brief    Simulate wakes until the trace ends
+ *
+ */
+int main(int argc, char **argv)
+{
+    uint8_t quiet = 0;
+    long max_wakes = -1;
+    int option;
+
+    while ((option = getopt(argc, argv, "qn:")) != -1)
+    {
+        if (option == 'q')
+            quiet = 1;
+        else if (option == 'n')
+            max_wakes = atol(optarg);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-q] [-n wakes] < trace.csv\n", argv[0]);
+            return 1;
+        }
+    }
+
+    read_samples();
+    if (samples_count < 2)
+    {
+        fprintf(stderr, "Not enough readings on stdin\n");
+        return 1;
+    }
+
+    size_t rtc_size = __stop_sim_rtc_data - __start_sim_rtc_data;
+    sim_shared = mmap(NULL, sizeof(*sim_shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    rtc_image = mmap(NULL, rtc_size ? rtc_size : 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sim_shared == MAP_FAILED || rtc_image == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    memset(sim_shared->partition, 0xFF, sizeof(sim_shared->partition)); // Erased flash
+
+    cause_stats_t stats[CAUSES] = {0};
+    int64_t end = (int64_t)samples[samples_count - 1].timestamp * 1000000;
+    int64_t wall = 0;
+    cause_t cause = CAUSE_POWER_ON;
+    uint32_t published = 0, acked = 0, connections = 0;
+    long wakes = 0;
+
+    while (wall <= end && wakes != max_wakes)
+    {
+        if (!quiet)
+            printf("\n=== %.3f s: %s wakeup ===\n", wall / 1e6, cause_names[cause]);
+        fflush(stdout);
+
+        wall_reset = wall;
+        if (cause == CAUSE_POWER_ON || cause == CAUSE_RESET)
+        {
+            clock_origin = wall;
+            rtc_valid = 0;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+            wake_run(cause, quiet);
+
+        int status;
+        waitpid(pid, &status, 0);
+        wakes++;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+        {
+            printf("Wake %ld crashed (%s)\n", wakes, WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "exit status");
+            break;
+        }
+
+        sim_result_t *result = &sim_shared->result;
+        stats[cause].wakes++;
+        stats[cause].awake_us += result->awake_us;
+        stats[cause].radio_us += result->radio_us;
+        published += result->published;
+        acked += result->acked;
+        connections += result->connections;
+
+        if (result->end == SIM_END_HANG)
+        {
+            printf("Wake %ld hung, stopping\n", wakes);
+            break;
+        }
+
+        wall += result->awake_us;
+        if (result->end == SIM_END_PANIC)
+        {
+            cause = CAUSE_RESET; // RTC memory is lost, sensors stay powered
+            continue;
+        }
+
+        rtc_valid = 1;
+        if (!result->timer_enabled && !result->ext0_enabled)
+        {
+            printf("Deep sleep without wakeup source, stopping\n");
+            break;
+        }
+
+        // Next wake, the timer wins a tie with the PIR
+        int64_t timer = result->timer_enabled ? wall + (int64_t)result->timer_us : SIM_FOREVER;
+        int64_t pir = SIM_FOREVER;
+        if (result->ext0_enabled)
+        {
+            pir = sim_env(wall)->pir == result->ext0_level ? wall : sim_pir_next_edge(wall);
+            if (pir != SIM_FOREVER && sim_env(pir)->pir != result->ext0_level)
+                pir = sim_pir_next_edge(pir); // Edge to the other level
+        }
+
+        cause = timer <= pir ? CAUSE_TIMER : CAUSE_EXT0;
+        wall = timer <= pir ? timer : pir;
+        if (wall == SIM_FOREVER)
+            break;
+    }
+
+    double days = (wall < end ? wall : end) / 86400e6;
+    uint32_t total_wakes = 0;
+    int64_t total_awake = 0, total_radio = 0;
+
+    printf("\n=== Summary ===\n");
+    printf("%-10s %8s %12s %12s\n", "cause", "wakes", "awake [ms]", "radio [ms]");
+    for (uint8_t i = 0; i < CAUSES; i++)
+    {
+        total_wakes += stats[i].wakes;
+        total_awake += stats[i].awake_us;
+        total_radio += stats[i].radio_us;
+        if (stats[i].wakes)
+            printf("%-10s %8u %12.1f %12.1f\n", cause_names[i], stats[i].wakes,
+                   stats[i].awake_us / 1e3 / stats[i].wakes, stats[i].radio_us / 1e3 / stats[i].wakes);
+    }
+    printf("Simulated %.2f days\n", days);
+    if (days > 0)
+        printf("Per day: %.1f wakes, %.1f s awake, %.1f s radio on\n",
+               total_wakes / days, total_awake / 1e6 / days, total_radio / 1e6 / days);
+    printf("Messages: %u published, %u acknowledged, %u Wi-Fi connections\n", published, acked, connections);
+    return 0;
+}
+
+/**
+ * @brief    Wall time, since the first power on
+ *
+ * @return   int64_t time [us]
+ */
+int64_t sim_wall(void)
+{
+    return wall_reset + sim_now;
+}
+
+/**
+ * @brief    RTC clock of gettimeofday(), zero at power on or reset
+ *
+ * @return   int64_t time [us]
+ */
+int64_t sim_clock(void)
+{
+    return sim_wall() - clock_origin;
+}
+
+/**
+ * @brief    Environment at a time, the last reading at or before it
+ *
+ * @param    wall: Wall time [us]
+ * @return   const sim_sample_t* reading
+ */
+const sim_sample_t *sim_env(int64_t wall)
+{
+    size_t low = 0, high = samples_count;
+
+    while (high - low > 1)
+    {
+        size_t middle = (low + high) / 2;
+
+        if ((int64_t)samples[middle].timestamp * 1000000 <= wall)
+            low = middle;
+        else
+            high = middle;
+    }
+    return &samples[low];
+}
+
+/**
+ * @brief    Next PIR level change after a time
+ *
+ * @param    wall: Wall time [us]
+ * @return   int64_t time of the change, SIM_FOREVER if none [us]
+ */
+int64_t sim_pir_next_edge(int64_t wall)
+{
+    const sim_sample_t *sample = sim_env(wall);
+    uint8_t level = sample->pir;
+
+    for (sample++; sample < samples + samples_count; sample++)
+        if (sample->pir != level && (int64_t)sample->timestamp * 1000000 > wall)
+            return (int64_t)sample->timestamp * 1000000;
+    return SIM_FOREVER;
+}
+
+/**
+ * @brief    Random failure
+ *
+ * @param    percent: Failure probability [%]
+ * @return   uint8_t: 1 failure, 0 otherwise
+ */
+uint8_t sim_chance(uint8_t percent)
+{
+    return percent && rand() % 100 < percent;
+}
+
+/**
+ * @brief    End the wake and report it to the parent process
+ *
+ * @param    end: Deep sleep, panic or hang
+ */
+void sim_end(sim_end_t end)
+{
+    sim_shared->result.end = end;
+    sim_shared->result.awake_us = sim_now;
+    sim_shared->result.radio_us = sim_radio_time();
+
+    if (end == SIM_END_SLEEP)
+        memcpy(rtc_image, __start_sim_rtc_data, __stop_sim_rtc_data - __start_sim_rtc_data);
+
+    fflush(stdout);
+    _exit(0);
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function, const char *expression)
+{
+    printf("ESP_ERROR_CHECK failed: esp_err_t 0x%x at %s:%d %s(): %s\n", rc, file, line, function, expression);
+    abort();
+}
+
+void _esp_error_check_failed_without_abort(esp_err_t rc, const char *file, int line, const char *function, const char *expression)
+{
+    printf("ESP_ERROR_CHECK_WITHOUT_ABORT failed: esp_err_t 0x%x at %s:%d %s(): %s\n", rc, file, line, function, expression);
+}
+
+/**
+ * @brief    Read the trace from stdin
+ *
+ */
+static void read_samples(void)
+{
+    size_t size = 0;
+    long timestamp;
+    float light, temperature, humidity;
+    int motion;
+
+    while (scanf("%ld,%f,%f,%f,%d", &timestamp, &light, &temperature, &humidity, &motion) == 5)
+    {
+        if (samples_count == size)
+        {
+            size = size ? size * 2 : 1024;
+            samples = realloc(samples, size * sizeof(*samples));
+        }
+
+        samples[samples_count++] = (sim_sample_t){timestamp, light, temperature, humidity, motion != 0};
+    }
+}
+
+/**
+ * @brief    Run app_main in the wake process, RTC memory restored
+ *
+ * @param    cause: Wakeup cause
+ * @param    quiet: 1 to drop the firmware output
+ */
+static void wake_run(cause_t cause, uint8_t quiet)
+{
+    if (quiet)
+        freopen("/dev/null", "w", stdout);
+
+    srand(SIM_SEED + (unsigned int)(wall_reset / 1000));
+    if (rtc_valid)
+        memcpy(__start_sim_rtc_data, rtc_image, __stop_sim_rtc_data - __start_sim_rtc_data);
+
+    memset(&sim_shared->result, 0, sizeof(sim_shared->result));
+    sim_wakeup_cause = cause_values[cause];
+    sim_now = cause == CAUSE_TIMER || cause == CAUSE_EXT0 ? SIM_BOOT_US : SIM_RESET_BOOT_US;
+
+    signal(SIGABRT, panic_handler);
+    sim_run(app_main);
+}
+
+/**
+ * @brief    Abort of the firmware, the chip resets
+ *
+ * @param    signal: Signal number
+ */
+static void panic_handler(int signal)
+{
+    printf("Panic, restarting\n");
+    sim_end(SIM_END_PANIC);
+}
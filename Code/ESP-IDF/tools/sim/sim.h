@@ -0,0 +1,218 @@
+/**
+ * @file     sim.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host simulation internals: latency model, scheduler, the
+ *           recorded environment and the state kept between wakes.
+ *           Every latency can be overridden with -D, measured values
+ *           come from the TRACE_ENABLE report of a real node.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <time.h>
+#include <esp_sleep.h>
+#include <driver/i2c.h>
+
+#include "configuration.h"
+
+// Boot [us]
+#ifndef SIM_BOOT_US
+#define SIM_BOOT_US 30000 // Deep sleep wakeup to app_main
+#endif
+#ifndef SIM_RESET_BOOT_US
+#define SIM_RESET_BOOT_US 300000 // Power on or reset to app_main, bootloader and image check
+#endif
+
+// Storage [us]
+#ifndef SIM_NVS_INIT_US
+#define SIM_NVS_INIT_US 10000 // NVS page scan
+#endif
+#ifndef SIM_NVS_COMMIT_US
+#define SIM_NVS_COMMIT_US 5000 // NVS entry write
+#endif
+#ifndef SIM_FLASH_READ_US
+#define SIM_FLASH_READ_US 50 // Partition read
+#endif
+#ifndef SIM_FLASH_WRITE_US
+#define SIM_FLASH_WRITE_US 300 // Partition write
+#endif
+#ifndef SIM_FLASH_ERASE_US
+#define SIM_FLASH_ERASE_US 45000 // Sector erase
+#endif
+
+// Sensors [us]
+#ifndef SIM_I2C_COMMAND_US
+#define SIM_I2C_COMMAND_US 100 // I2C driver overhead of a command link, the bits on the bus are added
+#endif
+#ifndef SIM_BH1750_HIGH_US
+#define SIM_BH1750_HIGH_US 120000 // Typical BH1750 conversion at the default measurement time, H and H2 resolution
+#endif
+#ifndef SIM_BH1750_LOW_US
+#define SIM_BH1750_LOW_US 16000 // Typical BH1750 conversion at the default measurement time, L resolution
+#endif
+#ifndef SIM_SI7021_PERCENT
+#define SIM_SI7021_PERCENT 75 // Typical Si7021 conversion, percent of the datasheet maximum
+#endif
+
+// Network [us]
+#ifndef SIM_WIFI_INIT_US
+#define SIM_WIFI_INIT_US 40000 // Wi-Fi driver init
+#endif
+#ifndef SIM_WIFI_START_US
+#define SIM_WIFI_START_US 100000 // PHY calibration, the radio is on from here
+#endif
+#ifndef SIM_WIFI_SCAN_US
+#define SIM_WIFI_SCAN_US 1200000 // Scan of every channel
+#endif
+#ifndef SIM_WIFI_ASSOC_US
+#define SIM_WIFI_ASSOC_US 80000 // Authentication, association and WPA2 handshake
+#endif
+#ifndef SIM_WIFI_DHCP_US
+#define SIM_WIFI_DHCP_US 700000 // DHCP lease
+#endif
+#ifndef SIM_WIFI_STATIC_IP_US
+#define SIM_WIFI_STATIC_IP_US 2000 // Static or cached IP configuration
+#endif
+#ifndef SIM_MQTT_CONNECT_US
+#define SIM_MQTT_CONNECT_US 50000 // TCP and MQTT connection to the broker
+#endif
+#ifndef SIM_MQTT_SEND_US
+#define SIM_MQTT_SEND_US 1500 // Publish of a message
+#endif
+#ifndef SIM_MQTT_ACK_US
+#define SIM_MQTT_ACK_US 20000 // Round trip of a message ack
+#endif
+
+// Failures, percent of the attempts
+#ifndef SIM_WIFI_FAIL_PERCENT
+#define SIM_WIFI_FAIL_PERCENT 0 // Connections rejected by the access point
+#endif
+#ifndef SIM_MQTT_LOSS_PERCENT
+#define SIM_MQTT_LOSS_PERCENT 0 // Messages never acknowledged
+#endif
+#ifndef SIM_SEED
+#define SIM_SEED 1 // Seed of the failures
+#endif
+
+#ifndef SIM_AWAKE_MAX_US
+#define SIM_AWAKE_MAX_US 60000000 // Longest wake before the node is considered hung
+#endif
+
+#define SIM_FOREVER INT64_MAX
+
+#define SIM_PARTITION_SIZE 0x10000 // Backlog partition size, see partitions.csv
+#define SIM_NVS_ENTRIES 16
+#define SIM_NVS_NAME_LEN 16
+#define SIM_NVS_VALUE_MAX 512
+
+// Environment of the node at a time of the trace
+typedef struct
+{
+    time_t timestamp;  // Time since power on [sec]
+    float light;       // [lx]
+    float temperature; // [°C/°F]
+    float humidity;    // [%]
+    uint8_t pir;       // PIR level
+} sim_sample_t;
+
+typedef struct
+{
+    uint8_t used;
+    char space[SIM_NVS_NAME_LEN];
+    char key[SIM_NVS_NAME_LEN];
+    uint16_t length;
+    uint8_t value[SIM_NVS_VALUE_MAX];
+} sim_nvs_entry_t;
+
+// Sensors stay powered through deep sleep, their state too
+typedef struct
+{
+    uint8_t powered;
+    uint8_t opcode;           // Measurement opcode, 0 if none since power on
+    uint8_t mtreg;            // Measurement time register
+    uint16_t count;           // Data register
+    int64_t conversion_start; // Start of the running conversion, -1 if none [us]
+    uint8_t read_index;
+} sim_bh1750_t;
+
+typedef struct
+{
+    uint8_t user_register;
+    uint8_t command;        // Last command received
+    uint8_t command_bytes;  // Bytes received after the address
+    int64_t busy_until;     // End of the running conversion or reset, address not acknowledged before [us]
+    uint16_t temperature;   // Temperature code of the last measurement
+    uint8_t response[3];    // Bytes of the next read
+    uint8_t response_len;
+    uint8_t read_index;
+} sim_si7021_t;
+
+typedef struct
+{
+    uint8_t valid; // Powered since the start
+    sim_bh1750_t bh1750[LIGHT_SENSORS];
+    sim_si7021_t si7021;
+    uint8_t mux_channels[I2C_NUM_MAX]; // Enabled channels of the TCA9548A of every port
+} sim_devices_t;
+
+typedef enum
+{
+    SIM_END_SLEEP = 0, // Deep sleep started
+    SIM_END_PANIC,     // Abort, the chip resets
+    SIM_END_HANG,      // No task can run anymore
+} sim_end_t;
+
+// Outcome of a wake
+typedef struct
+{
+    uint8_t end;           // sim_end_t
+    int64_t awake_us;      // Reset to deep sleep
+    int64_t radio_us;      // Radio on
+    uint8_t timer_enabled; // Timer wakeup
+    uint64_t timer_us;
+    uint8_t ext0_enabled; // PIR wakeup
+    uint8_t ext0_level;
+    uint32_t published; // Messages handed to the MQTT client
+    uint32_t acked;     // Messages acknowledged
+    uint32_t connections;
+} sim_result_t;
+
+// State kept between wakes, RTC memory aside
+typedef struct
+{
+    sim_result_t result;
+    sim_devices_t devices;
+    sim_nvs_entry_t nvs[SIM_NVS_ENTRIES];
+    uint8_t partition[SIM_PARTITION_SIZE];
+} sim_shared_t;
+
+typedef void (*sim_event_fn_t)(intptr_t args);
+
+extern sim_shared_t *sim_shared;
+extern int64_t sim_now; // Time since reset, esp_timer [us]
+extern esp_sleep_wakeup_cause_t sim_wakeup_cause;
+
+// sim.c
+int64_t sim_wall(void);
+int64_t sim_clock(void);
+const sim_sample_t *sim_env(int64_t wall);
+int64_t sim_pir_next_edge(int64_t wall);
+uint8_t sim_chance(uint8_t percent);
+void sim_end(sim_end_t end) __attribute__((noreturn));
+
+// sim_kernel.c
+void sim_run(void (*main_task)(void)) __attribute__((noreturn));
+void sim_advance(int64_t us);
+uint8_t sim_block(uint8_t (*ready)(void *args), void *args, int64_t deadline);
+int64_t sim_tick_deadline(uint32_t ticks);
+void sim_post(int64_t at, sim_event_fn_t fn, intptr_t args);
+
+// sim_network.c
+int64_t sim_radio_time(void);
+
+#endif
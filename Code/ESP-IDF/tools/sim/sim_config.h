@@ -0,0 +1,31 @@
+/**
+ * @file     sim_config.h
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Configuration of the host simulation, included before every
+ *           source file. Starts from configuration.h, the wake trace is
+ *           always on so every wake prints its phase budget, the wake
+ *           stub runs from RTC memory before the boot and is left out.
+ *           gettimeofday() reads the simulated RTC clock.
+ */
+
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+#include <sys/time.h>
+
+#include "configuration.h"
+
+#undef TRACE_ENABLE
+#define TRACE_ENABLE 1
+
+#undef WAKE_STUB_ENABLE
+#define WAKE_STUB_ENABLE 0
+
+int sim_gettimeofday(struct timeval *tv, void *tz);
+
+#define gettimeofday sim_gettimeofday
+
+#endif
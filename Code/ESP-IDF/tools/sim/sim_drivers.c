@@ -0,0 +1,935 @@
+/**
+ * @file     sim_drivers.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Simulated peripherals of the node: the I2C controllers with
+ *           the BH1750, Si7021 and TCA9548A devices, the PIR input,
+ *           timers, deep sleep, NVS and the backlog partition.
+ *           Sensors read the recorded environment at the time their
+ *           conversion ends, and keep their state through deep sleep.
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <esp_partition.h>
+#include <esp32/rom/ets_sys.h>
+#include <esp32/rom/crc.h>
+#include <driver/i2c.h>
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include "nvs_flash.h"
+
+#include "configuration.h"
+
+#include "typedefs.h"
+#include "devices.h"
+#include "sim.h"
+
+#define I2C_OPS_MAX 16
+#define NVS_HANDLES_MAX 4
+#define FLASH_SECTOR_SIZE 4096
+#define BH1750_MTREG_DEFAULT 69
+#define BH1750_COUNT_MAX 65535
+#define SI7021_USER_REGISTER_RESET 0x3A
+#define SI7021_RESET_US 15000
+
+typedef enum
+{
+    I2C_OP_START = 0,
+    I2C_OP_WRITE,
+    I2C_OP_READ,
+    I2C_OP_STOP,
+} i2c_op_type_t;
+
+typedef struct
+{
+    uint8_t type;  // i2c_op_type_t
+    uint8_t byte;  // Single byte write
+    uint8_t *data; // Buffer of a write or read, NULL for a single byte write
+    size_t len;
+    uint8_t ack_en; // Check the ACK of written bytes
+} i2c_op_t;
+
+typedef struct
+{
+    i2c_op_t ops[I2C_OPS_MAX];
+    uint8_t count;
+} i2c_link_t;
+
+typedef enum
+{
+    DEVICE_BH1750 = 0,
+    DEVICE_SI7021,
+    DEVICE_TCA9548A,
+} device_type_t;
+
+// Device on a bus, behind a multiplexer channel or not
+typedef struct
+{
+    const i2c_device_t *location;
+    uint8_t type; // device_type_t
+    uint8_t index;
+} bus_device_t;
+
+typedef struct
+{
+    uint8_t installed;
+    uint32_t clk_speed;
+} i2c_controller_t;
+
+typedef struct
+{
+    const char *space;
+    nvs_open_mode_t mode;
+} nvs_open_t;
+
+// Global variables
+esp_sleep_wakeup_cause_t sim_wakeup_cause;
+
+static i2c_controller_t i2c_controllers[I2C_NUM_MAX];
+static bus_device_t bus_devices[LIGHT_SENSORS + 1 + I2C_NUM_MAX];
+static i2c_device_t mux_locations[I2C_NUM_MAX];
+static uint8_t bus_devices_count;
+
+static gpio_isr_t pir_isr;
+static void *pir_isr_args;
+
+static uint8_t nvs_ready;
+static nvs_open_t nvs_handles[NVS_HANDLES_MAX];
+
+static const esp_partition_t backlog_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = (esp_partition_subtype_t)0x40,
+    .address = 0x110000,
+    .size = SIM_PARTITION_SIZE,
+    .label = BACKLOG_PARTITION,
+};
+
+static const uint16_t si7021_rh_conversion_us[] = {22800, 6900, 10700, 9400}; // Datasheet maximum, RH conversion includes temperature
+static const uint16_t si7021_temp_conversion_us[] = {10800, 3800, 6200, 2400};
+static const uint8_t si7021_rh_bits[] = {12, 8, 10, 11};
+static const uint8_t si7021_temp_bits[] = {14, 12, 13, 11};
+
+// Private function declarations
+static esp_err_t i2c_link_add(i2c_cmd_handle_t cmd_handle, i2c_op_t op);
+static void bus_setup(void);
+static bus_device_t *bus_find(i2c_port_t port, uint8_t address);
+static uint8_t device_address(bus_device_t *device, uint8_t read);
+static void device_write(bus_device_t *device, uint8_t byte);
+static uint8_t device_read(bus_device_t *device);
+static int64_t bh1750_conversion_us(const sim_bh1750_t *sensor);
+static void bh1750_update(sim_bh1750_t *sensor);
+static void si7021_command(sim_si7021_t *sensor, uint8_t command);
+static void si7021_measure(sim_si7021_t *sensor, uint8_t humidity);
+static uint16_t si7021_code(float value, float offset, float scale, uint8_t bits);
+static uint8_t si7021_crc(const uint8_t *data, uint8_t len);
+static void pir_edge(intptr_t args);
+static sim_nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key, uint8_t create);
+
+// Functions
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now;
+}
+
+void ets_delay_us(uint32_t us)
+{
+    sim_advance(us);
+}
+
+int sim_gettimeofday(struct timeval *tv, void *tz)
+{
+    int64_t clock = sim_clock();
+
+    tv->tv_sec = clock / 1000000;
+    tv->tv_usec = clock % 1000000;
+    return 0;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    return sim_wakeup_cause;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    sim_shared->result.timer_enabled = 1;
+    sim_shared->result.timer_us = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level)
+{
+    if (gpio_num != PIR_GPIO)
+        return ESP_ERR_INVALID_ARG; // Only the PIR is connected
+
+    sim_shared->result.ext0_enabled = 1;
+    sim_shared->result.ext0_level = level;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void)
+{
+    sim_end(SIM_END_SLEEP);
+}
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num != PIR_GPIO)
+        return 0;
+
+    return sim_env(sim_wall())->pir;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (gpio_num != PIR_GPIO)
+        return ESP_OK; // Never triggers
+
+    if (pir_isr == NULL)
+        pir_edge(-1); // Schedule the first edge
+
+    pir_isr = isr_handler;
+    pir_isr_args = args;
+    return ESP_OK;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX || i2c_conf->mode != I2C_MODE_MASTER)
+        return ESP_ERR_INVALID_ARG;
+
+    i2c_controllers[i2c_num].clk_speed = i2c_conf->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags)
+{
+    if (i2c_num < 0 || i2c_num >= I2C_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+    if (i2c_controllers[i2c_num].installed)
+        return ESP_FAIL; // As the driver, installed once per boot
+
+    i2c_controllers[i2c_num].installed = 1;
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(i2c_link_t));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return i2c_link_add(cmd_handle, (i2c_op_t){.type = I2C_OP_START});
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    return i2c_link_add(cmd_handle, (i2c_op_t){.type = I2C_OP_WRITE, .byte = data, .len = 1, .ack_en = ack_en});
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, bool ack_en)
+{
+    return i2c_link_add(cmd_handle, (i2c_op_t){.type = I2C_OP_WRITE, .data = data, .len = data_len, .ack_en = ack_en});
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    return i2c_link_add(cmd_handle, (i2c_op_t){.type = I2C_OP_READ, .data = data, .len = 1});
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t ack)
+{
+    return i2c_link_add(cmd_handle, (i2c_op_t){.type = I2C_OP_READ, .data = data, .len = data_len});
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return i2c_link_add(cmd_handle, (i2c_op_t){.type = I2C_OP_STOP});
+}
+
+/**
+ * @brief    Run a command link on the bus. The task waits for the bits
+ *           on the bus and the driver overhead, then the devices see
+ *           the transaction. A byte that isn't acknowledged fails the
+ *           transaction only if its ACK is checked, otherwise the
+ *           transaction goes on and reads return the idle bus level.
+ */
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    i2c_link_t *link = cmd_handle;
+    i2c_controller_t *controller = &i2c_controllers[i2c_num];
+    uint32_t bits = 0;
+
+    if (!controller->installed)
+        return ESP_FAIL;
+
+    for (uint8_t i = 0; i < link->count; i++)
+        bits += link->ops[i].type == I2C_OP_WRITE || link->ops[i].type == I2C_OP_READ ? 9 * link->ops[i].len : 1;
+    sim_advance(SIM_I2C_COMMAND_US + (int64_t)bits * 1000000 / controller->clk_speed);
+
+    bus_setup();
+
+    bus_device_t *device = NULL;
+    uint8_t address_next = 0;
+
+    for (uint8_t i = 0; i < link->count; i++)
+    {
+        i2c_op_t *op = &link->ops[i];
+
+        switch (op->type)
+        {
+        case I2C_OP_START:
+            address_next = 1;
+            device = NULL;
+            break;
+
+        case I2C_OP_WRITE:
+            for (size_t j = 0; j < op->len; j++)
+            {
+                uint8_t byte = op->data != NULL ? op->data[j] : op->byte;
+
+                if (!address_next)
+                {
+                    if (device != NULL)
+                        device_write(device, byte);
+                    continue;
+                }
+
+                address_next = 0;
+                device = bus_find(i2c_num, byte >> 1);
+                if (device != NULL && !device_address(device, byte & 1))
+                    device = NULL; // Address not acknowledged
+                if (device == NULL && op->ack_en)
+                    return ESP_FAIL;
+            }
+            break;
+
+        case I2C_OP_READ:
+            for (size_t j = 0; j < op->len; j++)
+                op->data[j] = device != NULL ? device_read(device) : 0xFF;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    if (!nvs_ready)
+    {
+        sim_advance(SIM_NVS_INIT_US);
+        nvs_ready = 1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(sim_shared->nvs, 0, sizeof(sim_shared->nvs));
+    nvs_ready = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (!nvs_ready)
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+
+    if (open_mode == NVS_READONLY)
+    {
+        uint8_t found = 0;
+
+        for (uint8_t i = 0; i < SIM_NVS_ENTRIES && !found; i++)
+            found = sim_shared->nvs[i].used && !strcmp(sim_shared->nvs[i].space, name);
+        if (!found)
+            return ESP_ERR_NVS_NOT_FOUND; // Namespace never written
+    }
+
+    for (uint8_t i = 0; i < NVS_HANDLES_MAX; i++)
+    {
+        if (nvs_handles[i].space != NULL)
+            continue;
+
+        nvs_handles[i].space = name;
+        nvs_handles[i].mode = open_mode;
+        *out_handle = i + 1;
+        return ESP_OK;
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    sim_nvs_entry_t *entry = nvs_find(handle, key, 0);
+
+    if (entry == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    if (out_value == NULL)
+    {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (handle < 1 || handle > NVS_HANDLES_MAX || nvs_handles[handle - 1].space == NULL)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (nvs_handles[handle - 1].mode == NVS_READONLY)
+        return ESP_ERR_NVS_READ_ONLY;
+    if (length > SIM_NVS_VALUE_MAX)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    sim_nvs_entry_t *entry = nvs_find(handle, key, 1);
+    if (entry == NULL)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    sim_nvs_entry_t *entry = nvs_find(handle, key, 0);
+
+    if (entry != NULL && entry->length != length)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    return nvs_get_blob(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    sim_advance(SIM_NVS_COMMIT_US);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle >= 1 && handle <= NVS_HANDLES_MAX)
+        nvs_handles[handle - 1].space = NULL;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    if (type != backlog_partition.type || (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != backlog_partition.subtype))
+        return NULL;
+    if (label != NULL && strcmp(label, backlog_partition.label))
+        return NULL;
+
+    return &backlog_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset > partition->size || size > partition->size - src_offset)
+        return ESP_ERR_INVALID_SIZE;
+
+    memcpy(dst, sim_shared->partition + src_offset, size);
+    sim_advance(SIM_FLASH_READ_US);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if (dst_offset > partition->size || size > partition->size - dst_offset)
+        return ESP_ERR_INVALID_SIZE;
+
+    for (size_t i = 0; i < size; i++)
+        sim_shared->partition[dst_offset + i] &= ((const uint8_t *)src)[i]; // Programming only clears bits
+    sim_advance(SIM_FLASH_WRITE_US);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t start_addr, size_t size)
+{
+    if (start_addr % FLASH_SECTOR_SIZE || size % FLASH_SECTOR_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+    if (start_addr > partition->size || size > partition->size - start_addr)
+        return ESP_ERR_INVALID_SIZE;
+
+    memset(sim_shared->partition + start_addr, 0xFF, size);
+    sim_advance(SIM_FLASH_ERASE_US * (size / FLASH_SECTOR_SIZE));
+    return ESP_OK;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/**
+ * @brief    Append an operation to a command link
+ *
+ * @param    cmd_handle: Command link
+ * @param    op: Operation
+ * @return   esp_err_t status
+ */
+static esp_err_t i2c_link_add(i2c_cmd_handle_t cmd_handle, i2c_op_t op)
+{
+    i2c_link_t *link = cmd_handle;
+
+    if (link->count >= I2C_OPS_MAX)
+        return ESP_ERR_NO_MEM;
+
+    link->ops[link->count++] = op;
+    return ESP_OK;
+}
+
+/**
+ * @brief    Place the devices on the buses where devices.c expects them,
+ *           with a multiplexer for every port that has devices behind one.
+ *           Sensors get their power on state with the first wake.
+ */
+static void bus_setup(void)
+{
+    sim_devices_t *devices = &sim_shared->devices;
+
+    if (bus_devices_count)
+        return;
+
+    for (uint8_t i = 0; i < LIGHT_SENSORS; i++)
+        bus_devices[bus_devices_count++] = (bus_device_t){.location = &bh1750_devices[i], .type = DEVICE_BH1750, .index = i};
+    bus_devices[bus_devices_count++] = (bus_device_t){.location = &si7021_device, .type = DEVICE_SI7021};
+
+    for (uint8_t i = 0; i < bus_devices_count; i++)
+    {
+        const i2c_device_t *location = bus_devices[i].location;
+        i2c_device_t *mux = &mux_locations[location->port];
+
+        if (location->mux_address == I2C_MUX_NONE || mux->address != I2C_MUX_NONE)
+            continue;
+
+        mux->port = location->port;
+        mux->address = location->mux_address;
+        mux->mux_address = I2C_MUX_NONE;
+        bus_devices[bus_devices_count++] = (bus_device_t){.location = mux, .type = DEVICE_TCA9548A, .index = location->port};
+    }
+
+    if (devices->valid)
+        return;
+
+    memset(devices, 0, sizeof(*devices));
+    for (uint8_t i = 0; i < LIGHT_SENSORS; i++)
+    {
+        devices->bh1750[i].mtreg = BH1750_MTREG_DEFAULT;
+        devices->bh1750[i].conversion_start = -1;
+    }
+    devices->si7021.user_register = SI7021_USER_REGISTER_RESET;
+    devices->valid = 1;
+}
+
+/**
+ * @brief    Device answering an address, devices behind a multiplexer
+ *           only while their channel is enabled
+ *
+ * @param    port: I2C port
+ * @param    address: 7 bit address
+ * @return   bus_device_t* device, NULL if none
+ */
+static bus_device_t *bus_find(i2c_port_t port, uint8_t address)
+{
+    for (uint8_t i = 0; i < bus_devices_count; i++)
+    {
+        const i2c_device_t *location = bus_devices[i].location;
+
+        if (location->port != port || location->address != address)
+            continue;
+        if (location->mux_address == I2C_MUX_NONE ||
+            sim_shared->devices.mux_channels[port] & (1 << location->mux_channel))
+            return &bus_devices[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief    Address phase of a transaction
+ *
+ * @param    device: Addressed device
+ * @param    read: 1 read, 0 write
+ * @return   uint8_t: 1 acknowledged, 0 otherwise
+ */
+static uint8_t device_address(bus_device_t *device, uint8_t read)
+{
+    switch (device->type)
+    {
+    case DEVICE_BH1750:
+    {
+        sim_bh1750_t *sensor = &sim_shared->devices.bh1750[device->index];
+
+        bh1750_update(sensor);
+        sensor->read_index = 0;
+        return 1;
+    }
+
+    case DEVICE_SI7021:
+    {
+        sim_si7021_t *sensor = &sim_shared->devices.si7021;
+
+        if (sim_wall() < sensor->busy_until)
+            return 0; // Converting, no hold master mode
+        if (read)
+            sensor->read_index = 0;
+        else
+            sensor->command_bytes = 0;
+        return 1;
+    }
+
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief    Byte written to a device
+ *
+ * @param    device: Addressed device
+ * @param    byte: Byte
+ */
+static void device_write(bus_device_t *device, uint8_t byte)
+{
+    switch (device->type)
+    {
+    case DEVICE_BH1750:
+    {
+        sim_bh1750_t *sensor = &sim_shared->devices.bh1750[device->index];
+
+        if (byte == BH1750_OPCODE_POWER_DOWN)
+            sensor->powered = 0;
+        else if (byte == BH1750_OPCODE_POWER_ON)
+            sensor->powered = 1;
+        else if ((byte & 0xF8) == BH1750_OPCODE_MT_HI)
+            sensor->mtreg = (sensor->mtreg & 0x1F) | (byte & 0x07) << 5;
+        else if ((byte & 0xE0) == BH1750_OPCODE_MT_LO)
+            sensor->mtreg = (sensor->mtreg & 0xE0) | (byte & 0x1F);
+        else if ((byte & 0xF0) == BH1750_OPCODE_CONT || (byte & 0xF0) == BH1750_OPCODE_OT)
+        {
+            sensor->powered = 1;
+            sensor->opcode = byte;
+            sensor->conversion_start = sim_wall();
+        }
+        break;
+    }
+
+    case DEVICE_SI7021:
+    {
+        sim_si7021_t *sensor = &sim_shared->devices.si7021;
+
+        if (sensor->command_bytes++ == 0)
+            si7021_command(sensor, byte);
+        else if (sensor->command == SI7021_REG_WRITE)
+            sensor->user_register = byte;
+        break;
+    }
+
+    case DEVICE_TCA9548A:
+        sim_shared->devices.mux_channels[device->index] = byte;
+        break;
+    }
+}
+
+/**
+ * @brief    Byte read from a device
+ *
+ * @param    device: Addressed device
+ * @return   uint8_t byte
+ */
+static uint8_t device_read(bus_device_t *device)
+{
+    switch (device->type)
+    {
+    case DEVICE_BH1750:
+    {
+        sim_bh1750_t *sensor = &sim_shared->devices.bh1750[device->index];
+        uint8_t index = sensor->read_index++;
+
+        if (index > 1)
+            return 0xFF;
+        return index == 0 ? sensor->count >> 8 : sensor->count & 0xFF;
+    }
+
+    case DEVICE_SI7021:
+    {
+        sim_si7021_t *sensor = &sim_shared->devices.si7021;
+
+        if (sensor->read_index >= sensor->response_len)
+            return 0xFF;
+        return sensor->response[sensor->read_index++];
+    }
+
+    case DEVICE_TCA9548A:
+        return sim_shared->devices.mux_channels[device->index];
+    }
+    return 0xFF;
+}
+
+/**
+ * @brief    Conversion time of a BH1750, scaled by the measurement time
+ *
+ * @param    sensor: Sensor state
+ * @return   int64_t time [us]
+ */
+static int64_t bh1750_conversion_us(const sim_bh1750_t *sensor)
+{
+    int64_t base = (sensor->opcode & 0x03) == BH1750_OPCODE_LOW ? SIM_BH1750_LOW_US : SIM_BH1750_HIGH_US;
+
+    return base * sensor->mtreg / BH1750_MTREG_DEFAULT;
+}
+
+/**
+ * @brief    Bring the data register of a BH1750 up to date. A one-time
+ *           conversion powers the sensor down once done, a continuous
+ *           one keeps converting.
+ *
+ * @param    sensor: Sensor state
+ */
+static void bh1750_update(sim_bh1750_t *sensor)
+{
+    int64_t now = sim_wall();
+
+    if (sensor->conversion_start < 0 || !sensor->powered)
+        return;
+
+    int64_t conversion = bh1750_conversion_us(sensor);
+    int64_t conversions = (now - sensor->conversion_start) / conversion;
+    if (conversions == 0)
+        return; // First conversion still running
+
+    uint8_t one_time = (sensor->opcode & 0xF0) == BH1750_OPCODE_OT;
+    int64_t end = sensor->conversion_start + (one_time ? 1 : conversions) * conversion;
+    double count = sim_env(end)->light * 1.2 * sensor->mtreg / BH1750_MTREG_DEFAULT;
+
+    if ((sensor->opcode & 0x03) == BH1750_OPCODE_HIGH2)
+        count *= 2;
+    sensor->count = count < BH1750_COUNT_MAX ? (uint16_t)count : BH1750_COUNT_MAX;
+
+    if (one_time)
+    {
+        sensor->conversion_start = -1;
+        sensor->powered = 0;
+    }
+}
+
+/**
+ * @brief    Command written to the Si7021
+ *
+ * @param    sensor: Sensor state
+ * @param    command: Command byte
+ */
+static void si7021_command(sim_si7021_t *sensor, uint8_t command)
+{
+    uint8_t resolution = (sensor->user_register & SI7021_REG_RES1 ? 2 : 0) | (sensor->user_register & SI7021_REG_RES0 ? 1 : 0);
+
+    sensor->command = command;
+    sensor->response_len = 0;
+
+    switch (command)
+    {
+    case SI7021_COMMAND_READ_RH:
+        sensor->busy_until = sim_wall() + si7021_rh_conversion_us[resolution] * SIM_SI7021_PERCENT / 100;
+        si7021_measure(sensor, 1);
+        break;
+
+    case SI7021_COMMAND_READ_TEMP:
+        sensor->busy_until = sim_wall() + si7021_temp_conversion_us[resolution] * SIM_SI7021_PERCENT / 100;
+        si7021_measure(sensor, 0);
+        break;
+
+    case SI7021_COMMAND_READ_TEMP_AFTER_RH:
+        sensor->response[0] = sensor->temperature >> 8;
+        sensor->response[1] = sensor->temperature & 0xFF;
+        sensor->response[2] = si7021_crc(sensor->response, 2);
+        sensor->response_len = 3;
+        break;
+
+    case SI7021_REG_READ:
+        sensor->response[0] = sensor->user_register;
+        sensor->response_len = 1;
+        break;
+
+    case SI7021_RESET:
+        sensor->user_register = SI7021_USER_REGISTER_RESET;
+        sensor->busy_until = sim_wall() + SI7021_RESET_US;
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief    Measure the environment at the end of the conversion just
+ *           started, a humidity measurement measures temperature too
+ *
+ * @param    sensor: Sensor state
+ * @param    humidity: 1 humidity, 0 temperature only
+ */
+static void si7021_measure(sim_si7021_t *sensor, uint8_t humidity)
+{
+    uint8_t resolution = (sensor->user_register & SI7021_REG_RES1 ? 2 : 0) | (sensor->user_register & SI7021_REG_RES0 ? 1 : 0);
+    const sim_sample_t *sample = sim_env(sensor->busy_until);
+    float celsius = sample->temperature;
+    uint16_t code;
+
+#if TEMPERATURE_USE_FAHRENHEIT
+    celsius = (celsius - 32) * 5 / 9;
+#endif
+
+    sensor->temperature = si7021_code(celsius, 46.85, 175.72, si7021_temp_bits[resolution]);
+    code = humidity ? si7021_code(sample->humidity, 6, 125, si7021_rh_bits[resolution]) : sensor->temperature;
+
+    sensor->response[0] = code >> 8;
+    sensor->response[1] = code & 0xFF;
+    sensor->response[2] = si7021_crc(sensor->response, 2);
+    sensor->response_len = 3;
+}
+
+/**
+ * @brief    Si7021 measurement code, value = scale * code / 65536 - offset
+ *
+ * @param    value: Measured value
+ * @param    offset: Formula offset
+ * @param    scale: Formula scale
+ * @param    bits: Resolution, lower bits are zero
+ * @return   uint16_t code
+ */
+static uint16_t si7021_code(float value, float offset, float scale, uint8_t bits)
+{
+    double code = (value + offset) * 65536 / scale;
+
+    if (code < 0)
+        code = 0;
+    if (code > 65535)
+        code = 65535;
+    return (uint16_t)code & (0xFFFF << (16 - bits));
+}
+
+/**
+ * @brief    Si7021 checksum, CRC-8 with polynomial x^8 + x^5 + x^4 + 1
+ *
+ * @param    data: Bytes
+ * @param    len: Number of bytes
+ * @return   uint8_t checksum
+ */
+static uint8_t si7021_crc(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * @brief    PIR edge, calls the interrupt handler and schedules the next edge
+ *
+ * @param    args: -1 to only schedule the first edge
+ */
+static void pir_edge(intptr_t args)
+{
+    if (args >= 0 && pir_isr != NULL)
+        pir_isr(pir_isr_args);
+
+    int64_t edge = sim_pir_next_edge(sim_wall());
+    if (edge != SIM_FOREVER)
+        sim_post(sim_now + edge - sim_wall(), pir_edge, 0);
+}
+
+/**
+ * @brief    NVS entry of an open namespace
+ *
+ * @param    handle: Namespace handle
+ * @param    key: Entry key
+ * @param    create: Allocate the entry if missing
+ * @return   sim_nvs_entry_t* entry, NULL if missing or full
+ */
+static sim_nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key, uint8_t create)
+{
+    sim_nvs_entry_t *empty = NULL;
+
+    if (handle < 1 || handle > NVS_HANDLES_MAX || nvs_handles[handle - 1].space == NULL)
+        return NULL;
+
+    const char *space = nvs_handles[handle - 1].space;
+
+    for (uint8_t i = 0; i < SIM_NVS_ENTRIES; i++)
+    {
+        sim_nvs_entry_t *entry = &sim_shared->nvs[i];
+
+        if (!entry->used)
+        {
+            if (empty == NULL)
+                empty = entry;
+            continue;
+        }
+        if (!strcmp(entry->space, space) && !strcmp(entry->key, key))
+            return entry;
+    }
+
+    if (!create || empty == NULL)
+        return NULL;
+
+    snprintf(empty->space, sizeof(empty->space), "%s", space);
+    snprintf(empty->key, sizeof(empty->key), "%s", key);
+    empty->length = 0;
+    empty->used = 1;
+    return empty;
+}
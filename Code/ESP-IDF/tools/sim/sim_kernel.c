@@ -0,0 +1,464 @@
+/**
+ * @file     sim_kernel.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Discrete event scheduler of the host simulation and the
+ *           FreeRTOS functions built on it.
+ *           Tasks are coroutines that run until they wait: for a time,
+ *           for a condition or both. The scheduler then runs whatever
+ *           comes first, a task or a driver event, and moves the
+ *           simulated time to it. Code runs in no time, the time spent
+ *           is the one of the waits and of the driver latencies.
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "sim.h"
+
+#define SIM_TASKS_MAX 8
+#define SIM_EVENTS_MAX 64
+#define SIM_STACK_SIZE (256 * 1024) // Host stack of every task, printf included
+
+typedef enum
+{
+    TASK_FREE = 0,
+    TASK_READY,   // Runs at ready_at
+    TASK_BLOCKED, // Runs when its condition is met or at its deadline
+    TASK_DONE,
+} task_state_t;
+
+typedef struct
+{
+    ucontext_t context;
+    void *stack;
+    TaskFunction_t code;
+    void *args;
+    uint8_t state;             // task_state_t
+    int64_t ready_at;          // [us]
+    uint8_t (*ready)(void *);  // Condition of a blocked task
+    void *ready_args;
+    int64_t deadline;          // Timeout of a blocked task [us]
+    uint32_t notify;           // Notification count
+} sim_task_t;
+
+typedef struct
+{
+    int64_t at;   // [us]
+    uint32_t seq; // Events of the same time run in posting order
+    sim_event_fn_t fn;
+    intptr_t args;
+} sim_event_t;
+
+struct sim_semaphore
+{
+    uint8_t given;
+};
+
+struct sim_event_group
+{
+    EventBits_t bits;
+};
+
+// Event group condition
+typedef struct
+{
+    struct sim_event_group *group;
+    EventBits_t bits;
+    BaseType_t wait_for_all;
+} bits_wait_t;
+
+// Global variables
+int64_t sim_now;
+
+static sim_task_t tasks[SIM_TASKS_MAX];
+static sim_task_t *current;
+static sim_task_t *main_task_handle;
+static void (*main_task_code)(void);
+static ucontext_t scheduler;
+
+static sim_event_t events[SIM_EVENTS_MAX];
+static uint8_t events_count;
+static uint32_t events_seq;
+
+// Private function declarations
+static sim_task_t *task_create(TaskFunction_t code, void *args);
+static void task_entry(void);
+static void task_switch(void);
+static void main_entry(void *args);
+static sim_event_t *event_next(void);
+static uint8_t task_notified(void *args);
+static uint8_t semaphore_given(void *args);
+static uint8_t bits_set(void *args);
+
+// Functions
+
+/**
+ * @brief    Run the main task and everything it starts, until deep sleep
+ *           ends the wake
+ *
+ * @param    main_task: Main task function
+ */
+void sim_run(void (*main_task)(void))
+{
+    main_task_code = main_task;
+    main_task_handle = task_create(main_entry, NULL);
+
+    while (1)
+    {
+        sim_task_t *next = NULL;
+        int64_t at = SIM_FOREVER;
+
+        for (uint8_t i = 0; i < SIM_TASKS_MAX; i++)
+        {
+            sim_task_t *task = &tasks[i];
+            int64_t time;
+
+            if (task->state == TASK_READY)
+                time = task->ready_at;
+            else if (task->state == TASK_BLOCKED)
+                time = task->ready(task->ready_args) ? sim_now : task->deadline;
+            else
+                continue;
+
+            if (time < at)
+            {
+                at = time;
+                next = task;
+            }
+        }
+
+        sim_event_t *event = event_next();
+        if (event != NULL && event->at <= at) // Driver events first
+        {
+            sim_event_t run = *event;
+
+            *event = events[--events_count];
+            if (run.at > sim_now)
+                sim_now = run.at;
+            run.fn(run.args);
+            continue;
+        }
+
+        if (next == NULL)
+        {
+            if (main_task_handle->state == TASK_FREE)
+                printf("app_main returned without deep sleep\n");
+            else
+                printf("Every task waits forever\n");
+            sim_end(SIM_END_HANG);
+        }
+
+        if (at > sim_now)
+            sim_now = at;
+        if (sim_now > SIM_AWAKE_MAX_US)
+        {
+            printf("Awake for more than %d s\n", SIM_AWAKE_MAX_US / 1000000);
+            sim_end(SIM_END_HANG);
+        }
+
+        current = next;
+        next->state = TASK_READY;
+        swapcontext(&scheduler, &next->context);
+        current = NULL;
+
+        if (next->state == TASK_DONE)
+        {
+            free(next->stack);
+            next->state = TASK_FREE;
+        }
+    }
+}
+
+/**
+ * @brief    Keep the running task busy or asleep for a time
+ *
+ * @param    us: Time [us]
+ */
+void sim_advance(int64_t us)
+{
+    if (current == NULL)
+    {
+        fprintf(stderr, "Driver event handlers can't wait\n");
+        abort();
+    }
+
+    current->ready_at = sim_now + (us > 0 ? us : 0);
+    task_switch();
+}
+
+/**
+ * @brief    Wait for a condition, set by another task or a driver event
+ *
+ * @param    ready: Condition function
+ * @param    args: Condition function arguments
+ * @param    deadline: Timeout [us], SIM_FOREVER for none
+ * @return   uint8_t: 1 condition met, 0 timeout
+ */
+uint8_t sim_block(uint8_t (*ready)(void *args), void *args, int64_t deadline)
+{
+    if (ready(args))
+        return 1;
+    if (deadline <= sim_now)
+        return 0;
+
+    current->ready = ready;
+    current->ready_args = args;
+    current->deadline = deadline;
+    current->state = TASK_BLOCKED;
+    task_switch();
+
+    return ready(args);
+}
+
+/**
+ * @brief    Time at which a wait of a number of ticks ends. A FreeRTOS
+ *           task wakes on a tick interrupt, so the first tick counts
+ *           only for the rest of its period.
+ *
+ * @param    ticks: Ticks to wait
+ * @return   int64_t end of the wait [us]
+ */
+int64_t sim_tick_deadline(uint32_t ticks)
+{
+    const int64_t tick_us = 1000000 / configTICK_RATE_HZ;
+
+    if (ticks == portMAX_DELAY)
+        return SIM_FOREVER;
+
+    return (sim_now / tick_us + ticks) * tick_us;
+}
+
+/**
+ * @brief    Schedule a driver event, run by the scheduler outside of any task
+ *
+ * @param    at: Event time [us]
+ * @param    fn: Event function
+ * @param    args: Event function arguments
+ */
+void sim_post(int64_t at, sim_event_fn_t fn, intptr_t args)
+{
+    if (events_count >= SIM_EVENTS_MAX)
+    {
+        fprintf(stderr, "Too many pending driver events\n");
+        abort();
+    }
+
+    events[events_count++] = (sim_event_t){.at = at, .seq = events_seq++, .fn = fn, .args = args};
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    sim_task_t *task = task_create(task_code, parameters);
+
+    if (task == NULL)
+        return pdFAIL;
+    if (created_task != NULL)
+        *created_task = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task != NULL && task != current)
+    {
+        fprintf(stderr, "Only tasks deleting themselves are simulated\n");
+        abort();
+    }
+
+    current->state = TASK_DONE;
+    swapcontext(&current->context, &scheduler);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_advance(sim_tick_deadline(ticks) - sim_now);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    ((sim_task_t *)task)->notify++;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    sim_task_t *self = current;
+
+    if (!sim_block(task_notified, self, sim_tick_deadline(ticks)))
+        return 0;
+
+    uint32_t count = self->notify;
+    self->notify = clear_on_exit ? 0 : count - 1;
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return calloc(1, sizeof(struct sim_semaphore));
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    if (!sim_block(semaphore_given, semaphore, sim_tick_deadline(ticks)))
+        return pdFALSE;
+
+    semaphore->given = 0;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    if (semaphore->given)
+        return pdFALSE;
+
+    semaphore->given = 1;
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear_on_exit,
+                                const BaseType_t wait_for_all, TickType_t ticks)
+{
+    bits_wait_t wait = {.group = group, .bits = bits, .wait_for_all = wait_for_all};
+    uint8_t ready = sim_block(bits_set, &wait, sim_tick_deadline(ticks));
+    EventBits_t value = group->bits;
+
+    if (ready && clear_on_exit)
+        group->bits &= ~bits;
+    return value;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits)
+{
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits)
+{
+    EventBits_t value = group->bits;
+
+    group->bits &= ~bits;
+    return value;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, const EventBits_t bits, BaseType_t *higher_priority_task_woken)
+{
+    xEventGroupSetBits(group, bits);
+    if (higher_priority_task_woken != NULL)
+        *higher_priority_task_woken = pdTRUE;
+    return pdPASS;
+}
+
+/**
+ * @brief    Allocate a task, it starts at the current time
+ *
+ * @param    code: Task function
+ * @param    args: Task function arguments
+ * @return   sim_task_t* task, NULL if none is free
+ */
+static sim_task_t *task_create(TaskFunction_t code, void *args)
+{
+    for (uint8_t i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        sim_task_t *task = &tasks[i];
+
+        if (task->state != TASK_FREE)
+            continue;
+
+        task->stack = malloc(SIM_STACK_SIZE);
+        if (task->stack == NULL)
+            return NULL;
+
+        getcontext(&task->context);
+        task->context.uc_stack.ss_sp = task->stack;
+        task->context.uc_stack.ss_size = SIM_STACK_SIZE;
+        task->context.uc_link = NULL;
+        makecontext(&task->context, task_entry, 0);
+
+        task->code = code;
+        task->args = args;
+        task->ready_at = sim_now;
+        task->notify = 0;
+        task->state = TASK_READY;
+        return task;
+    }
+    return NULL;
+}
+
+/**
+ * @brief    First function of every task, a task returning is deleted
+ *
+ */
+static void task_entry(void)
+{
+    current->code(current->args);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief    Give the CPU back to the scheduler
+ *
+ */
+static void task_switch(void)
+{
+    swapcontext(&current->context, &scheduler);
+}
+
+/**
+ * @brief    Main task, calls app_main
+ *
+ * @param    args: Unused
+ */
+static void main_entry(void *args)
+{
+    main_task_code();
+}
+
+/**
+ * @brief    Earliest pending driver event
+ *
+ * @return   sim_event_t* event, NULL if none
+ */
+static sim_event_t *event_next(void)
+{
+    sim_event_t *next = NULL;
+
+    for (uint8_t i = 0; i < events_count; i++)
+        if (next == NULL || events[i].at < next->at || (events[i].at == next->at && events[i].seq < next->seq))
+            next = &events[i];
+    return next;
+}
+
+static uint8_t task_notified(void *args)
+{
+    return ((sim_task_t *)args)->notify > 0;
+}
+
+static uint8_t semaphore_given(void *args)
+{
+    return ((struct sim_semaphore *)args)->given;
+}
+
+static uint8_t bits_set(void *args)
+{
+    const bits_wait_t *wait = args;
+    EventBits_t set = wait->group->bits & wait->bits;
+
+    return wait->wait_for_all ? set == wait->bits : set != 0;
+}
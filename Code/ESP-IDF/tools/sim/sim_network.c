@@ -0,0 +1,419 @@
+/**
+ * @file     sim_network.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Simulated network stack: default event loop, Wi-Fi station
+ *           with its scan, association and IP configuration, and the
+ *           MQTT client with its broker. Every step is a driver event
+ *           at the time given by the latency model, handlers run as
+ *           they would in the event loop task.
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_wifi.h>
+#include <tcpip_adapter.h>
+#include <mqtt_client.h>
+
+#include "sim.h"
+
+#define EVENT_HANDLERS_MAX 8
+#define MQTT_OUTBOX_MAX 64
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *args;
+} event_handler_t;
+
+typedef enum
+{
+    NET_STA_START = 0,
+    NET_CONNECTED,
+    NET_DISCONNECTED,
+    NET_GOT_IP,
+    NET_MQTT_CONNECTED,
+    NET_MQTT_ERROR,
+    NET_MQTT_ACK,
+} net_event_t;
+
+struct esp_mqtt_client
+{
+    esp_event_handler_t handler;
+    void *args;
+    uint8_t connected;
+    int msg_id;
+    int outbox[MQTT_OUTBOX_MAX]; // Messages published before the connection
+    uint8_t outbox_count;
+};
+
+// Global variables
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static event_handler_t event_handlers[EVENT_HANDLERS_MAX];
+static uint8_t event_handlers_count;
+static uint8_t event_loop_created;
+
+static wifi_config_t wifi_config;
+static uint8_t wifi_initialized;
+static uint8_t wifi_started;
+static uint8_t wifi_has_ip;
+static uint32_t wifi_generation; // Pending events of a stopped station are dropped
+static uint8_t dhcp_stopped;
+static tcpip_adapter_ip_info_t static_ip_info;
+
+static int64_t radio_on_at = -1;
+static int64_t radio_time;
+
+static struct esp_mqtt_client mqtt_client;
+
+static const uint8_t ap_bssid[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+static const uint8_t ap_channel = 6;
+
+// Private function declarations
+static void event_dispatch(esp_event_base_t base, int32_t id, void *data);
+static void net_post(int64_t at, net_event_t event, int32_t args);
+static void net_event(intptr_t args);
+static void radio_on(void);
+static void radio_off(void);
+
+// Functions
+
+/**
+ * @brief    Time the radio was on during the wake
+ *
+ * @return   int64_t time [us]
+ */
+int64_t sim_radio_time(void)
+{
+    radio_off();
+    return radio_time;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (event_loop_created)
+        return ESP_ERR_INVALID_STATE;
+
+    event_loop_created = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (!event_loop_created)
+        return ESP_ERR_INVALID_STATE;
+    if (event_handlers_count >= EVENT_HANDLERS_MAX)
+        return ESP_ERR_NO_MEM;
+
+    event_handlers[event_handlers_count++] = (event_handler_t){event_base, event_id, event_handler, event_handler_arg};
+    return ESP_OK;
+}
+
+void tcpip_adapter_init(void)
+{
+}
+
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if)
+{
+    dhcp_stopped = 0;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if)
+{
+    dhcp_stopped = 1;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if, const tcpip_adapter_ip_info_t *ip_info)
+{
+    if (!dhcp_stopped)
+        return ESP_ERR_INVALID_STATE; // As the adapter, DHCP client first
+
+    static_ip_info = *ip_info;
+    return ESP_OK;
+}
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr)
+{
+    unsigned int a, b, c, d;
+
+    if (sscanf(cp, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+        return 0;
+
+    addr->addr = a | b << 8 | c << 16 | d << 24; // Network order
+    return 1;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    if (wifi_initialized)
+        return ESP_OK;
+
+    sim_advance(SIM_WIFI_INIT_US);
+    wifi_initialized = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return wifi_initialized ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!wifi_initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+
+    wifi_config = *conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!wifi_initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+
+    *conf = wifi_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!wifi_initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (wifi_started)
+        return ESP_OK;
+
+    radio_on();
+    sim_advance(SIM_WIFI_START_US);
+    wifi_started = 1;
+    net_post(sim_now, NET_STA_START, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    if (!wifi_started)
+        return ESP_OK;
+
+    wifi_started = 0;
+    wifi_has_ip = 0;
+    wifi_generation++;
+    mqtt_client.connected = 0;
+    radio_off();
+    return ESP_OK;
+}
+
+/**
+ * @brief    Connect to the access point. A directed connection to a known
+ *           access point skips the scan, a static or cached IP skips DHCP.
+ */
+esp_err_t esp_wifi_connect(void)
+{
+    if (!wifi_started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+
+    int64_t at = sim_now + SIM_WIFI_ASSOC_US;
+    if (!wifi_config.sta.bssid_set || !wifi_config.sta.channel)
+        at += SIM_WIFI_SCAN_US;
+
+    if (sim_chance(SIM_WIFI_FAIL_PERCENT))
+    {
+        net_post(at, NET_DISCONNECTED, 0);
+        return ESP_OK;
+    }
+
+    net_post(at, NET_CONNECTED, 0);
+    net_post(at + (dhcp_stopped ? SIM_WIFI_STATIC_IP_US : SIM_WIFI_DHCP_US), NET_GOT_IP, 0);
+    return ESP_OK;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    memset(&mqtt_client, 0, sizeof(mqtt_client));
+    return &mqtt_client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    client->handler = event_handler;
+    client->args = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    net_post(sim_now + SIM_MQTT_CONNECT_US, wifi_has_ip ? NET_MQTT_CONNECTED : NET_MQTT_ERROR, 0);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    if (!client->connected)
+        return -1;
+
+    return ++client->msg_id; // No retained message on the simulated broker
+}
+
+/**
+ * @brief    Publish a message. Before the connection the message waits in
+ *           the outbox, after it the task spends the send time and the ack
+ *           comes one round trip later, unless the message is lost.
+ */
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    int msg_id = ++client->msg_id;
+
+    sim_shared->result.published++;
+
+    if (!client->connected)
+    {
+        if (client->outbox_count >= MQTT_OUTBOX_MAX)
+            return -1;
+        client->outbox[client->outbox_count++] = msg_id;
+        return msg_id;
+    }
+
+    sim_advance(SIM_MQTT_SEND_US);
+    if (!sim_chance(SIM_MQTT_LOSS_PERCENT))
+        net_post(sim_now + SIM_MQTT_ACK_US, NET_MQTT_ACK, msg_id);
+    return msg_id;
+}
+
+/**
+ * @brief    Call the event loop handlers of an event
+ *
+ * @param    base: Event base
+ * @param    id: Event id
+ * @param    data: Event data
+ */
+static void event_dispatch(esp_event_base_t base, int32_t id, void *data)
+{
+    for (uint8_t i = 0; i < event_handlers_count; i++)
+        if (event_handlers[i].base == base && (event_handlers[i].id == ESP_EVENT_ANY_ID || event_handlers[i].id == id))
+            event_handlers[i].handler(event_handlers[i].args, base, id, data);
+}
+
+/**
+ * @brief    Schedule a network event of the current station
+ *
+ * @param    at: Event time [us]
+ * @param    event: Event
+ * @param    args: Message id of an ack
+ */
+static void net_post(int64_t at, net_event_t event, int32_t args)
+{
+    intptr_t packed = (intptr_t)wifi_generation << 40 | (intptr_t)event << 32 | (uint32_t)args;
+
+    sim_post(at, net_event, packed);
+}
+
+/**
+ * @brief    Network event, dropped if the station stopped since it was posted
+ *
+ * @param    args: Packed generation, event and message id
+ */
+static void net_event(intptr_t args)
+{
+    net_event_t event = (args >> 32) & 0xFF;
+    int32_t msg_id = (int32_t)(args & 0xFFFFFFFF);
+    esp_mqtt_event_t mqtt_event = {.client = &mqtt_client, .msg_id = msg_id};
+
+    if ((uint32_t)(args >> 40) != wifi_generation)
+        return;
+
+    switch (event)
+    {
+    case NET_STA_START:
+        event_dispatch(WIFI_EVENT, WIFI_EVENT_STA_START, NULL);
+        break;
+
+    case NET_CONNECTED:
+    {
+        wifi_event_sta_connected_t connected = {.channel = ap_channel, .authmode = WIFI_AUTH_WPA2_PSK};
+
+        memcpy(connected.bssid, ap_bssid, sizeof(ap_bssid));
+        event_dispatch(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &connected);
+        break;
+    }
+
+    case NET_DISCONNECTED:
+    {
+        wifi_event_sta_disconnected_t disconnected = {.reason = 201}; // No access point found
+        event_dispatch(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnected);
+        break;
+    }
+
+    case NET_GOT_IP:
+    {
+        ip_event_got_ip_t got_ip = {.if_index = TCPIP_ADAPTER_IF_STA, .ip_changed = 1};
+
+        if (dhcp_stopped)
+            got_ip.ip_info = static_ip_info;
+        else
+            ip4addr_aton("192.168.1.50", &got_ip.ip_info.ip); // DHCP lease
+        wifi_has_ip = 1;
+        sim_shared->result.connections++;
+        event_dispatch(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip);
+        break;
+    }
+
+    case NET_MQTT_CONNECTED:
+        mqtt_client.connected = 1;
+        mqtt_event.event_id = MQTT_EVENT_CONNECTED;
+        mqtt_client.handler(mqtt_client.args, "MQTT_EVENTS", MQTT_EVENT_CONNECTED, &mqtt_event);
+
+        for (uint8_t i = 0; i < mqtt_client.outbox_count; i++) // Outbox sent back to back
+            if (!sim_chance(SIM_MQTT_LOSS_PERCENT))
+                net_post(sim_now + (i + 1) * SIM_MQTT_SEND_US + SIM_MQTT_ACK_US, NET_MQTT_ACK, mqtt_client.outbox[i]);
+        mqtt_client.outbox_count = 0;
+        break;
+
+    case NET_MQTT_ERROR:
+        mqtt_event.event_id = MQTT_EVENT_ERROR;
+        mqtt_client.handler(mqtt_client.args, "MQTT_EVENTS", MQTT_EVENT_ERROR, &mqtt_event);
+        break;
+
+    case NET_MQTT_ACK:
+        if (!mqtt_client.connected)
+            break;
+        sim_shared->result.acked++;
+        mqtt_event.event_id = MQTT_EVENT_PUBLISHED;
+        mqtt_client.handler(mqtt_client.args, "MQTT_EVENTS", MQTT_EVENT_PUBLISHED, &mqtt_event);
+        break;
+    }
+}
+
+/**
+ * @brief    Start counting radio time
+ *
+ */
+static void radio_on(void)
+{
+    if (radio_on_at < 0)
+        radio_on_at = sim_now;
+}
+
+/**
+ * @brief    Stop counting radio time
+ *
+ */
+static void radio_off(void)
+{
+    if (radio_on_at < 0)
+        return;
+
+    radio_time += sim_now - radio_on_at;
+    radio_on_at = -1;
+}
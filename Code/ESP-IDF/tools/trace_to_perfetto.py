@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""
+@file     trace_to_perfetto.py
+@author   Nicholas Polledri
+@version  1.0
+@date     17-10-2026
+
+@brief    Convert the wake trace published on the diagnostics topic
+          (TRACE_PUBLISH) into a Chrome trace / Perfetto JSON file.
+          Every wake is placed at its wakeup timestamp, the CPU phases
+          on one track and the radio on another, sends and acks are
+          instant events.
+
+          Input on stdin, one event per line:
+          wake_time [sec],cause,phase,start [us],duration [us]
+
+          Run from Code/ESP-IDF:
+          mosquitto_sub -t ESP32-SensorNode/diagnostics | tools/trace_to_perfetto.py > trace.json
+          then open trace.json in https://ui.perfetto.dev or chrome://tracing
+"""
+
+import json
+import sys
+
+CPU_TRACK = 1
+RADIO_TRACK = 2
+
+INSTANTS = {"mqtt send", "mqtt ack", "deep sleep"}
+
+# esp_sleep_wakeup_cause_t
+CAUSES = {0: "reset", 2: "pir", 4: "timer"}
+
+
+def main():
+    events = [
+        {"ph": "M", "pid": 1, "name": "process_name", "args": {"name": "sensor node"}},
+        {"ph": "M", "pid": 1, "tid": CPU_TRACK, "name": "thread_name", "args": {"name": "cpu"}},
+        {"ph": "M", "pid": 1, "tid": RADIO_TRACK, "name": "thread_name", "args": {"name": "radio"}},
+    ]
+    seen = set()
+
+    for line in sys.stdin:
+        fields = line.strip().split(",")
+        if len(fields) != 5:
+            continue
+        wake_time, cause, phase, start, duration = fields
+        key = tuple(fields)
+        if key in seen:  # Events of a message resent before its ack
+            continue
+        seen.add(key)
+
+        event = {
+            "name": phase,
+            "pid": 1,
+            "tid": RADIO_TRACK if phase == "radio" else CPU_TRACK,
+            "ts": int(wake_time) * 1000000 + int(start),
+            "args": {"wake": int(wake_time), "cause": CAUSES.get(int(cause), cause)},
+        }
+        if phase in INSTANTS:
+            event.update(ph="i", s="t")
+        else:
+            event.update(ph="X", dur=int(duration))
+        events.append(event)
+
+    json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, sys.stdout, indent=1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+/**
+ * @file     wake_emulator.c
+ * @author   Nicholas Polledri
+ * @version  1.0
+ * @date     17-10-2026
+ *
+ * @brief    Host emulator of the wakeup report decision.
+ *           Runs recorded readings through decision.h with the thresholds
+ *           of configuration.h, and prints which wakeups would need the
+ *           main core to report and which would go straight back to sleep.
+ *
+ *           Input on stdin, one reading per line:
+ *           timestamp [sec],light [lx],temperature [°C/°F],humidity [%]
+ *
+ *           Build and run from Code/ESP-IDF:
+ *           gcc -O2 -Iinclude tools/wake_emulator.c -o wake_emulator -lm && ./wake_emulator < readings.csv
+ */
+
+// Include libraries
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "configuration.h"
+#include "decision.h"
+
+typedef struct
+{
+    const char *name;
+    decision_config_t decision; // Same policy and thresholds as channels.c
+    float scale;                // Fixed point units per input unit
+} emulated_channel_t;
+
+static const emulated_channel_t emulated_channels[] = {
+    {"light", {LIGHT_UPDATE_POLICY, LIGHT_UPDATE_THRESHOLD, LIGHT_UPDATE_RELATIVE * 10, SENSOR_UPDATE_INTERVAL_MAX}, 1},
+    {"temperature", {TEMPERATURE_UPDATE_POLICY, DECISION_CENTI(TEMPERATURE_UPDATE_THRESHOLD), 0, SENSOR_UPDATE_INTERVAL_MAX}, 100},
+    {"humidity", {HUMIDITY_UPDATE_POLICY, DECISION_CENTI(HUMIDITY_UPDATE_THRESHOLD), 0, SENSOR_UPDATE_INTERVAL_MAX}, 100},
+};
+
+#define EMULATED_CHANNELS (sizeof(emulated_channels) / sizeof(emulated_channels[0]))
+
+// Functions
+
+/**
+ * @brief    Main function
+ *
+ */
+int main(void)
+{
+    channel_state_t states[EMULATED_CHANNELS] = {0};
+    unsigned long reports[EMULATED_CHANNELS] = {0};
+    unsigned long wakeups = 0, reporting_wakeups = 0;
+    long timestamp;
+    float input[EMULATED_CHANNELS];
+
+    while (scanf("%ld,%f,%f,%f", &timestamp, &input[0], &input[1], &input[2]) == 4)
+    {
+        uint8_t report = 0;
+
+        for (size_t id = 0; id < EMULATED_CHANNELS; id++)
+        {
+            int32_t value = lroundf(input[id] * emulated_channels[id].scale);
+
+            if (decision_update(&states[id], &emulated_channels[id].decision, value, timestamp))
+            {
+                report |= 1 << id;
+                reports[id]++;
+            }
+        }
+
+        wakeups++;
+        if (report)
+        {
+            reporting_wakeups++;
+            printf("%ld wake", timestamp);
+            for (size_t id = 0; id < EMULATED_CHANNELS; id++)
+                if (report & (1 << id))
+                    printf(" %s", emulated_channels[id].name);
+            printf("\n");
+        }
+    }
+
+    printf("wakeups: %lu, main core needed: %lu, back to sleep: %lu\n",
+           wakeups, reporting_wakeups, wakeups - reporting_wakeups);
+    for (size_t id = 0; id < EMULATED_CHANNELS; id++)
+        printf("%s reports: %lu\n", emulated_channels[id].name, reports[id]);
+
+    return 0;
+}